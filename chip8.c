@@ -5,16 +5,21 @@
 // src: 
 // https:\\www.laurencescotford.net\2020\07\25\chip-8-on-the-cosmac-vip-instruction-index\
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include "chip8.h"
 #include "chip8_defines.h"
 
-#define X ((chip8->opcode >> 8) & 0x0F) // X register index
-#define Y ((chip8->opcode >> 4) & 0x00F) // Y register index
-#define NNN (chip8->opcode & 0x0FFF)
-#define NN (chip8->opcode & 0x00FF)
-#define N (chip8->opcode & 0x000F)
+#ifdef CHIP8_AUDIO_SYNTH
+#include "chip8_audio.h"
+#endif
+
+#define X ((opcode >> 8) & 0x0F) // X register index
+#define Y ((opcode >> 4) & 0x00F) // Y register index
+#define NNN (opcode & 0x0FFF)
+#define NN (opcode & 0x00FF)
+#define N (opcode & 0x000F)
 
 #define VX chip8->v[X]
 #define VY chip8->v[Y]
@@ -23,6 +28,37 @@
 #define PC chip8->pc
 #define SP chip8->sp
 
+#if defined(__GNUC__) || defined(__clang__)
+#define CHIP8_INLINE static inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#define CHIP8_INLINE static __forceinline
+#else
+#define CHIP8_INLINE static inline
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define CHIP8_POPCOUNT64(x) __builtin_popcountll(x)
+#elif defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#define CHIP8_POPCOUNT64(x) __popcnt64(x)
+#else
+CHIP8_INLINE int chip8_popcount64(uint64_t x) {
+	x = x - ((x >> 1) & 0x5555555555555555ULL);
+	x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+	x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return (int)((x * 0x0101010101010101ULL) >> 56);
+}
+#define CHIP8_POPCOUNT64(x) chip8_popcount64(x)
+#endif
+
+#ifdef CHIP8_PROFILER
+#define PROFILE_OP(op)		(chip8->profile.ops[op] += 1, chip8->profile.pc_hits[PC & (CHIP8_MEMORY_BYTES - 1)] += 1)
+#define PROFILE_PIXELS(row)	(chip8->profile.pixels_toggled += CHIP8_POPCOUNT64(row))
+#else
+#define PROFILE_OP(op)
+#define PROFILE_PIXELS(row)
+#endif
+
 /* Builtin font */
 static const uint8_t chip8_font[CHIP8_FONT_BYTES] = {
 	0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
@@ -43,115 +79,435 @@ static const uint8_t chip8_font[CHIP8_FONT_BYTES] = {
 	0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 };
 
+/* SCHIP big font; 8x10 digits for FX30 */
+static const uint8_t chip8_big_font[CHIP8_BIG_FONT_BYTES] = {
+	0x3C, 0x7E, 0xE7, 0xC3, 0xC3, 0xC3, 0xC3, 0xE7, 0x7E, 0x3C, // 0
+	0x18, 0x38, 0x58, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x3C, // 1
+	0x3E, 0x7F, 0xC3, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xFF, 0xFF, // 2
+	0x3C, 0x7E, 0xC3, 0x03, 0x0E, 0x0E, 0x03, 0xC3, 0x7E, 0x3C, // 3
+	0x06, 0x0E, 0x1E, 0x36, 0x66, 0xC6, 0xFF, 0xFF, 0x06, 0x06, // 4
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFE, 0x03, 0xC3, 0x7E, 0x3C, // 5
+	0x3E, 0x7C, 0xE0, 0xC0, 0xFC, 0xFE, 0xC3, 0xC3, 0x7E, 0x3C, // 6
+	0xFF, 0xFF, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x60, 0x60, // 7
+	0x3C, 0x7E, 0xC3, 0xC3, 0x7E, 0x7E, 0xC3, 0xC3, 0x7E, 0x3C, // 8
+	0x3C, 0x7E, 0xC3, 0xC3, 0x7F, 0x3F, 0x03, 0x03, 0x3E, 0x7C, // 9
+	0x3C, 0x7E, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, // A
+	0xFC, 0xFE, 0xC3, 0xC3, 0xFE, 0xFE, 0xC3, 0xC3, 0xFE, 0xFC, // B
+	0x3C, 0x7E, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0x7E, 0x3C, // C
+	0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+};
+
+CHIP8_INLINE uint8_t chip8_rng_next(uint32_t* s) {
+	/* xoshiro128**; returns the top byte */
+	uint32_t r = s[1] * 5;
+	uint32_t t = s[1] << 9;
+	r = ((r << 7) | (r >> 25)) * 9;
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = (s[3] << 11) | (s[3] >> 21);
+	return (uint8_t)(r >> 24);
+}
+
 /* Note: Opcodes that affect the VF register need to cache the value 
  * for VF prior to operation. Then after operation, assign VF to the
  * cached value. This is because VF can be used in the operation itself.
  * Setting VF early will result in an incorrect operation. */
 
+#ifdef CHIP8_NO_SCHIP
+/* Only CHIP8_PLATFORM_CHIP8 is built; SCHIP and XO-CHIP opcodes are always invalid */
+#define SCHIP_ONLY() \
+	{ \
+		chip8->cpu_state = CHIP8_STATE_ERROR_OPCODE; \
+		return; \
+	}
+#define XOCHIP_ONLY() SCHIP_ONLY()
+#else
+/* SCHIP opcodes are invalid opcodes on CHIP8_PLATFORM_CHIP8 */
+#define SCHIP_ONLY() \
+	if (chip8->platform == CHIP8_PLATFORM_CHIP8) { \
+		chip8->cpu_state = CHIP8_STATE_ERROR_OPCODE; \
+		return; \
+	}
+
+/* XO-CHIP opcodes are invalid opcodes on the other platforms */
+#define XOCHIP_ONLY() \
+	if (chip8->platform != CHIP8_PLATFORM_XOCHIP) { \
+		chip8->cpu_state = CHIP8_STATE_ERROR_OPCODE; \
+		return; \
+	}
+#endif
+
+CHIP8_INLINE uint64_t* chip8_plane(CHIP8* chip8, int plane) {
+	/* Display words of plane 0 or 1; only XO-CHIP has plane 1 */
+	return plane ? chip8->xo->display : chip8->display;
+}
+#ifndef CHIP8_NO_SCHIP
+static void chip8_draw_planes(CHIP8* chip8, uint16_t opcode, uint32_t quirks, int xo) {
+	/* SCHIP and XO-CHIP DXYN; every sprite in hires, 16x16 sprites (DXY0) in
+	 * either resolution and every XO-CHIP sprite. Each sprite row is placed at
+	 * the left edge of a display row of one or two words and rotated into
+	 * place as a whole, clipping masks off what came around from the right
+	 * edge. Every selected plane draws its own sprite, stored one after the
+	 * other from I, in the same pass over the rows. In SCHIP hires VF is the
+	 * number of rows that collided or were clipped off the bottom, as on
+	 * SCHIP 1.1; otherwise VF is 1 on any collision. */
+
+	const int hires = chip8->hires;
+	const int width = hires ? CHIP8_DISPLAY_HIRES_WIDTH : CHIP8_DISPLAY_WIDTH;
+	const int height = hires ? CHIP8_DISPLAY_HIRES_HEIGHT : CHIP8_DISPLAY_HEIGHT;
+	const int wide = (N == 0);
+	const int rows = wide ? 16 : N;
+	const int sprite_bytes = wide ? 32 : N;
+	const int count_rows = hires && chip8->platform == CHIP8_PLATFORM_SCHIP;
+	const int vx = VX & (width - 1);
+	const int vy = VY & (height - 1);
+	uint64_t clip_hi = ~0ULL;
+	uint64_t clip_lo = ~0ULL;
+	uint64_t hi, lo, t, hit, changed;
+	uint64_t* display;
+	int collisions = 0;
+	int y, row, s, p, sprite;
+
+	if (quirks & CHIP8_QUIRK_DISPLAY_CLIPPING) {
+		clip_hi = (vx < 64) ? ~0ULL >> vx : 0;
+		clip_lo = (vx < 64) ? ~0ULL : ~0ULL >> (vx - 64);
+	}
+
+	for (y = 0; y < rows; ++y) {
+		row = vy + y;
+		if (row >= height) {
+			if (quirks & CHIP8_QUIRK_DISPLAY_CLIPPING) {
+				collisions += count_rows ? rows - y : 0;
+				break;
+			}
+			row -= height;
+		}
+
+		hit = 0;
+		changed = 0;
+		sprite = I;
+
+		for (p = 0; p < 2; ++p) {
+			if (!(chip8->planes & (1 << p))) {
+				continue;
+			}
+
+			if (wide) {
+				hi = (uint64_t)((MEM_READ_BYTE(xo, sprite + y * 2) << 8) | MEM_READ_BYTE(xo, sprite + y * 2 + 1)) << 48;
+			}
+			else {
+				hi = (uint64_t)MEM_READ_BYTE(xo, sprite + y) << 56;
+			}
+			sprite += sprite_bytes;
+			display = chip8_plane(chip8, p);
+
+			if (hires) {
+				/* rotate hi:lo right by vx */
+				lo = 0;
+				s = vx;
+				if (s >= 64) {
+					lo = hi;
+					hi = 0;
+					s -= 64;
+				}
+				if (s != 0) {
+					t = hi;
+					hi = (hi >> s) | (lo << (64 - s));
+					lo = (lo >> s) | (t << (64 - s));
+				}
+				hi &= clip_hi;
+				lo &= clip_lo;
+				display += row * 2;
+				hit |= (display[0] & hi) | (display[1] & lo);
+				display[0] ^= hi;
+				display[1] ^= lo;
+				changed |= hi | lo;
+				PROFILE_PIXELS(hi);
+				PROFILE_PIXELS(lo);
+			}
+			else {
+				hi = ((hi >> vx) | (hi << ((CHIP8_DISPLAY_WIDTH - vx) & (CHIP8_DISPLAY_WIDTH - 1)))) & clip_hi;
+				display += row;
+				hit |= display[0] & hi;
+				display[0] ^= hi;
+				changed |= hi;
+				PROFILE_PIXELS(hi);
+			}
+		}
+
+		collisions += (hit != 0);
+		chip8->dirty_rows |= (uint64_t)(changed != 0) << row;
+	}
+
+	VF = count_rows ? (uint8_t)collisions : (collisions != 0);
+}
+#endif
+static void chip8_scroll_down(CHIP8* chip8, int n) {
+	/* Move the selected planes down n rows. Rows are whole words, so this is
+	 * a word copy; a hires row is a pair of words. */
+
+	const int hires = chip8->hires;
+	const int words = hires ? CHIP8_DISPLAY_WORDS : CHIP8_DISPLAY_HEIGHT;
+	const int distance = n << hires;
+	uint64_t* display;
+	uint64_t w;
+
+	for (int p = 0; p < 2; ++p) {
+		if (!(chip8->planes & (1 << p))) {
+			continue;
+		}
+		display = chip8_plane(chip8, p);
+		for (int i = words - 1; i >= 0; --i) {
+			w = (i >= distance) ? display[i - distance] : 0;
+			chip8->dirty_rows |= (uint64_t)(display[i] != w) << (i >> hires);
+			display[i] = w;
+		}
+	}
+}
+static void chip8_scroll_up(CHIP8* chip8, int n) {
+	/* Move the selected planes up n rows; see chip8_scroll_down */
+
+	const int hires = chip8->hires;
+	const int words = hires ? CHIP8_DISPLAY_WORDS : CHIP8_DISPLAY_HEIGHT;
+	const int distance = n << hires;
+	uint64_t* display;
+	uint64_t w;
+
+	for (int p = 0; p < 2; ++p) {
+		if (!(chip8->planes & (1 << p))) {
+			continue;
+		}
+		display = chip8_plane(chip8, p);
+		for (int i = 0; i < words; ++i) {
+			w = (i + distance < words) ? display[i + distance] : 0;
+			chip8->dirty_rows |= (uint64_t)(display[i] != w) << (i >> hires);
+			display[i] = w;
+		}
+	}
+}
+static void chip8_scroll_right(CHIP8* chip8) {
+	/* Move the selected planes right 4 pixels; in hires the left word carries into the right */
+
+	uint64_t* display;
+	uint64_t hi, lo;
+
+	for (int p = 0; p < 2; ++p) {
+		if (!(chip8->planes & (1 << p))) {
+			continue;
+		}
+		display = chip8_plane(chip8, p);
+		if (chip8->hires) {
+			for (int y = 0; y < CHIP8_DISPLAY_HIRES_HEIGHT; ++y) {
+				hi = display[y * 2];
+				lo = display[y * 2 + 1];
+				display[y * 2] = hi >> 4;
+				display[y * 2 + 1] = (lo >> 4) | (hi << 60);
+				chip8->dirty_rows |= (uint64_t)((hi | lo) != 0) << y;
+			}
+		}
+		else {
+			for (int y = 0; y < CHIP8_DISPLAY_HEIGHT; ++y) {
+				chip8->dirty_rows |= (uint64_t)(display[y] != 0) << y;
+				display[y] >>= 4;
+			}
+		}
+	}
+}
+static void chip8_scroll_left(CHIP8* chip8) {
+	/* Move the selected planes left 4 pixels; in hires the right word carries into the left */
+
+	uint64_t* display;
+	uint64_t hi, lo;
+
+	for (int p = 0; p < 2; ++p) {
+		if (!(chip8->planes & (1 << p))) {
+			continue;
+		}
+		display = chip8_plane(chip8, p);
+		if (chip8->hires) {
+			for (int y = 0; y < CHIP8_DISPLAY_HIRES_HEIGHT; ++y) {
+				hi = display[y * 2];
+				lo = display[y * 2 + 1];
+				display[y * 2] = (hi << 4) | (lo >> 60);
+				display[y * 2 + 1] = lo << 4;
+				chip8->dirty_rows |= (uint64_t)((hi | lo) != 0) << y;
+			}
+		}
+		else {
+			for (int y = 0; y < CHIP8_DISPLAY_HEIGHT; ++y) {
+				chip8->dirty_rows |= (uint64_t)(display[y] != 0) << y;
+				display[y] <<= 4;
+			}
+		}
+	}
+}
+static void chip8_clear_planes(CHIP8* chip8, int planes) {
+	/* Zero the given planes; a hires row is two words */
+
+	const int hires = chip8->hires;
+	const int words = hires ? CHIP8_DISPLAY_WORDS : CHIP8_DISPLAY_HEIGHT;
+	uint64_t* display;
+
+	for (int p = 0; p < 2; ++p) {
+		if (!(planes & (1 << p))) {
+			continue;
+		}
+		display = chip8_plane(chip8, p);
+		for (int i = 0; i < words; ++i) {
+			chip8->dirty_rows |= (uint64_t)(display[i] != 0) << (i >> hires);
+			display[i] = 0;
+		}
+	}
+}
+static void chip8_set_hires(CHIP8* chip8, uint8_t hires) {
+	/* Change resolution. The display is cleared and every row of the new
+	 * resolution is dirty, so the host redraws it at the new size. */
+
+	if (chip8->hires == hires) {
+		return;
+	}
+	chip8_zero_video_memory(chip8);
+	chip8->hires = hires;
+	chip8->dirty_rows = hires ? CHIP8_DISPLAY_HIRES_ROWS_ALL : CHIP8_DISPLAY_ROWS_ALL;
+}
+CHIP8_INLINE void chip8_skip(CHIP8* chip8, int xo) {
+	/* Skip the instruction after the one at pc; XO-CHIP F000 NNNN is two words long */
+
+	if (xo && XO_GET_OPCODE(PC + 2) == 0xF000) {
+		PC += 2;
+	}
+	PC += 2;
+}
+
 /* OPCODES*/
 
-static void chip8_00E0(CHIP8* chip8) {
+CHIP8_INLINE void chip8_00E0(CHIP8* chip8, uint32_t quirks) {
 	// CLS
-	chip8_zero_video_memory(chip8);
-	if (chip8->quirks & CHIP8_QUIRK_DISPLAY_WAIT) {
+	PROFILE_OP(CHIP8_OP_00E0);
+	chip8_clear_planes(chip8, chip8->planes);
+	if (quirks & CHIP8_QUIRK_DISPLAY_WAIT) {
 		chip8->draw_display = 1;
 	}
 	PC += 2;
 }
-static void chip8_00EE(CHIP8* chip8) {
+CHIP8_INLINE void chip8_00EE(CHIP8* chip8) {
 	// RET
-	PC = chip8->stack[SP];
+	PROFILE_OP(CHIP8_OP_00EE);
+	PC = chip8->stack[SP & (CHIP8_STACK_SIZE - 1)];
 	SP -= 1;
 	PC += 2;
 }
-static void chip8_1NNN(CHIP8* chip8) {
+CHIP8_INLINE void chip8_1NNN(CHIP8* chip8, uint16_t opcode) {
 	// JMP NNN
+	PROFILE_OP(CHIP8_OP_1NNN);
+	if (NNN == PC) {
+		/* jump to self; nothing can leave the loop */
+		chip8->cpu_state = CHIP8_STATE_HLT;
+	}
 	PC = NNN;
 }
-static void chip8_2NNN(CHIP8* chip8) {
+CHIP8_INLINE void chip8_2NNN(CHIP8* chip8, uint16_t opcode) {
 	// CALL NNN
+	PROFILE_OP(CHIP8_OP_2NNN);
 	SP += 1;
-	chip8->stack[SP] = PC;
+	chip8->stack[SP & (CHIP8_STACK_SIZE - 1)] = PC;
 	PC = NNN;
 }
-static void chip8_3XNN(CHIP8* chip8) {
+CHIP8_INLINE void chip8_3XNN(CHIP8* chip8, uint16_t opcode, int xo) {
 	// SE VX, NN
+	PROFILE_OP(CHIP8_OP_3XNN);
 	if (VX == NN) {
-		PC += 2;
+		chip8_skip(chip8, xo);
 	}
 	PC += 2;
 }
-static void chip8_4XNN(CHIP8* chip8) {
+CHIP8_INLINE void chip8_4XNN(CHIP8* chip8, uint16_t opcode, int xo) {
 	// SNE VX, NN
+	PROFILE_OP(CHIP8_OP_4XNN);
 	if (VX != NN) {
-		PC += 2;
+		chip8_skip(chip8, xo);
 	}
 	PC += 2;
 }
-static void chip8_5XY0(CHIP8* chip8) {
+CHIP8_INLINE void chip8_5XY0(CHIP8* chip8, uint16_t opcode, int xo) {
 	// SE VX, VY
+	PROFILE_OP(CHIP8_OP_5XY0);
 	if (VX == VY) {
-		PC += 2;
+		chip8_skip(chip8, xo);
 	}
 	PC += 2;
 }
-static void chip8_6XNN(CHIP8* chip8) {
+CHIP8_INLINE void chip8_6XNN(CHIP8* chip8, uint16_t opcode) {
 	// LD VX, NN
+	PROFILE_OP(CHIP8_OP_6XNN);
 	VX = NN;
 	PC += 2;
 }
-static void chip8_7XNN(CHIP8* chip8) {
+CHIP8_INLINE void chip8_7XNN(CHIP8* chip8, uint16_t opcode) {
 	// ADD VX, NN
+	PROFILE_OP(CHIP8_OP_7XNN);
 	VX += NN;
 	PC += 2;
 }
-static void chip8_8XY0(CHIP8* chip8) {
+CHIP8_INLINE void chip8_8XY0(CHIP8* chip8, uint16_t opcode) {
 	// LD VX, VY
+	PROFILE_OP(CHIP8_OP_8XY0);
 	VX = VY;
 	PC += 2;
 }
-static void chip8_8XY1(CHIP8* chip8) {
+CHIP8_INLINE void chip8_8XY1(CHIP8* chip8, uint16_t opcode, uint32_t quirks) {
 	// OR VX, VY
+	PROFILE_OP(CHIP8_OP_8XY1);
 	VX |= VY;
-	if (chip8->quirks & CHIP8_QUIRK_ZERO_VF_REGISTER) {
+	if (quirks & CHIP8_QUIRK_ZERO_VF_REGISTER) {
 		VF = 0;
 	}
 	PC += 2;
 }
-static void chip8_8XY2(CHIP8* chip8) {
+CHIP8_INLINE void chip8_8XY2(CHIP8* chip8, uint16_t opcode, uint32_t quirks) {
 	// AND VX, VY
+	PROFILE_OP(CHIP8_OP_8XY2);
 	VX &= VY;
-	if (chip8->quirks & CHIP8_QUIRK_ZERO_VF_REGISTER) {
+	if (quirks & CHIP8_QUIRK_ZERO_VF_REGISTER) {
 		VF = 0;
 	}
 	PC += 2;
 }
-static void chip8_8XY3(CHIP8* chip8) {
+CHIP8_INLINE void chip8_8XY3(CHIP8* chip8, uint16_t opcode, uint32_t quirks) {
 	// XOR VX, VY
+	PROFILE_OP(CHIP8_OP_8XY3);
 	VX ^= VY;
-	if (chip8->quirks & CHIP8_QUIRK_ZERO_VF_REGISTER) {
+	if (quirks & CHIP8_QUIRK_ZERO_VF_REGISTER) {
 		VF = 0;
 	}
 	PC += 2;
 }
-static void chip8_8XY4(CHIP8* chip8) {
+CHIP8_INLINE void chip8_8XY4(CHIP8* chip8, uint16_t opcode) {
 	// ADD VX, VY ; set VF = carry.
+	PROFILE_OP(CHIP8_OP_8XY4);
 	uint16_t r = VX + VY;
 	VX = r & 0xFF;
 	VF = r > 0xFF ? 0x1 : 0x0;
 	PC += 2;
 }
-static void chip8_8XY5(CHIP8* chip8) {
+CHIP8_INLINE void chip8_8XY5(CHIP8* chip8, uint16_t opcode) {
 	// SUB VX, VY
+	PROFILE_OP(CHIP8_OP_8XY5);
 	uint8_t vf = VX < VY ? 0x0 : 0x1;
 	VX = VX - VY;
 	VF = vf;
 	PC += 2;
 }
-static void chip8_8XY6(CHIP8* chip8) {
+CHIP8_INLINE void chip8_8XY6(CHIP8* chip8, uint16_t opcode, uint32_t quirks) {
 	// SHR VX, VY XXX
+	PROFILE_OP(CHIP8_OP_8XY6);
 	uint8_t vf = VX & 0x1;
-	if (chip8->quirks & CHIP8_QUIRK_SHIFT_X_REGISTER) {
+	if (quirks & CHIP8_QUIRK_SHIFT_X_REGISTER) {
 		VX >>= 1;
 	}
 	else {
@@ -160,17 +516,19 @@ static void chip8_8XY6(CHIP8* chip8) {
 	VF = vf;
 	PC += 2;
 }
-static void chip8_8XY7(CHIP8* chip8) {
+CHIP8_INLINE void chip8_8XY7(CHIP8* chip8, uint16_t opcode) {
 	// SUBN VX, VY
+	PROFILE_OP(CHIP8_OP_8XY7);
 	uint8_t vf = VY < VX ? 0x0 : 0x1;
 	VX = VY - VX;
 	VF = vf;
 	PC += 2;
 }
-static void chip8_8XYE(CHIP8* chip8) {
+CHIP8_INLINE void chip8_8XYE(CHIP8* chip8, uint16_t opcode, uint32_t quirks) {
 	// SHL VX, VY
+	PROFILE_OP(CHIP8_OP_8XYE);
 	uint8_t vf = (VX >> 7) & 0x1;
-	if (chip8->quirks & CHIP8_QUIRK_SHIFT_X_REGISTER) {
+	if (quirks & CHIP8_QUIRK_SHIFT_X_REGISTER) {
 		VX <<= 1;
 	}
 	else {
@@ -179,21 +537,24 @@ static void chip8_8XYE(CHIP8* chip8) {
 	VF = vf;
 	PC += 2;
 }
-static void chip8_9XY0(CHIP8* chip8) {
+CHIP8_INLINE void chip8_9XY0(CHIP8* chip8, uint16_t opcode, int xo) {
 	// SNE VX, VY
+	PROFILE_OP(CHIP8_OP_9XY0);
 	if (VX != VY) {
-		PC += 2;
+		chip8_skip(chip8, xo);
 	}
 	PC += 2;
 }
-static void chip8_ANNN(CHIP8* chip8) {
+CHIP8_INLINE void chip8_ANNN(CHIP8* chip8, uint16_t opcode) {
 	// LD I, NNN
+	PROFILE_OP(CHIP8_OP_ANNN);
 	I = NNN;
 	PC += 2;
 }
-static void chip8_BNNN(CHIP8* chip8) {
+CHIP8_INLINE void chip8_BNNN(CHIP8* chip8, uint16_t opcode, uint32_t quirks) {
 	// JMP NNN
-	if (chip8->quirks & CHIP8_QUIRK_JUMP_VX) {
+	PROFILE_OP(CHIP8_OP_BNNN);
+	if (quirks & CHIP8_QUIRK_JUMP_VX) {
 		// JMP NNN + VX
 		PC = NNN + chip8->v[X];
 	}
@@ -202,64 +563,95 @@ static void chip8_BNNN(CHIP8* chip8) {
 		PC = NNN + chip8->v[0];
 	}
 }
-static void chip8_CXNN(CHIP8* chip8) {
+CHIP8_INLINE void chip8_CXNN(CHIP8* chip8, uint16_t opcode) {
 	// RND VX, NN
+	PROFILE_OP(CHIP8_OP_CXNN);
+#ifdef CHIP8_RANDOM_HOOK
 	VX = (chip8_random() & NN);
+#else
+	VX = (chip8_rng_next(chip8->rng) & NN);
+#endif
 	PC += 2;
 }
-static void chip8_DXYN(CHIP8* chip8) {
+CHIP8_INLINE void chip8_DXYN(CHIP8* chip8, uint16_t opcode, uint32_t quirks, int xo) {
 	// DRW VX, VY, N
-	uint16_t i, vx, vy;
+	PROFILE_OP(CHIP8_OP_DXYN);
+	uint64_t row, hit = 0;
+	uint8_t vx, vy;
+#ifndef CHIP8_NO_SCHIP
+	if (chip8->platform != CHIP8_PLATFORM_CHIP8 && (chip8->hires || N == 0 || chip8->platform == CHIP8_PLATFORM_XOCHIP)) {
+		chip8_draw_planes(chip8, opcode, quirks, xo);
+		if (quirks & CHIP8_QUIRK_DISPLAY_WAIT) {
+			chip8->draw_display = 1;
+		}
+		PC += 2;
+		return;
+	}
+#else
+	(void)xo;
+#endif
 	VF = 0;
-	for (int y = 0; y < N; ++y) {
-		for (int x = 0; x < 8; ++x) {
-			if ((chip8->ram[I + y] & (0x80 >> x)) != 0) {
-				if (chip8->quirks & CHIP8_QUIRK_DISPLAY_CLIPPING) {
-					vx = (VX & (CHIP8_DISPLAY_WIDTH - 1)) + x;
-					vy = (VY & (CHIP8_DISPLAY_HEIGHT - 1)) + y;
-				}
-				else {
-					vx = ((VX + x) & (CHIP8_DISPLAY_WIDTH - 1));
-					vy = ((VY + y) & (CHIP8_DISPLAY_HEIGHT - 1));
-				}
-
-				if (vx < CHIP8_DISPLAY_WIDTH && vy < CHIP8_DISPLAY_HEIGHT) {
-					i = vx + vy * CHIP8_DISPLAY_WIDTH;
-					if (CHIP8_DISPLAY_GET_PX(chip8->display, i)) {
-						VF = 1;
-					}
-					CHIP8_DISPLAY_TOGGLE_PX(chip8->display, i);
-				}
-			}
+	vx = VX & (CHIP8_DISPLAY_WIDTH - 1);
+	vy = VY & (CHIP8_DISPLAY_HEIGHT - 1);
+	/* Each sprite row is placed at the left edge and shifted into place.
+	 * Clipping drops the pixels past the right and bottom edges, wrapping
+	 * rotates them around to the other side. */
+	if (quirks & CHIP8_QUIRK_DISPLAY_CLIPPING) {
+		int rows = N;
+		if (vy + rows > CHIP8_DISPLAY_HEIGHT) {
+			rows = CHIP8_DISPLAY_HEIGHT - vy;
 		}
+		for (int y = 0; y < rows; ++y) {
+			row = ((uint64_t)READ_BYTE(I + y) << 56) >> vx;
+			hit |= chip8->display[vy + y] & row;
+			chip8->display[vy + y] ^= row;
+			PROFILE_PIXELS(row);
+			chip8->dirty_rows |= (uint64_t)(row != 0) << (vy + y);
+		}
+	}
+	else {
+		for (int y = 0; y < N; ++y) {
+			row = (uint64_t)READ_BYTE(I + y) << 56;
+			row = (row >> vx) | (row << ((CHIP8_DISPLAY_WIDTH - vx) & (CHIP8_DISPLAY_WIDTH - 1)));
+			hit |= chip8->display[(vy + y) & (CHIP8_DISPLAY_HEIGHT - 1)] & row;
+			chip8->display[(vy + y) & (CHIP8_DISPLAY_HEIGHT - 1)] ^= row;
+			PROFILE_PIXELS(row);
+			chip8->dirty_rows |= (uint64_t)(row != 0) << ((vy + y) & (CHIP8_DISPLAY_HEIGHT - 1));
+		}
+	}
+	if (hit != 0) {
+		VF = 1;
 	}
-	if (chip8->quirks & CHIP8_QUIRK_DISPLAY_WAIT) {
+	if (quirks & CHIP8_QUIRK_DISPLAY_WAIT) {
 		chip8->draw_display = 1;
 	}
 	PC += 2;
 }
-static void chip8_EX9E(CHIP8* chip8) {
+CHIP8_INLINE void chip8_EX9E(CHIP8* chip8, uint16_t opcode, int xo) {
 	// SKP VX
+	PROFILE_OP(CHIP8_OP_EX9E);
 	if (CHIP8_KEYPAD_GET(chip8->keypad, VX) == 0x1) {
-		PC += 2;
+		chip8_skip(chip8, xo);
 	}
 	PC += 2;
 }
-static void chip8_EXA1(CHIP8* chip8) {
+CHIP8_INLINE void chip8_EXA1(CHIP8* chip8, uint16_t opcode, int xo) {
 	// SKNP VX
+	PROFILE_OP(CHIP8_OP_EXA1);
 	if (CHIP8_KEYPAD_GET(chip8->keypad, VX) == 0x0) {
-		PC += 2;
+		chip8_skip(chip8, xo);
 	}
 	PC += 2;
 }
-static void chip8_FX07(CHIP8* chip8) {
+CHIP8_INLINE void chip8_FX07(CHIP8* chip8, uint16_t opcode) {
 	// LD VX, DT
+	PROFILE_OP(CHIP8_OP_FX07);
 	VX = chip8->delay_timer;
 	PC += 2;
 }
-static void chip8_FX0A(CHIP8* chip8) {
-	// LD VX, KEY
-	
+CHIP8_INLINE int chip8_key_wait_scan(CHIP8* chip8, uint16_t opcode) {
+	/* FX0A key state; returns 1 once a key is pressed and released, with VX set to the key */
+
 	for (int i = 0; i < 16; ++i) {
 		/* Set key state */
 		if (CHIP8_KEYPAD_GET(chip8->keypad, i) == CHIP8_KEY_STATE_KEY_DOWN) {
@@ -270,74 +662,265 @@ static void chip8_FX0A(CHIP8* chip8) {
 		if (CHIP8_KEYPAD_GET(chip8->fxoa_state, i) == CHIP8_KEY_STATE_KEY_DOWN) {
 			if (CHIP8_KEYPAD_GET(chip8->keypad, i) == CHIP8_KEY_STATE_KEY_UP) {
 				VX = i;
-				PC += 2;
 
 				/* Reset FX0A state */
 				chip8->fxoa_state = 0;
-				break;
+				return 1;
 			}
 		}
 	}
+	return 0;
+}
+CHIP8_INLINE void chip8_FX0A(CHIP8* chip8, uint16_t opcode) {
+	// LD VX, KEY
+	PROFILE_OP(CHIP8_OP_FX0A);
+	if (chip8_key_wait_scan(chip8, opcode)) {
+		PC += 2;
+	}
+	else {
+		/* wait for the keypad to change; see chip8_key_wait_resume */
+		chip8->cpu_state = CHIP8_STATE_KEY_WAIT;
+	}
+}
+CHIP8_INLINE int chip8_key_wait_resume(CHIP8* chip8, int xo) {
+	/* Scan the keypad for a cpu waiting in FX0A, as if the FX0A at pc ran again.
+	 * Returns 1 if the wait is over */
+
+	uint16_t opcode = MEM_GET_OPCODE(xo, PC);
+
+	if (!chip8_key_wait_scan(chip8, opcode)) {
+		return 0;
+	}
+	PC += 2;
+	chip8->cpu_state = CHIP8_STATE_EXE;
+	return 1;
 }
-static void chip8_FX15(CHIP8* chip8) {
+CHIP8_INLINE void chip8_FX15(CHIP8* chip8, uint16_t opcode) {
 	// LD DT, VX
+	PROFILE_OP(CHIP8_OP_FX15);
 	chip8->delay_timer = VX;
 	PC += 2;
 }
-static void chip8_FX18(CHIP8* chip8) {
+CHIP8_INLINE void chip8_FX18(CHIP8* chip8, uint16_t opcode) {
 	// LD ST, VX
+	PROFILE_OP(CHIP8_OP_FX18);
 	chip8->sound_timer = VX;
 	PC += 2;
 }
-static void chip8_FX1E(CHIP8* chip8) {
+CHIP8_INLINE void chip8_FX1E(CHIP8* chip8, uint16_t opcode) {
 	// ADD I, VX
+	PROFILE_OP(CHIP8_OP_FX1E);
 	I += VX;
 	PC += 2;
 }
-static void chip8_FX29(CHIP8* chip8) {
+CHIP8_INLINE void chip8_FX29(CHIP8* chip8, uint16_t opcode) {
 	// LD B, VX
+	PROFILE_OP(CHIP8_OP_FX29);
 	I = VX * 5;
 	PC += 2;
 }
-static void chip8_FX33(CHIP8* chip8) {
+CHIP8_INLINE void chip8_FX33(CHIP8* chip8, uint16_t opcode, int xo) {
 	// LD B, VX
-	WRITE_BYTE(I,   (VX % 1000) / 100);
-	WRITE_BYTE(I+1, (VX % 100) / 10);
-	WRITE_BYTE(I+2, (VX % 10));
+	PROFILE_OP(CHIP8_OP_FX33);
+	MEM_WRITE_BYTE(xo, I,   (VX % 1000) / 100);
+	MEM_WRITE_BYTE(xo, I+1, (VX % 100) / 10);
+	MEM_WRITE_BYTE(xo, I+2, (VX % 10));
 	PC += 2;
 } 
-static void chip8_FX55(CHIP8* chip8) {
+CHIP8_INLINE void chip8_FX55(CHIP8* chip8, uint16_t opcode, uint32_t quirks, int xo) {
 	//LD [I], VX
+	PROFILE_OP(CHIP8_OP_FX55);
 	for (int i = 0; i <= X; ++i) {
-		WRITE_BYTE(I+i, chip8->v[i]);
+		MEM_WRITE_BYTE(xo, I+i, chip8->v[i]);
 	}
 
-	if (chip8->quirks & CHIP8_QUIRK_INCREMENT_I_REGISTER) {
+	if (quirks & CHIP8_QUIRK_INCREMENT_I_REGISTER) {
 		I += X + 1;
 	}
 
 	PC += 2;
 }
-static void chip8_FX65(CHIP8* chip8) {
+CHIP8_INLINE void chip8_FX65(CHIP8* chip8, uint16_t opcode, uint32_t quirks, int xo) {
 	// LD VX, [I]
+	PROFILE_OP(CHIP8_OP_FX65);
 	for (int i = 0; i <= X; ++i) {
-		chip8->v[i] = READ_BYTE(I + i);
+		chip8->v[i] = MEM_READ_BYTE(xo, I + i);
 	}
 
-	if (chip8->quirks & CHIP8_QUIRK_INCREMENT_I_REGISTER) {
+	if (quirks & CHIP8_QUIRK_INCREMENT_I_REGISTER) {
 		I += X + 1;
 	}
 
 	PC += 2;
 }
+CHIP8_INLINE void chip8_00CN(CHIP8* chip8, uint16_t opcode) {
+	// SCD N
+	SCHIP_ONLY();
+	PROFILE_OP(CHIP8_OP_00CN);
+	chip8_scroll_down(chip8, N);
+	PC += 2;
+}
+CHIP8_INLINE void chip8_00FB(CHIP8* chip8) {
+	// SCR
+	SCHIP_ONLY();
+	PROFILE_OP(CHIP8_OP_00FB);
+	chip8_scroll_right(chip8);
+	PC += 2;
+}
+CHIP8_INLINE void chip8_00FC(CHIP8* chip8) {
+	// SCL
+	SCHIP_ONLY();
+	PROFILE_OP(CHIP8_OP_00FC);
+	chip8_scroll_left(chip8);
+	PC += 2;
+}
+CHIP8_INLINE void chip8_00FD(CHIP8* chip8) {
+	// EXIT
+	SCHIP_ONLY();
+	PROFILE_OP(CHIP8_OP_00FD);
+	chip8->cpu_state = CHIP8_STATE_HLT;
+}
+CHIP8_INLINE void chip8_00FE(CHIP8* chip8) {
+	// LOW
+	SCHIP_ONLY();
+	PROFILE_OP(CHIP8_OP_00FE);
+	chip8_set_hires(chip8, 0);
+	PC += 2;
+}
+CHIP8_INLINE void chip8_00FF(CHIP8* chip8) {
+	// HIGH
+	SCHIP_ONLY();
+	PROFILE_OP(CHIP8_OP_00FF);
+	chip8_set_hires(chip8, 1);
+	PC += 2;
+}
+CHIP8_INLINE void chip8_FX30(CHIP8* chip8, uint16_t opcode) {
+	// LD HF, VX
+	SCHIP_ONLY();
+	PROFILE_OP(CHIP8_OP_FX30);
+	I = CHIP8_BIG_FONT_ADDR + (VX & 0xF) * 10;
+	PC += 2;
+}
+CHIP8_INLINE void chip8_FX75(CHIP8* chip8, uint16_t opcode) {
+	// LD R, VX
+	SCHIP_ONLY();
+	PROFILE_OP(CHIP8_OP_FX75);
+	for (int i = 0; i <= X; ++i) {
+		chip8->rpl[i] = chip8->v[i];
+	}
+	PC += 2;
+}
+CHIP8_INLINE void chip8_FX85(CHIP8* chip8, uint16_t opcode) {
+	// LD VX, R
+	SCHIP_ONLY();
+	PROFILE_OP(CHIP8_OP_FX85);
+	for (int i = 0; i <= X; ++i) {
+		chip8->v[i] = chip8->rpl[i];
+	}
+	PC += 2;
+}
+CHIP8_INLINE void chip8_00DN(CHIP8* chip8, uint16_t opcode) {
+	// SCU N
+	XOCHIP_ONLY();
+	PROFILE_OP(CHIP8_OP_00DN);
+	chip8_scroll_up(chip8, N);
+	PC += 2;
+}
+CHIP8_INLINE void chip8_5XY2(CHIP8* chip8, uint16_t opcode, int xo) {
+	// LD [I], VX-VY ; in either order, I is not changed
+	if (!xo) {
+		// 5XYN is 5XY0 elsewhere
+		chip8_5XY0(chip8, opcode, xo);
+		return;
+	}
+	PROFILE_OP(CHIP8_OP_5XY2);
+	const int step = (X <= Y) ? 1 : -1;
+	const int count = (X <= Y) ? Y - X : X - Y;
+	for (int i = 0; i <= count; ++i) {
+		XO_WRITE_BYTE(I + i, chip8->v[X + i * step]);
+	}
+	PC += 2;
+}
+CHIP8_INLINE void chip8_5XY3(CHIP8* chip8, uint16_t opcode, int xo) {
+	// LD VX-VY, [I]
+	if (!xo) {
+		// 5XYN is 5XY0 elsewhere
+		chip8_5XY0(chip8, opcode, xo);
+		return;
+	}
+	PROFILE_OP(CHIP8_OP_5XY3);
+	const int step = (X <= Y) ? 1 : -1;
+	const int count = (X <= Y) ? Y - X : X - Y;
+	for (int i = 0; i <= count; ++i) {
+		chip8->v[X + i * step] = XO_READ_BYTE(I + i);
+	}
+	PC += 2;
+}
+CHIP8_INLINE void chip8_F000(CHIP8* chip8) {
+	// LD I, NNNN ; the address is the word after the opcode
+	XOCHIP_ONLY();
+	PROFILE_OP(CHIP8_OP_F000);
+	I = XO_GET_OPCODE(PC + 2);
+	PC += 4;
+}
+CHIP8_INLINE void chip8_FN01(CHIP8* chip8, uint16_t opcode) {
+	// PLANE N
+	XOCHIP_ONLY();
+	PROFILE_OP(CHIP8_OP_FN01);
+	chip8->planes = X & 0x3;
+	PC += 2;
+}
+CHIP8_INLINE void chip8_F002(CHIP8* chip8) {
+	// AUDIO
+	XOCHIP_ONLY();
+	PROFILE_OP(CHIP8_OP_F002);
+	for (int i = 0; i < CHIP8_XO_PATTERN_BYTES; ++i) {
+		chip8->xo->pattern[i] = XO_READ_BYTE(I + i);
+	}
+	PC += 2;
+}
+CHIP8_INLINE void chip8_FX3A(CHIP8* chip8, uint16_t opcode) {
+	// PITCH VX
+	XOCHIP_ONLY();
+	PROFILE_OP(CHIP8_OP_FX3A);
+	chip8->xo->pitch = VX;
+	PC += 2;
+}
 
 void chip8_init_cpu(CHIP8* chip8) {
 
 	chip8->quirks = 0; 
+	chip8->hires = 0;
+	chip8->xo = NULL;
+	chip8->platform = CHIP8_PLATFORM_CHIP8;
+	chip8_seed_random(chip8, 0);
 	chip8_reset_cpu(chip8);
 	chip8_zero_memory(chip8);
-	chip8_zero_video_memory(chip8);
+	chip8_set_platform(chip8, CHIP8_PLATFORM_CHIP8);
 	chip8_load_font(chip8, chip8_font);
+
+	for (int i = 0; i < CHIP8_RPL_FLAGS; ++i) {
+		chip8->rpl[i] = 0;
+	}
+
+	/* Host has not drawn anything yet */
+	chip8->dirty_rows = CHIP8_DISPLAY_ROWS_ALL;
+
+#ifdef CYCLE_COUNT
+	chip8->cycles = 0;
+#endif
+#ifdef CHIP8_PROFILER
+	chip8_reset_profile(chip8);
+#endif
+
+#ifdef CHIP8_SNAPSHOT_PAGES
+	chip8->dirty_pages = CHIP8_PAGES_ALL;
+	chip8->snapshot_base = NULL;
+#endif
+
+#ifdef CHIP8_AUDIO_SYNTH
+	chip8->audio = NULL;
+#endif
 }
 void chip8_reset_cpu(CHIP8* chip8) {
 
@@ -362,121 +945,307 @@ void chip8_reset_cpu(CHIP8* chip8) {
 
 	chip8->delay_timer = 0;
 	chip8->sound_timer = 0;
+	chip8->frame_debt = 0;
 
+	chip8->planes = 1;
+	chip8_set_hires(chip8, 0);
 	if (chip8->quirks & CHIP8_QUIRK_CLS_ON_RESET) {
 		chip8_zero_video_memory(chip8);
 	}
+
+	/* quirks may have been written since the engine was selected */
+	chip8_set_quirks(chip8, chip8->quirks);
+}
+static void chip8_load_big_font(CHIP8* chip8) {
+	for (int i = 0; i < CHIP8_BIG_FONT_BYTES; ++i) {
+		CHIP8_MEMORY(chip8)[CHIP8_BIG_FONT_ADDR + i] = chip8_big_font[i];
+	}
+	chip8_invalidate_memory(chip8, CHIP8_BIG_FONT_ADDR, CHIP8_BIG_FONT_BYTES);
+}
+int chip8_set_platform(CHIP8* chip8, CHIP8_PLATFORM platform) {
+
+#ifdef CHIP8_NO_SCHIP
+	if (platform != CHIP8_PLATFORM_CHIP8) {
+		return 1;
+	}
+#endif
+	if (platform == CHIP8_PLATFORM_XOCHIP && chip8->xo == NULL) {
+		return 1;
+	}
+
+	chip8->platform = (uint8_t)platform;
+	chip8->planes = 1;
+
+	switch (platform) {
+		case CHIP8_PLATFORM_SCHIP:
+			chip8_set_quirks(chip8, CHIP8_QUIRKS_SCHIP);
+			chip8_load_big_font(chip8);
+			break;
+		case CHIP8_PLATFORM_XOCHIP:
+			chip8_set_quirks(chip8, CHIP8_QUIRKS_XOCHIP);
+			chip8_zero_memory(chip8);
+			chip8_load_font(chip8, chip8_font);
+			chip8_load_big_font(chip8);
+			for (int i = 0; i < CHIP8_DISPLAY_WORDS; ++i) {
+				chip8->xo->display[i] = 0;
+			}
+			for (int i = 0; i < CHIP8_XO_PATTERN_BYTES; ++i) {
+				chip8->xo->pattern[i] = 0;
+			}
+			chip8->xo->pitch = 64;
+			break;
+		default:
+			chip8_set_quirks(chip8, CHIP8_QUIRKS_CHIP8);
+			break;
+	}
+
+	/* what was decoded may have come from the other memory */
+	chip8_invalidate_memory(chip8, 0, CHIP8_MEMORY_BYTES);
+
+	/* lores, with nothing left over from either resolution */
+	for (int i = 0; i < CHIP8_DISPLAY_WORDS; ++i) {
+		chip8->display[i] = 0;
+	}
+	chip8->hires = 0;
+	chip8->dirty_rows = CHIP8_DISPLAY_ROWS_ALL;
+	return 0;
 }
 
 void chip8_zero_memory(CHIP8* chip8) {
-	for (int i = 0; i < CHIP8_MEMORY_BYTES; ++i) {
-		chip8->ram[i] = 0;
+	uint8_t* mem = CHIP8_MEMORY(chip8);
+	for (int i = 0; i < CHIP8_MEMORY_SIZE(chip8); ++i) {
+		mem[i] = 0;
 	}
+	/* predecoded entries and pages cover the first 4 KB; higher XO-CHIP addresses fold onto it */
+	chip8_invalidate_memory(chip8, 0, CHIP8_MEMORY_BYTES);
 }
 void chip8_zero_program_memory(CHIP8* chip8) {
-	for (int i = CHIP8_PROGRAM_ADDR; i < CHIP8_MEMORY_BYTES - CHIP8_PROGRAM_ADDR; ++i) {
-		chip8->ram[i] = 0;
+	uint8_t* mem = CHIP8_MEMORY(chip8);
+	for (int i = CHIP8_PROGRAM_ADDR; i < CHIP8_MEMORY_SIZE(chip8); ++i) {
+		mem[i] = 0;
 	}
+	chip8_invalidate_memory(chip8, CHIP8_PROGRAM_ADDR, (uint16_t)(CHIP8_MEMORY_SIZE(chip8) - CHIP8_PROGRAM_ADDR));
 }
 void chip8_zero_video_memory(CHIP8* chip8) {
-	for (int i = 0; i < CHIP8_DISPLAY_BYTES; ++i) {
-		chip8->display[i] = 0;
-	}
+	chip8_clear_planes(chip8, (chip8->platform == CHIP8_PLATFORM_XOCHIP) ? 0x3 : 0x1);
+}
+uint64_t chip8_get_dirty_rows(CHIP8* chip8) {
+	return chip8->dirty_rows;
+}
+void chip8_clear_dirty_rows(CHIP8* chip8) {
+	chip8->dirty_rows = 0;
 }
 void chip8_load_font(CHIP8* chip8, const uint8_t* font) {
+	uint8_t* mem = CHIP8_MEMORY(chip8);
 	for (int i = 0; i < CHIP8_FONT_BYTES; ++i) {
-		chip8->ram[i] = font[i];
+		mem[i] = font[i];
+	}
+	chip8_invalidate_memory(chip8, 0, CHIP8_FONT_BYTES);
+}
+void chip8_load_program(CHIP8* chip8, const uint8_t* program, uint16_t size) {
+	uint8_t* mem = CHIP8_MEMORY(chip8);
+	if (size > CHIP8_MEMORY_SIZE(chip8) - CHIP8_PROGRAM_ADDR) {
+		size = (uint16_t)(CHIP8_MEMORY_SIZE(chip8) - CHIP8_PROGRAM_ADDR);
 	}
+	for (int i = 0; i < size; ++i) {
+		mem[CHIP8_PROGRAM_ADDR + i] = program[i];
+	}
+	chip8_invalidate_memory(chip8, CHIP8_PROGRAM_ADDR, size);
+}
+void chip8_invalidate_memory(CHIP8* chip8, uint16_t address, uint16_t size) {
+#ifdef CHIP8_SNAPSHOT_PAGES
+	if (size > 0) {
+		for (uint32_t page = address >> 8; page <= (uint32_t)(address + size - 1) >> 8; ++page) {
+			chip8->dirty_pages |= (uint16_t)(1U << (page & (CHIP8_PAGE_COUNT - 1)));
+		}
+	}
+#endif
+#ifdef CHIP8_PREDECODE
+	/* Entries starting up to CHIP8_DECODED_SPAN - 1 bytes before address overlap the first byte */
+	for (int i = 1 - CHIP8_DECODED_SPAN; i < size; ++i) {
+		chip8->decoded[(address + i) & (CHIP8_MEMORY_BYTES - 1)].op = CHIP8_OP_NONE;
+	}
+#else
+	(void)chip8;
+	(void)address;
+	(void)size;
+#endif
 }
 void chip8_step_timers(CHIP8* chip8) {
 
+#ifdef CHIP8_AUDIO_SYNTH
+	/* the tick that just ended sounded if the timer was running */
+	if (chip8->audio != NULL) {
+		if (chip8->platform == CHIP8_PLATFORM_XOCHIP) {
+			/* XO-CHIP plays its F002 pattern at the FX3A pitch */
+			chip8_audio_set_pattern(chip8->audio, chip8->xo->pattern, chip8->xo->pitch);
+		}
+		else {
+			chip8_audio_set_pattern(chip8->audio, NULL, 0);
+		}
+		chip8_audio_tick(chip8->audio, chip8->sound_timer > 0);
+	}
+#endif
+
 	if (chip8->delay_timer > 0) {
 		chip8->delay_timer -= 1;
 	}
 
 	if (chip8->sound_timer > 0) {
 		chip8->sound_timer -= 1;
+#ifndef CHIP8_AUDIO_SYNTH
 		chip8_beep(chip8);
+#endif
 	}
 }
+void chip8_set_keypad(CHIP8* chip8, uint16_t keypad) {
 
-void chip8_execute(CHIP8* chip8) {
-	/* Decode and execute the next instruction */
-
-	chip8->opcode = GET_OPCODE(chip8->pc); // chip8 is big endian
+	chip8->keypad = keypad;
 
-#ifdef CYCLE_COUNT
-	chip8->cycles = 0;
+	if (chip8->cpu_state == CHIP8_STATE_KEY_WAIT) {
+		chip8_key_wait_resume(chip8, chip8->platform == CHIP8_PLATFORM_XOCHIP);
+	}
+}
+void chip8_set_key(CHIP8* chip8, uint8_t key, CHIP8_KEY_STATE state) {
+	uint16_t keypad = chip8->keypad;
+	CHIP8_KEYPAD_SET(keypad, key & 0xF, (uint16_t)state);
+	chip8_set_keypad(chip8, keypad);
+}
+#ifdef CHIP8_PROFILER
+void chip8_reset_profile(CHIP8* chip8) {
+	for (int i = 0; i < CHIP8_OP_COUNT; ++i) {
+		chip8->profile.ops[i] = 0;
+	}
+	for (int i = 0; i < CHIP8_MEMORY_BYTES; ++i) {
+		chip8->profile.pc_hits[i] = 0;
+	}
+	chip8->profile.pixels_toggled = 0;
+}
 #endif
 
-	switch (chip8->opcode >> 12) {
+void chip8_seed_random(CHIP8* chip8, uint64_t seed) {
+	chip8_rng_seed(chip8->rng, seed);
+}
+void chip8_rng_seed(uint32_t* rng, uint64_t seed) {
+	/* Expand the seed with splitmix64; never leaves the state all zero */
+	for (int i = 0; i < 4; i += 2) {
+		uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		z ^= z >> 31;
+		rng[i] = (uint32_t)z;
+		rng[i + 1] = (uint32_t)(z >> 32);
+	}
+}
+uint8_t chip8_rng_byte(uint32_t* rng) {
+	return chip8_rng_next(rng);
+}
+
+static void chip8_decode(CHIP8* chip8, uint16_t opcode, int xo) {
+	/* Decode and execute opcode */
+
+	switch (opcode >> 12) {
 
 		case 0x0: {
-			switch (chip8->opcode & 0x00FF) {
+			switch (opcode & 0x00FF) {
 
 				case 0xE0: // CLS
-					chip8_00E0(chip8);
+					chip8_00E0(chip8, chip8->quirks);
 					break;
 				case 0xEE: // RET
 					chip8_00EE(chip8);
 					break;
+				case 0xFB: // SCR
+					chip8_00FB(chip8);
+					break;
+				case 0xFC: // SCL
+					chip8_00FC(chip8);
+					break;
+				case 0xFD: // EXIT
+					chip8_00FD(chip8);
+					break;
+				case 0xFE: // LOW
+					chip8_00FE(chip8);
+					break;
+				case 0xFF: // HIGH
+					chip8_00FF(chip8);
+					break;
 				default:
+					if ((opcode & 0x00F0) == 0xC0) { // SCD N
+						chip8_00CN(chip8, opcode);
+						break;
+					}
+					if ((opcode & 0x00F0) == 0xD0) { // SCU N
+						chip8_00DN(chip8, opcode);
+						break;
+					}
 					chip8->cpu_state = CHIP8_STATE_ERROR_OPCODE;
 					break;
 			}
 		} break;
 
 		case 0x1: // JMP NNN
-			chip8_1NNN(chip8);
+			chip8_1NNN(chip8, opcode);
 			break;
 		case 0x2: // CALL NNN
-			chip8_2NNN(chip8);
+			chip8_2NNN(chip8, opcode);
 			break;
 		case 0x3: // SE VX, NN
-			chip8_3XNN(chip8);
+			chip8_3XNN(chip8, opcode, xo);
 			break;
 		case 0x4: // SNE VX, NN
-			chip8_4XNN(chip8);
-			break;
-		case 0x5: // SE VX, VY
-			chip8_5XY0(chip8);
+			chip8_4XNN(chip8, opcode, xo);
 			break;
+		case 0x5: {
+			switch (opcode & 0x000F) {
+
+				case 0x02: // LD [I], VX-VY
+					chip8_5XY2(chip8, opcode, xo);
+					break;
+				case 0x03: // LD VX-VY, [I]
+					chip8_5XY3(chip8, opcode, xo);
+					break;
+				default: // SE VX, VY
+					chip8_5XY0(chip8, opcode, xo);
+					break;
+			}
+		} break;
 		case 0x6: // LD VX, NN
-			chip8_6XNN(chip8);
+			chip8_6XNN(chip8, opcode);
 			break;
 		case 0x7: // ADD VX, NN
-			chip8_7XNN(chip8);
+			chip8_7XNN(chip8, opcode);
 			break;
 
 		case 0x8: {
-			switch (chip8->opcode & 0x000F) {
+			switch (opcode & 0x000F) {
 
 				case 0x00: // LD VX, VY
-					chip8_8XY0(chip8);
+					chip8_8XY0(chip8, opcode);
 					break;
 				case 0x01: // OR VX, VY
-					chip8_8XY1(chip8);
+					chip8_8XY1(chip8, opcode, chip8->quirks);
 					break;
 				case 0x02: // AND VX, VY
-					chip8_8XY2(chip8);
+					chip8_8XY2(chip8, opcode, chip8->quirks);
 					break;
 				case 0x03: // XOR VX, VY
-					chip8_8XY3(chip8);
+					chip8_8XY3(chip8, opcode, chip8->quirks);
 					break;
 				case 0x04: // ADD VX, VY
-					chip8_8XY4(chip8);
+					chip8_8XY4(chip8, opcode);
 					break;
 				case 0x05: // SUB VX, VY
-					chip8_8XY5(chip8);
+					chip8_8XY5(chip8, opcode);
 					break;
 				case 0x06: // SHL VX, VY
-					chip8_8XY6(chip8);
+					chip8_8XY6(chip8, opcode, chip8->quirks);
 					break;
 				case 0x07: // SUBN VX, VY
-					chip8_8XY7(chip8);
+					chip8_8XY7(chip8, opcode);
 					break;
 				case 0x0E: // SHR VX, VY
-					chip8_8XYE(chip8);
+					chip8_8XYE(chip8, opcode, chip8->quirks);
 					break;
 				default:
 					chip8->cpu_state = CHIP8_STATE_ERROR_OPCODE;
@@ -485,29 +1254,29 @@ void chip8_execute(CHIP8* chip8) {
 		} break;
 
 		case 0x9: // SNE VX, VY
-			chip8_9XY0(chip8);
+			chip8_9XY0(chip8, opcode, xo);
 			break;
 		case 0xA: // LD I, NNN 
-			chip8_ANNN(chip8);
+			chip8_ANNN(chip8, opcode);
 			break;
 		case 0xB: // JMP NNN, V0
-			chip8_BNNN(chip8);
+			chip8_BNNN(chip8, opcode, chip8->quirks);
 			break;
 		case 0xC: // RND VX, NN
-			chip8_CXNN(chip8);
+			chip8_CXNN(chip8, opcode);
 			break;
 		case 0xD: // DSP VX, VY, N
-			chip8_DXYN(chip8);
+			chip8_DXYN(chip8, opcode, chip8->quirks, xo);
 			break;
 
 		case 0xE: {
-			switch (chip8->opcode & 0x00FF) {
+			switch (opcode & 0x00FF) {
 
 				case 0x9E: // SKP VX
-					chip8_EX9E(chip8);
+					chip8_EX9E(chip8, opcode, xo);
 					break;
 				case 0xA1: // SKNP VX 
-					chip8_EXA1(chip8);
+					chip8_EXA1(chip8, opcode, xo);
 					break;
 				default:
 					chip8->cpu_state = CHIP8_STATE_ERROR_OPCODE;
@@ -516,34 +1285,55 @@ void chip8_execute(CHIP8* chip8) {
 		} break;
 
 		case 0xF: {
-			switch (chip8->opcode & 0x00FF) {
+			switch (opcode & 0x00FF) {
 
+				case 0x00: // LD I, NNNN
+					chip8_F000(chip8);
+					break;
+				case 0x01: // PLANE N
+					chip8_FN01(chip8, opcode);
+					break;
+				case 0x02: // AUDIO
+					chip8_F002(chip8);
+					break;
 				case 0x07: // LD VX, DT
-					chip8_FX07(chip8);
+					chip8_FX07(chip8, opcode);
 					break;
 				case 0x0A: // LD VX, KEY
-					chip8_FX0A(chip8);
+					chip8_FX0A(chip8, opcode);
 					break;
 				case 0x15: // LD DT, VX
-					chip8_FX15(chip8);
+					chip8_FX15(chip8, opcode);
 					break;
 				case 0x18: // LD ST, VX
-					chip8_FX18(chip8);
+					chip8_FX18(chip8, opcode);
 					break;
 				case 0x1E: // ADD I, VX
-					chip8_FX1E(chip8);
+					chip8_FX1E(chip8, opcode);
 					break;
 				case 0x29: // LD F, VX 
-					chip8_FX29(chip8);
+					chip8_FX29(chip8, opcode);
+					break;
+				case 0x30: // LD HF, VX
+					chip8_FX30(chip8, opcode);
 					break;
 				case 0x33: // LD B, VX
-					chip8_FX33(chip8);
+					chip8_FX33(chip8, opcode, xo);
+					break;
+				case 0x3A: // PITCH VX
+					chip8_FX3A(chip8, opcode);
 					break;
 				case 0x55: // LD [I], VX 
-					chip8_FX55(chip8);
+					chip8_FX55(chip8, opcode, chip8->quirks, xo);
 					break;
 				case 0x65: // LD VX, [I] 
-					chip8_FX65(chip8);
+					chip8_FX65(chip8, opcode, chip8->quirks, xo);
+					break;
+				case 0x75: // LD R, VX
+					chip8_FX75(chip8, opcode);
+					break;
+				case 0x85: // LD VX, R
+					chip8_FX85(chip8, opcode);
 					break;
 				default:
 					chip8->cpu_state = CHIP8_STATE_ERROR_OPCODE;
@@ -556,3 +1346,619 @@ void chip8_execute(CHIP8* chip8) {
 			break;
 	}
 }
+
+void chip8_execute(CHIP8* chip8) {
+	/* Decode and execute the next instruction */
+
+	const int xo = (chip8->platform == CHIP8_PLATFORM_XOCHIP);
+
+	if (chip8->cpu_state == CHIP8_STATE_HLT) {
+		return;
+	}
+
+	if (chip8->cpu_state == CHIP8_STATE_KEY_WAIT) {
+		/* completing the wait counts as executing the FX0A */
+#ifdef CYCLE_COUNT
+		chip8->cycles += chip8_key_wait_resume(chip8, xo);
+#else
+		chip8_key_wait_resume(chip8, xo);
+#endif
+		return;
+	}
+
+	chip8->opcode = MEM_GET_OPCODE(xo, chip8->pc); // chip8 is big endian
+
+	chip8_decode(chip8, chip8->opcode, xo);
+
+#ifdef CYCLE_COUNT
+	/* an invalid opcode is not counted, as in chip8_run */
+	chip8->cycles += (chip8->cpu_state != CHIP8_STATE_ERROR_OPCODE);
+#endif
+}
+
+CHIP8_OP chip8_decode_op(uint16_t opcode) {
+	/* Decode opcode into its CHIP8_OP */
+
+	switch (opcode >> 12) {
+
+		case 0x0: {
+			switch (opcode & 0x00FF) {
+				case 0xE0: return CHIP8_OP_00E0;
+				case 0xEE: return CHIP8_OP_00EE;
+				case 0xFB: return CHIP8_OP_00FB;
+				case 0xFC: return CHIP8_OP_00FC;
+				case 0xFD: return CHIP8_OP_00FD;
+				case 0xFE: return CHIP8_OP_00FE;
+				case 0xFF: return CHIP8_OP_00FF;
+			}
+			if ((opcode & 0x00F0) == 0xC0) {
+				return CHIP8_OP_00CN;
+			}
+			if ((opcode & 0x00F0) == 0xD0) {
+				return CHIP8_OP_00DN;
+			}
+		} break;
+
+		case 0x1: return CHIP8_OP_1NNN;
+		case 0x2: return CHIP8_OP_2NNN;
+		case 0x3: return CHIP8_OP_3XNN;
+		case 0x4: return CHIP8_OP_4XNN;
+		case 0x5: {
+			switch (opcode & 0x000F) {
+				case 0x02: return CHIP8_OP_5XY2;
+				case 0x03: return CHIP8_OP_5XY3;
+			}
+			return CHIP8_OP_5XY0;
+		}
+		case 0x6: return CHIP8_OP_6XNN;
+		case 0x7: return CHIP8_OP_7XNN;
+
+		case 0x8: {
+			switch (opcode & 0x000F) {
+				case 0x00: return CHIP8_OP_8XY0;
+				case 0x01: return CHIP8_OP_8XY1;
+				case 0x02: return CHIP8_OP_8XY2;
+				case 0x03: return CHIP8_OP_8XY3;
+				case 0x04: return CHIP8_OP_8XY4;
+				case 0x05: return CHIP8_OP_8XY5;
+				case 0x06: return CHIP8_OP_8XY6;
+				case 0x07: return CHIP8_OP_8XY7;
+				case 0x0E: return CHIP8_OP_8XYE;
+			}
+		} break;
+
+		case 0x9: return CHIP8_OP_9XY0;
+		case 0xA: return CHIP8_OP_ANNN;
+		case 0xB: return CHIP8_OP_BNNN;
+		case 0xC: return CHIP8_OP_CXNN;
+		case 0xD: return CHIP8_OP_DXYN;
+
+		case 0xE: {
+			switch (opcode & 0x00FF) {
+				case 0x9E: return CHIP8_OP_EX9E;
+				case 0xA1: return CHIP8_OP_EXA1;
+			}
+		} break;
+
+		case 0xF: {
+			switch (opcode & 0x00FF) {
+				case 0x00: return CHIP8_OP_F000;
+				case 0x01: return CHIP8_OP_FN01;
+				case 0x02: return CHIP8_OP_F002;
+				case 0x07: return CHIP8_OP_FX07;
+				case 0x0A: return CHIP8_OP_FX0A;
+				case 0x15: return CHIP8_OP_FX15;
+				case 0x18: return CHIP8_OP_FX18;
+				case 0x1E: return CHIP8_OP_FX1E;
+				case 0x29: return CHIP8_OP_FX29;
+				case 0x30: return CHIP8_OP_FX30;
+				case 0x33: return CHIP8_OP_FX33;
+				case 0x3A: return CHIP8_OP_FX3A;
+				case 0x55: return CHIP8_OP_FX55;
+				case 0x65: return CHIP8_OP_FX65;
+				case 0x75: return CHIP8_OP_FX75;
+				case 0x85: return CHIP8_OP_FX85;
+			}
+		} break;
+	}
+
+	return CHIP8_OP_INVALID;
+}
+
+CHIP8_INLINE CHIP8_RUN_EXIT chip8_idle_exit(CHIP8* chip8, uint16_t pc, int xo) {
+	/* Check the jump just taken from pc for a loop that cannot progress:
+	 * a jump to self halts; FX07, 3XNN, 1NNN back to the FX07 spins until
+	 * the delay timer reaches NN, which only chip8_step_timers can do. */
+
+	uint16_t load, skip;
+
+	if (chip8->cpu_state == CHIP8_STATE_HLT) {
+		return CHIP8_RUN_EXIT_HALT;
+	}
+	if (pc == PC + 4) {
+		load = MEM_GET_OPCODE(xo, PC);
+		skip = MEM_GET_OPCODE(xo, PC + 2);
+		if ((load & 0xF0FF) == 0xF007 && (skip & 0xFF00) == (0x3000 | (load & 0x0F00)) && chip8->delay_timer != (skip & 0xFF)) {
+			return CHIP8_RUN_EXIT_IDLE;
+		}
+	}
+	return CHIP8_RUN_EXIT_COMPLETE;
+}
+
+#if defined(CHIP8_DISPATCH_THREADED) || defined(CHIP8_MNEMONICS)
+/* Opcode to CHIP8_OP lookup; indexed by [opcode >> 12][opcode & 0xFF].
+ * Every opcode group decodes from its high nibble plus the low byte.
+ * Constant so it needs no setup and is safe to read from any thread;
+ * must match chip8_decode_op. */
+#define OP_(op) CHIP8_OP_##op
+#define OP16(op) OP_(op), OP_(op), OP_(op), OP_(op), OP_(op), OP_(op), OP_(op), OP_(op), \
+	OP_(op), OP_(op), OP_(op), OP_(op), OP_(op), OP_(op), OP_(op), OP_(op)
+#define OP256(op) OP16(op), OP16(op), OP16(op), OP16(op), OP16(op), OP16(op), OP16(op), OP16(op), \
+	OP16(op), OP16(op), OP16(op), OP16(op), OP16(op), OP16(op), OP16(op), OP16(op)
+#define INV OP_(INVALID)
+#define OP_ROW_5 OP_(5XY0), OP_(5XY0), OP_(5XY2), OP_(5XY3), OP_(5XY0), OP_(5XY0), OP_(5XY0), OP_(5XY0), \
+	OP_(5XY0), OP_(5XY0), OP_(5XY0), OP_(5XY0), OP_(5XY0), OP_(5XY0), OP_(5XY0), OP_(5XY0)
+#define OP_ROW_8 OP_(8XY0), OP_(8XY1), OP_(8XY2), OP_(8XY3), OP_(8XY4), OP_(8XY5), OP_(8XY6), OP_(8XY7), \
+	INV, INV, INV, INV, INV, INV, OP_(8XYE), INV
+
+const uint8_t chip8_op_table[16][256] = {
+	{	// 0NNN
+		OP16(INVALID), OP16(INVALID), OP16(INVALID), OP16(INVALID), OP16(INVALID), OP16(INVALID),
+		OP16(INVALID), OP16(INVALID), OP16(INVALID), OP16(INVALID), OP16(INVALID), OP16(INVALID),
+		OP16(00CN), OP16(00DN),
+		OP_(00E0), INV, INV, INV, INV, INV, INV, INV, INV, INV, INV, INV, INV, INV, OP_(00EE), INV,
+		INV, INV, INV, INV, INV, INV, INV, INV, INV, INV, INV, OP_(00FB), OP_(00FC), OP_(00FD), OP_(00FE), OP_(00FF),
+	},
+	{ OP256(1NNN) },
+	{ OP256(2NNN) },
+	{ OP256(3XNN) },
+	{ OP256(4XNN) },
+	{	// 5XYN
+		OP_ROW_5, OP_ROW_5, OP_ROW_5, OP_ROW_5, OP_ROW_5, OP_ROW_5, OP_ROW_5, OP_ROW_5,
+		OP_ROW_5, OP_ROW_5, OP_ROW_5, OP_ROW_5, OP_ROW_5, OP_ROW_5, OP_ROW_5, OP_ROW_5,
+	},
+	{ OP256(6XNN) },
+	{ OP256(7XNN) },
+	{	// 8XYN
+		OP_ROW_8, OP_ROW_8, OP_ROW_8, OP_ROW_8, OP_ROW_8, OP_ROW_8, OP_ROW_8, OP_ROW_8,
+		OP_ROW_8, OP_ROW_8, OP_ROW_8, OP_ROW_8, OP_ROW_8, OP_ROW_8, OP_ROW_8, OP_ROW_8,
+	},
+	{ OP256(9XY0) },
+	{ OP256(ANNN) },
+	{ OP256(BNNN) },
+	{ OP256(CXNN) },
+	{ OP256(DXYN) },
+	{	// EXNN
+		OP16(INVALID), OP16(INVALID), OP16(INVALID), OP16(INVALID), OP16(INVALID), OP16(INVALID),
+		OP16(INVALID), OP16(INVALID), OP16(INVALID),
+		INV, INV, INV, INV, INV, INV, INV, INV, INV, INV, INV, INV, INV, INV, OP_(EX9E), INV,
+		INV, OP_(EXA1), INV, INV, INV, INV, INV, INV, INV, INV, INV, INV, INV, INV, INV, INV,
+		OP16(INVALID), OP16(INVALID), OP16(INVALID), OP16(INVALID), OP16(INVALID),
+	},
+	{	// FXNN
+		OP_(F000), OP_(FN01), OP_(F002), INV, INV, INV, INV, OP_(FX07), INV, INV, OP_(FX0A), INV, INV, INV, INV, INV,
+		INV, INV, INV, INV, INV, OP_(FX15), INV, INV, OP_(FX18), INV, INV, INV, INV, INV, OP_(FX1E), INV,
+		INV, INV, INV, INV, INV, INV, INV, INV, INV, OP_(FX29), INV, INV, INV, INV, INV, INV,
+		OP_(FX30), INV, INV, OP_(FX33), INV, INV, INV, INV, INV, INV, OP_(FX3A), INV, INV, INV, INV, INV,
+		OP16(INVALID),
+		INV, INV, INV, INV, INV, OP_(FX55), INV, INV, INV, INV, INV, INV, INV, INV, INV, INV,
+		INV, INV, INV, INV, INV, OP_(FX65), INV, INV, INV, INV, INV, INV, INV, INV, INV, INV,
+		INV, INV, INV, INV, INV, OP_(FX75), INV, INV, INV, INV, INV, INV, INV, INV, INV, INV,
+		INV, INV, INV, INV, INV, OP_(FX85), INV, INV, INV, INV, INV, INV, INV, INV, INV, INV,
+		OP16(INVALID), OP16(INVALID), OP16(INVALID), OP16(INVALID), OP16(INVALID), OP16(INVALID), OP16(INVALID),
+	},
+};
+
+#undef OP_ROW_8
+#undef OP_ROW_5
+#undef INV
+#undef OP256
+#undef OP16
+#undef OP_
+#endif
+
+/* COSMAC VIP TIMING */
+
+/* Fetch and decode; the interpreter loop charges this to every instruction */
+#define VIP_FETCH_CYCLES 40
+
+/* Skip instructions take this much longer when they skip */
+#define VIP_SKIP_CYCLES 4
+
+/* Execution cycles per CHIP8_OP, not including fetch and decode. Instructions
+ * with a variable cost hold their fixed part; see chip8_vip_cycles */
+static const uint16_t chip8_vip_op_cycles[CHIP8_OP_COUNT] = {
+	0, 0,		// NONE, INVALID
+	3078,		// 00E0; clears 256 bytes of display
+	10, 12, 26,	// 00EE, 1NNN, 2NNN
+	10, 10, 14,	// 3XNN, 4XNN, 5XY0
+	6, 10,		// 6XNN, 7XNN
+	44, 44, 44, 44, 44, 44, 44, 44, 44, // 8XYN; runs as code generated on the stack
+	14, 12,		// 9XY0, ANNN
+	22,			// BNNN; + 2 if the jump crosses a page
+	36,			// CXNN
+	26,			// DXYN; + per row
+	14, 14,		// EX9E, EXA1
+	10,			// FX07
+	20,			// FX0A; per pass while waiting
+	10, 10,		// FX15, FX18
+	16,			// FX1E; + 2 if I crosses a page
+	16,			// FX29
+	84,			// FX33; + 16 per unit counted out of each digit
+	14, 14,		// FX55, FX65; + 14 per register
+	0, 0, 0, 0, 0, 0, 0, 0, 0, // SCHIP; not on the VIP
+	0, 14, 14, 0, 0, 0, 0,		// XO-CHIP; not on the VIP, where 5XY2 and 5XY3 are 5XY0
+};
+
+CHIP8_INLINE uint32_t chip8_vip_op_cost(const CHIP8* chip8, uint16_t opcode, CHIP8_OP op) {
+	/* VIP cycles of opcode, from the current state */
+
+	uint32_t cycles = VIP_FETCH_CYCLES + chip8_vip_op_cycles[op];
+	uint32_t address;
+	int rows;
+
+	switch (op) {
+
+		case CHIP8_OP_3XNN:
+			cycles += (VX == NN) * VIP_SKIP_CYCLES;
+			break;
+		case CHIP8_OP_4XNN:
+			cycles += (VX != NN) * VIP_SKIP_CYCLES;
+			break;
+		case CHIP8_OP_5XY0:
+		case CHIP8_OP_5XY2:
+		case CHIP8_OP_5XY3:
+			cycles += (VX == VY) * VIP_SKIP_CYCLES;
+			break;
+		case CHIP8_OP_9XY0:
+			cycles += (VX != VY) * VIP_SKIP_CYCLES;
+			break;
+		case CHIP8_OP_EX9E:
+			cycles += CHIP8_KEYPAD_GET(chip8->keypad, VX & 0xF) * VIP_SKIP_CYCLES;
+			break;
+		case CHIP8_OP_EXA1:
+			cycles += !CHIP8_KEYPAD_GET(chip8->keypad, VX & 0xF) * VIP_SKIP_CYCLES;
+			break;
+
+		case CHIP8_OP_BNNN:
+			/* the VIP always adds V0 */
+			address = NNN + chip8->v[0];
+			cycles += ((address ^ NNN) & 0xF00) ? 2 : 0;
+			break;
+
+		case CHIP8_OP_DXYN:
+			/* each row is shifted into place a bit at a time, then
+			 * xored into the two display bytes it covers */
+			rows = N;
+			if ((chip8->quirks & CHIP8_QUIRK_DISPLAY_CLIPPING) && (VY & (CHIP8_DISPLAY_HEIGHT - 1)) + rows > CHIP8_DISPLAY_HEIGHT) {
+				rows = CHIP8_DISPLAY_HEIGHT - (VY & (CHIP8_DISPLAY_HEIGHT - 1));
+			}
+			cycles += rows * (46 + 8 * (VX & 7));
+			break;
+
+		case CHIP8_OP_FX1E:
+			address = chip8->i + VX;
+			cycles += ((address ^ chip8->i) & 0xF00) ? 2 : 0;
+			break;
+
+		case CHIP8_OP_FX33:
+			/* digits are counted out by repeated subtraction */
+			cycles += 16 * (VX / 100 + (VX / 10) % 10 + VX % 10);
+			break;
+
+		case CHIP8_OP_FX55:
+		case CHIP8_OP_FX65:
+			cycles += 14 * (X + 1);
+			break;
+
+		default:
+			break;
+	}
+
+	return cycles;
+}
+
+uint32_t chip8_vip_cycles(const CHIP8* chip8) {
+	uint16_t opcode = MEM_GET_OPCODE(chip8->platform == CHIP8_PLATFORM_XOCHIP, chip8->pc);
+	return chip8_vip_op_cost(chip8, opcode, chip8_decode_op(opcode));
+}
+
+#ifdef CHIP8_DISPATCH_THREADED
+#ifdef CHIP8_FUSION
+/* Fused ops; predecoded entries only, numbered after the CHIP8_OP range.
+ * The entry holds the first opcode, the following opcodes are stored in
+ * the entries after it. */
+enum {
+	CHIP8_OP_6XNN_6XNN = CHIP8_OP_COUNT,	// register setup
+	CHIP8_OP_ANNN_DXYN,						// sprite draw
+	CHIP8_OP_7XNN_3XNN_1NNN,				// counting loop
+	CHIP8_OP_FX07_3XNN_1NNN,				// delay timer wait
+	CHIP8_OP_FUSED_COUNT
+};
+
+static uint8_t chip8_fuse(CHIP8* chip8, uint16_t pc, uint8_t op, int xo) {
+	/* Fuse the instruction at pc with the instructions that follow it */
+
+	uint16_t opcode2, opcode3;
+	uint8_t op2, op3;
+	uint8_t fused = op;
+
+	if (pc > CHIP8_MEMORY_BYTES - CHIP8_DECODED_SPAN) {
+		return op;
+	}
+
+	opcode2 = MEM_GET_OPCODE(xo, pc + 2);
+	opcode3 = MEM_GET_OPCODE(xo, pc + 4);
+	op2 = chip8_op_table[opcode2 >> 12][opcode2 & 0xFF];
+	op3 = chip8_op_table[opcode3 >> 12][opcode3 & 0xFF];
+
+	switch (op) {
+		case CHIP8_OP_6XNN:
+			if (op2 == CHIP8_OP_6XNN) {
+				fused = CHIP8_OP_6XNN_6XNN;
+			}
+			break;
+		case CHIP8_OP_ANNN:
+			if (op2 == CHIP8_OP_DXYN) {
+				fused = CHIP8_OP_ANNN_DXYN;
+			}
+			break;
+		case CHIP8_OP_7XNN:
+			if (op2 == CHIP8_OP_3XNN && op3 == CHIP8_OP_1NNN) {
+				fused = CHIP8_OP_7XNN_3XNN_1NNN;
+			}
+			break;
+		case CHIP8_OP_FX07:
+			if (op2 == CHIP8_OP_3XNN && op3 == CHIP8_OP_1NNN) {
+				fused = CHIP8_OP_FX07_3XNN_1NNN;
+			}
+			break;
+	}
+
+	if (fused != op) {
+		/* Any write to these bytes also invalidates the fused entry,
+		 * so the opcodes stay valid for as long as it does. */
+		chip8->decoded[pc + 2].opcode = opcode2;
+		chip8->decoded[pc + 4].opcode = opcode3;
+	}
+	return fused;
+}
+#endif
+
+/* Threaded dispatch; each handler fetches and jumps to the next one
+ * directly so every opcode gets its own indirect branch. */
+#define RUN_OP(op) op_##op:
+#ifdef CHIP8_PREDECODE
+#define RUN_DISPATCH() \
+	if (count == max_instructions) goto done; \
+	if (PC >= CHIP8_MEMORY_BYTES) goto fetch_far; \
+	decoded = &chip8->decoded[PC]; \
+	opcode = decoded->opcode; \
+	count += 1; \
+	goto *op_labels[decoded->op]
+#else
+#define RUN_DISPATCH() \
+	if (count == max_instructions) goto done; \
+	opcode = MEM_GET_OPCODE(xo, PC); \
+	count += 1; \
+	goto *op_labels[chip8_op_table[opcode >> 12][opcode & 0xFF]]
+#endif
+#ifdef CHIP8_FUSION
+/* Fetch the instruction at offset n of a fused op */
+#define RUN_FUSED_NEXT(n) \
+	if (count == max_instructions) goto done; \
+	opcode = decoded[n].opcode; \
+	count += 1
+#endif
+#else
+/* Portable switch dispatch */
+#define RUN_OP(op) case CHIP8_OP_##op:
+#define RUN_DISPATCH() continue
+#endif
+
+#define CHIP8_ENGINE_CAT_(a, b) a##b
+#define CHIP8_ENGINE_CAT(a, b) CHIP8_ENGINE_CAT_(a, b)
+
+#ifdef CHIP8_QUIRK_ENGINES
+/* Specialized engines, one per combination of the quirks that affect
+ * execution. CHIP8_QUIRK_CLS_ON_RESET only matters to chip8_reset_cpu. */
+#define CHIP8_ENGINE_QUIRKS 0x00
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x02
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x04
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x06
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x10
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x12
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x14
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x16
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x20
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x22
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x24
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x26
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x30
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x32
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x34
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x36
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x40
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x42
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x44
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x46
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x50
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x52
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x54
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x56
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x60
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x62
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x64
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x66
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x70
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x72
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x74
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x76
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x80
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x82
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x84
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x86
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x90
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x92
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x94
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0x96
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0xA0
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0xA2
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0xA4
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0xA6
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0xB0
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0xB2
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0xB4
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0xB6
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0xC0
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0xC2
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0xC4
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0xC6
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0xD0
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0xD2
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0xD4
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0xD6
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0xE0
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0xE2
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0xE4
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0xE6
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0xF0
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0xF2
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0xF4
+#include "chip8_engine.h"
+#define CHIP8_ENGINE_QUIRKS 0xF6
+#include "chip8_engine.h"
+
+typedef CHIP8_RUN_EXIT(*CHIP8_RUN_ENGINE)(CHIP8*, uint32_t, uint32_t*);
+
+/* Quirk mask to engine index; packs quirk bits 1,2,4,5,6,7 into bits 0-5 */
+#define CHIP8_QUIRK_ENGINE_INDEX(quirks) ((((quirks) >> 1) & 0x03) | (((quirks) >> 2) & 0x3C))
+
+static const CHIP8_RUN_ENGINE chip8_quirk_engines[64] = {
+	chip8_run_quirks_0x00, chip8_run_quirks_0x02, chip8_run_quirks_0x04, chip8_run_quirks_0x06,
+	chip8_run_quirks_0x10, chip8_run_quirks_0x12, chip8_run_quirks_0x14, chip8_run_quirks_0x16,
+	chip8_run_quirks_0x20, chip8_run_quirks_0x22, chip8_run_quirks_0x24, chip8_run_quirks_0x26,
+	chip8_run_quirks_0x30, chip8_run_quirks_0x32, chip8_run_quirks_0x34, chip8_run_quirks_0x36,
+	chip8_run_quirks_0x40, chip8_run_quirks_0x42, chip8_run_quirks_0x44, chip8_run_quirks_0x46,
+	chip8_run_quirks_0x50, chip8_run_quirks_0x52, chip8_run_quirks_0x54, chip8_run_quirks_0x56,
+	chip8_run_quirks_0x60, chip8_run_quirks_0x62, chip8_run_quirks_0x64, chip8_run_quirks_0x66,
+	chip8_run_quirks_0x70, chip8_run_quirks_0x72, chip8_run_quirks_0x74, chip8_run_quirks_0x76,
+	chip8_run_quirks_0x80, chip8_run_quirks_0x82, chip8_run_quirks_0x84, chip8_run_quirks_0x86,
+	chip8_run_quirks_0x90, chip8_run_quirks_0x92, chip8_run_quirks_0x94, chip8_run_quirks_0x96,
+	chip8_run_quirks_0xA0, chip8_run_quirks_0xA2, chip8_run_quirks_0xA4, chip8_run_quirks_0xA6,
+	chip8_run_quirks_0xB0, chip8_run_quirks_0xB2, chip8_run_quirks_0xB4, chip8_run_quirks_0xB6,
+	chip8_run_quirks_0xC0, chip8_run_quirks_0xC2, chip8_run_quirks_0xC4, chip8_run_quirks_0xC6,
+	chip8_run_quirks_0xD0, chip8_run_quirks_0xD2, chip8_run_quirks_0xD4, chip8_run_quirks_0xD6,
+	chip8_run_quirks_0xE0, chip8_run_quirks_0xE2, chip8_run_quirks_0xE4, chip8_run_quirks_0xE6,
+	chip8_run_quirks_0xF0, chip8_run_quirks_0xF2, chip8_run_quirks_0xF4, chip8_run_quirks_0xF6,
+};
+#else
+/* Generic engine; tests chip8->quirks at runtime */
+#include "chip8_engine.h"
+#endif
+
+#ifndef CHIP8_NO_SCHIP
+/* XO-CHIP engine; tests chip8->quirks at runtime */
+#define CHIP8_ENGINE_XO
+#include "chip8_engine.h"
+#endif
+
+/* COSMAC VIP timing engine; tests chip8->quirks and the platform at
+ * runtime, and always dispatches on a switch */
+#undef RUN_OP
+#undef RUN_DISPATCH
+#define RUN_OP(op) case CHIP8_OP_##op:
+#define RUN_DISPATCH() continue
+#define CHIP8_ENGINE_VIP
+#include "chip8_engine.h"
+
+void chip8_set_quirks(CHIP8* chip8, uint32_t quirks) {
+	/* Select the engine once here rather than on every chip8_run */
+
+	chip8->quirks = quirks;
+#ifndef CHIP8_NO_SCHIP
+	if (chip8->platform == CHIP8_PLATFORM_XOCHIP) {
+		chip8->engine = chip8_run_engine_xo;
+		return;
+	}
+#endif
+#ifdef CHIP8_QUIRK_ENGINES
+	chip8->engine = chip8_quirk_engines[CHIP8_QUIRK_ENGINE_INDEX(quirks)];
+#else
+	chip8->engine = chip8_run_engine;
+#endif
+}
+
+CHIP8_RUN_EXIT chip8_run(CHIP8* chip8, uint32_t max_instructions, uint32_t* executed) {
+	/* Decode and execute up to max_instructions */
+
+	return chip8->engine(chip8, max_instructions, executed);
+}
+
+CHIP8_RUN_EXIT chip8_run_vip(CHIP8* chip8, uint32_t cycles, uint32_t* executed) {
+	/* Decode and execute until cycles VIP cycles are spent */
+
+	return chip8_run_engine_vip(chip8, cycles, executed);
+}
@@ -12,42 +12,126 @@
 #define CHIP8_REGISTER_COUNT	0x10
 #define CHIP8_STACK_SIZE		0x10
 #define CHIP8_MEMORY_BYTES		0x1000
+#define CHIP8_XO_MEMORY_BYTES	0x10000	// XO-CHIP; see CHIP8_XO
+#define CHIP8_XO_PATTERN_BYTES	0x10	// XO-CHIP F002 audio pattern
 #define CHIP8_PROGRAM_ADDR		0x200
 #define CHIP8_FONT_BYTES		0x50
+#define CHIP8_BIG_FONT_ADDR		0x50	// SCHIP 8x10 font; see chip8_set_platform
+#define CHIP8_BIG_FONT_BYTES	0xA0
+#define CHIP8_RPL_FLAGS			0x10	// SCHIP FX75/FX85 flag registers
 
 #define CHIP8_DISPLAY_WIDTH		64
 #define CHIP8_DISPLAY_HEIGHT	32
+#define CHIP8_DISPLAY_HIRES_WIDTH	128	// SCHIP hires
+#define CHIP8_DISPLAY_HIRES_HEIGHT	64
 
 #define CHIP8_NUM_PIXELS (CHIP8_DISPLAY_WIDTH * CHIP8_DISPLAY_HEIGHT)
 
-#ifdef CHIP8_SHRINK_DISPLAY_RAM
-#define CHIP8_DISPLAY_BYTES (CHIP8_NUM_PIXELS >> 3) /* divide by 8 */
-#define CHIP8_DISPLAY_GET_PX(s, i) (s[(i) >> 3] & (1 << ((i) & 7)))
-#define CHIP8_DISPLAY_SET_PX(s, i) (s[(i) >> 3] |= (1 << ((i) & 7)))
-#define CHIP8_DISPLAY_CLR_PX(s, i) (s[(i) >> 3] &= ~(1 << ((i) & 7)))
-#define CHIP8_DISPLAY_TOGGLE_PX(s, i) (s[(i) >> 3] ^= (1 << ((i) & 7)))
+/* Display is packed rows of uint64_t words; bit 63 of a word is its leftmost pixel.
+ * In lores a row is one word, in SCHIP hires a row is two words, left word first.
+ * Pixel index i is x + y * width, width being CHIP8_DISPLAY_WIDTH or CHIP8_DISPLAY_HIRES_WIDTH.
+ * XO-CHIP has a second plane laid out the same way in CHIP8_XO; a pixel's color is
+ * plane 1 | plane 2 << 1 */
+#ifdef CHIP8_NO_SCHIP
+#define CHIP8_DISPLAY_WORDS CHIP8_DISPLAY_HEIGHT
 #else
-#define CHIP8_DISPLAY_BYTES (CHIP8_NUM_PIXELS)
-#define CHIP8_DISPLAY_GET_PX(s, i) (s[i])
-#define CHIP8_DISPLAY_SET_PX(s, i) (s[i] = 0x1)
-#define CHIP8_DISPLAY_CLR_PX(s, i) (s[i] = 0x0)
-#define CHIP8_DISPLAY_TOGGLE_PX(s, i) (s[i] ^= 0x1)
+#define CHIP8_DISPLAY_WORDS (CHIP8_DISPLAY_HIRES_WIDTH * CHIP8_DISPLAY_HIRES_HEIGHT / 64)
 #endif
+#define CHIP8_DISPLAY_BYTES (CHIP8_DISPLAY_WORDS * 8)
+#define CHIP8_DISPLAY_PX_MASK(i) (0x8000000000000000ULL >> ((i) & (CHIP8_DISPLAY_WIDTH - 1)))
+#define CHIP8_DISPLAY_GET_PX(s, i) ((s[(i) >> 6] & CHIP8_DISPLAY_PX_MASK(i)) != 0)
+#define CHIP8_DISPLAY_SET_PX(s, i) (s[(i) >> 6] |= CHIP8_DISPLAY_PX_MASK(i))
+#define CHIP8_DISPLAY_CLR_PX(s, i) (s[(i) >> 6] &= ~CHIP8_DISPLAY_PX_MASK(i))
+#define CHIP8_DISPLAY_TOGGLE_PX(s, i) (s[(i) >> 6] ^= CHIP8_DISPLAY_PX_MASK(i))
+#define CHIP8_DISPLAY_ROWS_ALL ((1ULL << CHIP8_DISPLAY_HEIGHT) - 1)
+#define CHIP8_DISPLAY_HIRES_ROWS_ALL 0xFFFFFFFFFFFFFFFFULL
 
 #define CHIP8_KEYPAD_SET(s, n, v) s = (s & ~(0x1U << (n))) | ((v) << (n))
 #define CHIP8_KEYPAD_GET(s, n) ((s >> (n)) & 0x1U)
 
+/* Ram pages tracked for snapshots */
+#define CHIP8_PAGE_BYTES		0x100
+#define CHIP8_PAGE_COUNT		(CHIP8_MEMORY_BYTES / CHIP8_PAGE_BYTES)
+#define CHIP8_PAGES_ALL			0xFFFF
+
+#ifdef CHIP8_SNAPSHOT_PAGES
+#define MARK_PAGE(address)			(chip8->dirty_pages |= (uint16_t)(1U << (((address) & (CHIP8_MEMORY_BYTES - 1)) >> 8)))
+#else
+#define MARK_PAGE(address)			((void)0)
+#endif
+
+#ifdef CHIP8_PREDECODE
+#ifdef CHIP8_FUSION
+/* Bytes a predecoded entry depends on; a fused entry spans up to 3 instructions */
+#define CHIP8_DECODED_SPAN			6
+#define INVALIDATE_BYTE(address)	chip8_invalidate_memory(chip8, (address), 1)
+#else
+#define CHIP8_DECODED_SPAN			2
+/* A write changes the instructions starting at address and address - 1 */
+#define INVALIDATE_BYTE(address)	(chip8->decoded[(address) & (CHIP8_MEMORY_BYTES - 1)].op = CHIP8_OP_NONE, \
+									chip8->decoded[((address) - 1) & (CHIP8_MEMORY_BYTES - 1)].op = CHIP8_OP_NONE)
+#endif
+#else
+#define INVALIDATE_BYTE(address)	((void)0)
+#endif
+
+/* Memory is ram; XO-CHIP runs out of the 64 KB in CHIP8_XO instead. The MEM_ forms
+ * select the memory by xo, which is a constant in each engine */
 #define READ_BYTE(address)			chip8->ram[(address) & (CHIP8_MEMORY_BYTES - 1)]
-#define WRITE_BYTE(address, value)	chip8->ram[(address) & (CHIP8_MEMORY_BYTES - 1)] = (value)
-#define GET_OPCODE(address)			(READ_BYTE(address) << 8) | READ_BYTE(address + 1)
+#define WRITE_BYTE(address, value)	(READ_BYTE(address) = (value), INVALIDATE_BYTE(address), MARK_PAGE(address))
+#define GET_OPCODE(address)			((READ_BYTE(address) << 8) | READ_BYTE((address) + 1))
+#define XO_READ_BYTE(address)		chip8->xo->ram[(address) & (CHIP8_XO_MEMORY_BYTES - 1)]
+#define XO_WRITE_BYTE(address, value) (XO_READ_BYTE(address) = (value), INVALIDATE_BYTE(address), MARK_PAGE(address))
+#define XO_GET_OPCODE(address)		((XO_READ_BYTE(address) << 8) | XO_READ_BYTE((address) + 1))
+#define MEM_READ_BYTE(xo, address)	((xo) ? XO_READ_BYTE(address) : READ_BYTE(address))
+#define MEM_WRITE_BYTE(xo, address, value) ((xo) ? XO_WRITE_BYTE(address, value) : WRITE_BYTE(address, value))
+#define MEM_GET_OPCODE(xo, address)	((xo) ? XO_GET_OPCODE(address) : GET_OPCODE(address))
+
+/* Memory opcodes address and its size; ram, or xo->ram on XO-CHIP */
+#define CHIP8_MEMORY(chip8)			(((chip8)->platform == CHIP8_PLATFORM_XOCHIP) ? (chip8)->xo->ram : (chip8)->ram)
+#define CHIP8_MEMORY_SIZE(chip8)	(((chip8)->platform == CHIP8_PLATFORM_XOCHIP) ? CHIP8_XO_MEMORY_BYTES : CHIP8_MEMORY_BYTES)
 
  /* Chip8 cpu state */
 typedef enum {
 	CHIP8_STATE_EXE = 0,
-	CHIP8_STATE_HLT = 1,
+	CHIP8_STATE_HLT = 1,			// jumped to itself or SCHIP 00FD; nothing can run until reset
 	CHIP8_STATE_ERROR_OPCODE = 2,
+	CHIP8_STATE_KEY_WAIT = 3,		// FX0A waiting for a key to be pressed and released; see chip8_set_keypad
 } CHIP8_CPU_STATE;
 
+/* Chip8 run exit reason */
+typedef enum {
+	CHIP8_RUN_EXIT_COMPLETE = 0,	// executed max_instructions
+	CHIP8_RUN_EXIT_DRAW = 1,		// display updated; CHIP8_QUIRK_DISPLAY_WAIT
+	CHIP8_RUN_EXIT_KEY_WAIT = 2,	// cpu_state is CHIP8_STATE_KEY_WAIT; FX0A waiting for a key
+	CHIP8_RUN_EXIT_ERROR = 3,		// cpu_state is CHIP8_STATE_ERROR_OPCODE
+	CHIP8_RUN_EXIT_IDLE = 4,		// spinning on the delay timer; nothing changes until chip8_step_timers
+	CHIP8_RUN_EXIT_HALT = 5,		// cpu_state is CHIP8_STATE_HLT
+} CHIP8_RUN_EXIT;
+
+/* Chip8 decoded opcodes */
+typedef enum {
+	CHIP8_OP_NONE = 0,		// not decoded
+	CHIP8_OP_INVALID,
+	CHIP8_OP_00E0, CHIP8_OP_00EE, CHIP8_OP_1NNN, CHIP8_OP_2NNN,
+	CHIP8_OP_3XNN, CHIP8_OP_4XNN, CHIP8_OP_5XY0, CHIP8_OP_6XNN,
+	CHIP8_OP_7XNN, CHIP8_OP_8XY0, CHIP8_OP_8XY1, CHIP8_OP_8XY2,
+	CHIP8_OP_8XY3, CHIP8_OP_8XY4, CHIP8_OP_8XY5, CHIP8_OP_8XY6,
+	CHIP8_OP_8XY7, CHIP8_OP_8XYE, CHIP8_OP_9XY0, CHIP8_OP_ANNN,
+	CHIP8_OP_BNNN, CHIP8_OP_CXNN, CHIP8_OP_DXYN, CHIP8_OP_EX9E,
+	CHIP8_OP_EXA1, CHIP8_OP_FX07, CHIP8_OP_FX0A, CHIP8_OP_FX15,
+	CHIP8_OP_FX18, CHIP8_OP_FX1E, CHIP8_OP_FX29, CHIP8_OP_FX33,
+	CHIP8_OP_FX55, CHIP8_OP_FX65,
+	/* SCHIP; invalid on CHIP8_PLATFORM_CHIP8 */
+	CHIP8_OP_00CN, CHIP8_OP_00FB, CHIP8_OP_00FC, CHIP8_OP_00FD,
+	CHIP8_OP_00FE, CHIP8_OP_00FF, CHIP8_OP_FX30, CHIP8_OP_FX75,
+	CHIP8_OP_FX85,
+	/* XO-CHIP; invalid on the other platforms. F000 and F002 ignore X, as 00CN ignores its second nibble */
+	CHIP8_OP_00DN, CHIP8_OP_5XY2, CHIP8_OP_5XY3, CHIP8_OP_F000,
+	CHIP8_OP_FN01, CHIP8_OP_F002, CHIP8_OP_FX3A,
+	CHIP8_OP_COUNT
+} CHIP8_OP;
+
 /* Chip8 key state */
 typedef enum {
 	CHIP8_KEY_STATE_KEY_UP = 0,
@@ -66,11 +150,49 @@ typedef enum {
 	CHIP8_QUIRK_DISPLAY_WAIT = 128,
 } CHIP8_QUIRKS; 
 
-/* Chip8 state structure*/
+/* Chip8 platform */
+typedef enum {
+	CHIP8_PLATFORM_CHIP8 = 0,		// 64x32
+	CHIP8_PLATFORM_SCHIP = 1,		// SUPER-CHIP 1.1; 128x64 hires, scrolling, 16x16 sprites, big font, rpl flags
+	CHIP8_PLATFORM_XOCHIP = 2,		// SCHIP plus 64 KB of memory, two display planes and audio patterns; needs a CHIP8_XO
+} CHIP8_PLATFORM;
+
+/* Quirks each platform behaves with; see chip8_set_platform */
+#define CHIP8_QUIRKS_CHIP8 (CHIP8_QUIRK_NONE)
+#define CHIP8_QUIRKS_SCHIP (CHIP8_QUIRK_SHIFT_X_REGISTER | CHIP8_QUIRK_JUMP_VX | CHIP8_QUIRK_DISPLAY_CLIPPING)
+#define CHIP8_QUIRKS_XOCHIP (CHIP8_QUIRK_INCREMENT_I_REGISTER)
+
+/* XO-CHIP state the host provides, so CHIP-8 and SCHIP instances do not carry it;
+ * see chip8_set_platform */
+typedef struct CHIP8_XO {
+	uint8_t ram[CHIP8_XO_MEMORY_BYTES];		// memory; used in place of chip8->ram
+	uint64_t display[CHIP8_DISPLAY_WORDS];	// plane 2; chip8->display is plane 1
+	uint8_t pattern[CHIP8_XO_PATTERN_BYTES];// F002 audio pattern; 1 bit per sample, msb first
+	uint8_t pitch;							// FX3A; the pattern plays at 4000 * 2^((pitch - 64) / 48) samples a second
+} CHIP8_XO;
+
+#ifdef CHIP8_PREDECODE
+/* Chip8 predecoded instruction */
+typedef struct {
+	uint16_t opcode;
+	uint8_t op;				// CHIP8_OP or fused op; CHIP8_OP_NONE if not decoded
+} CHIP8_DECODED;
+#endif
+
+#ifdef CHIP8_PROFILER
+/* Chip8 execution profile */
 typedef struct {
+	uint64_t ops[CHIP8_OP_COUNT];			// instructions executed per CHIP8_OP
+	uint64_t pc_hits[CHIP8_MEMORY_BYTES];	// instructions executed per address; XO-CHIP addresses fold onto the first 4 KB
+	uint64_t pixels_toggled;				// pixels flipped by DXYN
+} CHIP8_PROFILE;
+#endif
+
+/* Chip8 state structure*/
+typedef struct CHIP8 {
 	uint16_t i;				// I register
 	uint16_t pc;			// program counter
-	uint16_t sp;			// stack pointer
+	uint16_t sp;			// stack pointer; calls and returns wrap around the 16 entry stack
 	uint16_t opcode;		// current opcode
 	uint16_t keypad;		// keypad state; 1 bit per key
 	uint16_t fxoa_state;	// FX0A keypad state; 1 bit per key
@@ -79,16 +201,42 @@ typedef struct {
 	uint8_t sound_timer;
 	uint8_t draw_display;
 	uint8_t cpu_state;
+	uint8_t platform;		// CHIP8_PLATFORM; see chip8_set_platform
+	uint8_t hires;			// SCHIP 128x64 mode; 00FF sets, 00FE clears
+	uint8_t planes;			// XO-CHIP planes drawn, scrolled and cleared; 1 bit per plane, set by FN01
 
 	uint8_t v[CHIP8_REGISTER_COUNT]; // general registers
+	uint8_t rpl[CHIP8_RPL_FLAGS]; // SCHIP flag registers; kept across chip8_reset_cpu
 	uint16_t stack[CHIP8_STACK_SIZE]; 
 	uint8_t ram[CHIP8_MEMORY_BYTES];
-	uint8_t display[CHIP8_DISPLAY_BYTES];
+	uint64_t display[CHIP8_DISPLAY_WORDS]; // 1 bit per pixel; see CHIP8_DISPLAY_GET_PX
+	uint64_t dirty_rows;	// display rows changed since chip8_clear_dirty_rows; 1 bit per row
+
+	uint32_t quirks;		// CHIP8_QUIRKS; see chip8_set_quirks
+	CHIP8_RUN_EXIT (*engine)(struct CHIP8* chip8, uint32_t max_instructions, uint32_t* executed); // chip8_run engine for quirks and platform
+	uint32_t rng[4];		// xoshiro128** state; see chip8_seed_random
+	uint32_t frame_debt;	// VIP cycles an instruction overran into the next frame; see chip8_run_frame
+	CHIP8_XO* xo;			// XO-CHIP memory, plane 2 and audio; see chip8_set_platform. NULL for none
+
+#ifdef CHIP8_PREDECODE
+	CHIP8_DECODED decoded[CHIP8_MEMORY_BYTES]; // predecoded instruction at each address
+#endif
 
-	uint32_t quirks;
+#ifdef CHIP8_SNAPSHOT_PAGES
+	uint16_t dirty_pages;		// ram pages written since snapshot_base; 1 bit per page
+	const void* snapshot_base;	// last snapshot taken or restored; see chip8_snapshot
+#endif
 
 #ifdef CYCLE_COUNT
-	uint64_t cycles;
+	uint64_t cycles;		// instructions executed since chip8_init_cpu
+#endif
+
+#ifdef CHIP8_PROFILER
+	CHIP8_PROFILE profile;
+#endif
+
+#ifdef CHIP8_AUDIO_SYNTH
+	struct CHIP8_AUDIO* audio;	// sound output; see chip8_audio_init. NULL for none
 #endif
 
 } CHIP8;
@@ -100,27 +248,100 @@ extern "C" {
 // Initialize chip8 cpu state
 void chip8_init_cpu(CHIP8* chip8);
 
-// Reset chip8 cpu state
+// Reset chip8 cpu state. SCHIP hires returns to lores, clearing the display.
+// Selects the chip8_run engine for chip8->quirks, as chip8_set_quirks does
 void chip8_reset_cpu(CHIP8* chip8);
 
+// Set quirks and select the chip8_run engine for them. chip8_run keeps the engine selected here,
+// by chip8_reset_cpu or by chip8_set_platform, so after writing chip8->quirks directly call
+// chip8_reset_cpu before running
+void chip8_set_quirks(CHIP8* chip8, uint32_t quirks);
+
+// Select the platform and set quirks to its CHIP8_QUIRKS_ preset; adjust them after with chip8_set_quirks.
+// Clears the display into lores. CHIP8_PLATFORM_SCHIP loads the big font at CHIP8_BIG_FONT_ADDR,
+// so call it before chip8_load_program. chip8_init_cpu selects CHIP8_PLATFORM_CHIP8.
+// CHIP8_PLATFORM_XOCHIP runs out of the CHIP8_XO set in chip8->xo, zeroing it and loading both fonts.
+// Returns 0 on success, 1 for CHIP8_PLATFORM_XOCHIP without chip8->xo, or for any platform but
+// CHIP8_PLATFORM_CHIP8 with CHIP8_NO_SCHIP
+int chip8_set_platform(CHIP8* chip8, CHIP8_PLATFORM platform);
+
 // Load font into chip8 memory space
 void chip8_load_font(CHIP8* chip8, const uint8_t* font);
 
+// Load program into chip8 memory space at CHIP8_PROGRAM_ADDR; XO-CHIP programs may fill all 64 KB
+void chip8_load_program(CHIP8* chip8, const uint8_t* program, uint16_t size);
+
+// Invalidate predecoded instructions and mark pages dirty after writing to chip8 memory directly
+void chip8_invalidate_memory(CHIP8* chip8, uint16_t address, uint16_t size);
+
 // Zero chip8 entire memory space
 void chip8_zero_memory(CHIP8* chip8);
 
 // Zero chip8 program space
 void chip8_zero_program_memory(CHIP8* chip8);
 
-// Zero chip8 video space
+// Zero chip8 video space; every plane
 void chip8_zero_video_memory(CHIP8* chip8);
 
+// Get display rows changed since the last chip8_clear_dirty_rows; bit n is row n.
+// A change of resolution marks every row of the new one
+uint64_t chip8_get_dirty_rows(CHIP8* chip8);
+
+// Clear dirty rows; call after rendering
+void chip8_clear_dirty_rows(CHIP8* chip8);
+
 // Step timers
 void chip8_step_timers(CHIP8* chip8);
 
-// Decode and execute next instruction
+// Set the keypad state; 1 bit per key. A cpu waiting in FX0A resumes here once a key has been
+// pressed and released, so hosts can block on input while cpu_state is CHIP8_STATE_KEY_WAIT
+void chip8_set_keypad(CHIP8* chip8, uint16_t keypad);
+
+// Set the state of one key; see chip8_set_keypad
+void chip8_set_key(CHIP8* chip8, uint8_t key, CHIP8_KEY_STATE state);
+
+#ifdef CHIP8_PROFILER
+// Zero the execution profile
+void chip8_reset_profile(CHIP8* chip8);
+#endif
+
+// Seed the instance random generator used by CXNN; the same seed gives the same sequence
+void chip8_seed_random(CHIP8* chip8, uint64_t seed);
+
+// Seed a generator state (uint32_t[4]) as chip8_seed_random does
+void chip8_rng_seed(uint32_t* rng, uint64_t seed);
+
+// Next random byte from a generator state; advances the state
+uint8_t chip8_rng_byte(uint32_t* rng);
+
+// Decode and execute next instruction. Does nothing once halted; while waiting in FX0A
+// it only scans the keypad, completing the FX0A if a key was pressed and released
 void chip8_execute(CHIP8* chip8);
 
+// Decode opcode into a CHIP8_OP; CHIP8_OP_INVALID if not a valid opcode
+CHIP8_OP chip8_decode_op(uint16_t opcode);
+
+#if defined(CHIP8_DISPATCH_THREADED) || defined(CHIP8_MNEMONICS)
+// chip8_decode_op as a table; the CHIP8_OP of opcode is chip8_op_table[opcode >> 12][opcode & 0xFF]
+extern const uint8_t chip8_op_table[16][256];
+#endif
+
+// Decode and execute up to max_instructions; stops early on draw, FX0A key wait, an idle loop on the
+// delay timer, a jump to self (halt) or opcode error.
+// The number of instructions executed is stored in executed if not NULL.
+CHIP8_RUN_EXIT chip8_run(CHIP8* chip8, uint32_t max_instructions, uint32_t* executed);
+
+// VIP machine cycles the instruction at pc takes on the COSMAC VIP, including fetch and decode.
+// Depends on the current registers, so call before executing it
+uint32_t chip8_vip_cycles(const CHIP8* chip8);
+
+// chip8_run with COSMAC VIP timing; runs until cycles VIP cycles are spent, charging each instruction
+// chip8_vip_cycles as it decodes it. Stops early as chip8_run does, except 00E0, which does not wait for vblank.
+// Sets frame_debt to the cycles the last instruction overran by, or to the cost of a DXYN that stopped on
+// CHIP8_QUIRK_DISPLAY_WAIT. chip8_run_frame (chip8_timing.h) runs one 60 Hz frame with it.
+// The number of instructions executed is stored in executed if not NULL.
+CHIP8_RUN_EXIT chip8_run_vip(CHIP8* chip8, uint32_t cycles, uint32_t* executed);
+
 /*
  * Implementation dependent functions
  */
@@ -128,11 +349,15 @@ void chip8_execute(CHIP8* chip8);
  /* Chip8 Render implementation */
 void chip8_render(CHIP8* chip8);
 
+#ifndef CHIP8_AUDIO_SYNTH
 /* Chip8 Beep implementation */
 void chip8_beep(CHIP8* chip8);
+#endif
 
+#ifdef CHIP8_RANDOM_HOOK
 /* Chip8 Random byte implementation */
 uint8_t chip8_random();
+#endif
 
 #ifdef __cplusplus
 };
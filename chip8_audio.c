@@ -0,0 +1,140 @@
+// chip8_audio.c
+//
+// GitHub: https:\\github.com\tommojphillips
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chip8_defines.h"
+#include "chip8.h"
+#include "chip8_audio.h"
+
+#define TICKS_PER_SECOND 60
+
+/* 2^(n/48) in 16.16 fixed point; XO-CHIP pitch steps are 48 to the octave */
+static const uint32_t chip8_audio_pitch_steps[48] = {
+	65536, 66489, 67456, 68438, 69433, 70443, 71468, 72507,
+	73562, 74632, 75717, 76819, 77936, 79069, 80220, 81386,
+	82570, 83771, 84990, 86226, 87480, 88752, 90043, 91353,
+	92682, 94030, 95398, 96785, 98193, 99621, 101070, 102540,
+	104032, 105545, 107080, 108638, 110218, 111821, 113448, 115098,
+	116772, 118470, 120194, 121942, 123715, 125515, 127341, 129193,
+};
+
+/* Atomics; only the ring indices are shared between the producer and consumer */
+#ifdef _MSC_VER
+#include <intrin.h>
+#define ATOMIC_LOAD(p)			(_ReadWriteBarrier(), *(volatile uint32_t*)(p))
+#define ATOMIC_STORE(p, v)		(_ReadWriteBarrier(), *(volatile uint32_t*)(p) = (v))
+#else
+#define ATOMIC_LOAD(p)			__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE(p, v)		__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#endif
+
+int chip8_audio_init(CHIP8_AUDIO* audio, int16_t* buffer, uint32_t capacity, uint32_t sample_rate) {
+
+	if (capacity == 0 || (capacity & (capacity - 1)) != 0 || sample_rate == 0) {
+		return 1;
+	}
+
+	audio->samples = buffer;
+	audio->capacity = capacity;
+	audio->sample_rate = sample_rate;
+	audio->phase = 0;
+	audio->tick_remainder = 0;
+	audio->playing = 0;
+	audio->dropped = 0;
+	audio->write = 0;
+	audio->read = 0;
+	audio->pattern = NULL;
+	audio->pattern_step = 0;
+	chip8_audio_set_tone(audio, CHIP8_AUDIO_DEFAULT_FREQUENCY, CHIP8_AUDIO_DEFAULT_AMPLITUDE);
+	return 0;
+}
+void chip8_audio_set_tone(CHIP8_AUDIO* audio, uint32_t frequency, int16_t amplitude) {
+	audio->step = (uint32_t)(((uint64_t)frequency << 32) / audio->sample_rate);
+	audio->amplitude = amplitude;
+}
+
+void chip8_audio_set_pattern(CHIP8_AUDIO* audio, const uint8_t* pattern, uint8_t pitch) {
+	/* The pattern plays at 4000 * 2^((pitch - 64) / 48) bits a second; 2^25 phase per bit */
+
+	const int steps = pitch + 128;	// pitch - 64 in 48ths of an octave, offset by 4 octaves
+	const int octave = steps / 48 - 4;
+	uint64_t rate = 4000ULL * chip8_audio_pitch_steps[steps % 48];
+
+	rate = (octave >= 0) ? rate << octave : rate >> -octave;
+	audio->pattern = pattern;
+	audio->pattern_step = (uint32_t)((rate << 9) / audio->sample_rate);
+}
+
+void chip8_audio_tick(CHIP8_AUDIO* audio, int sound) {
+	/* Render one tick of samples into the ring */
+
+	const uint32_t mask = audio->capacity - 1;
+	uint32_t write = audio->write;
+	uint32_t space = audio->capacity - (write - ATOMIC_LOAD(&audio->read));
+	uint32_t count;
+	uint32_t bit;
+	uint32_t n;
+
+	audio->tick_remainder += audio->sample_rate;
+	count = audio->tick_remainder / TICKS_PER_SECOND;
+	audio->tick_remainder %= TICKS_PER_SECOND;
+
+	if (count > space) {
+		audio->dropped += count - space;
+		count = space;
+	}
+
+	if (sound) {
+		if (!audio->playing) {
+			/* every tone starts on a fresh cycle */
+			audio->phase = 0;
+			audio->playing = 1;
+		}
+		if (audio->pattern != NULL) {
+			for (n = 0; n < count; ++n) {
+				bit = audio->phase >> 25;
+				audio->samples[(write + n) & mask] = ((audio->pattern[bit >> 3] << (bit & 7)) & 0x80) ? audio->amplitude : -audio->amplitude;
+				audio->phase += audio->pattern_step;
+			}
+		}
+		else {
+			for (n = 0; n < count; ++n) {
+				audio->samples[(write + n) & mask] = (audio->phase & 0x80000000) ? -audio->amplitude : audio->amplitude;
+				audio->phase += audio->step;
+			}
+		}
+	}
+	else {
+		audio->playing = 0;
+		for (n = 0; n < count; ++n) {
+			audio->samples[(write + n) & mask] = 0;
+		}
+	}
+
+	ATOMIC_STORE(&audio->write, write + count);
+}
+
+uint32_t chip8_audio_available(const CHIP8_AUDIO* audio) {
+	return ATOMIC_LOAD(&audio->write) - ATOMIC_LOAD(&audio->read);
+}
+uint32_t chip8_audio_read(CHIP8_AUDIO* audio, int16_t* out, uint32_t count) {
+	/* Copy out up to count samples and release their slots */
+
+	const uint32_t mask = audio->capacity - 1;
+	uint32_t read = audio->read;
+	uint32_t available = ATOMIC_LOAD(&audio->write) - read;
+	uint32_t n;
+
+	if (count > available) {
+		count = available;
+	}
+	for (n = 0; n < count; ++n) {
+		out[n] = audio->samples[(read + n) & mask];
+	}
+
+	ATOMIC_STORE(&audio->read, read + count);
+	return count;
+}
@@ -0,0 +1,78 @@
+// chip8_audio.h
+//
+// GitHub: https:\\github.com\tommojphillips
+
+#ifndef CHIP8_AUDIO_H
+#define CHIP8_AUDIO_H
+
+#include <stdint.h>
+
+#include "chip8_defines.h"
+#include "chip8.h"
+
+#define CHIP8_AUDIO_DEFAULT_FREQUENCY	440
+#define CHIP8_AUDIO_DEFAULT_AMPLITUDE	0x2000
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define CHIP8_AUDIO_ALIGN __declspec(align(64))
+#else
+#define CHIP8_AUDIO_ALIGN __attribute__((aligned(64)))
+#endif
+
+/* Chip8 audio; renders the sound timer as a square wave into a ring of signed
+ * 16 bit mono samples. Every timer tick produces sample_rate / 60 samples,
+ * tone or silence, so the stream starts and stops exactly on tick boundaries.
+ *
+ * The ring is single producer, single consumer and lock free: the thread
+ * stepping the timers writes, one audio thread reads with chip8_audio_read.
+ * Samples that do not fit are dropped rather than blocking the emulator.
+ *
+ * XO-CHIP replaces the square wave with a 128 bit pattern of full scale
+ * samples; chip8_step_timers sets it from chip8->xo each tick. */
+typedef struct CHIP8_AUDIO {
+	int16_t* samples;		// ring buffer of capacity samples
+	uint32_t capacity;		// power of two
+	uint32_t sample_rate;
+	uint32_t step;			// phase step per sample; 32 bit fraction of a cycle
+	const uint8_t* pattern;	// CHIP8_XO_PATTERN_BYTES played in place of the square wave; NULL for the tone
+	uint32_t pattern_step;	// phase step per sample through the pattern; a cycle is the whole pattern
+	uint32_t phase;
+	uint32_t tick_remainder;	// sample_rate / 60 remainder carried to the next tick
+	int16_t amplitude;
+	uint8_t playing;
+	uint64_t dropped;		// samples dropped because the ring was full
+
+	CHIP8_AUDIO_ALIGN uint32_t write;	// samples written; producer only
+	CHIP8_AUDIO_ALIGN uint32_t read;	// samples read; consumer only
+} CHIP8_AUDIO;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Initialize audio with a caller supplied ring of capacity samples (a power of two) at sample_rate.
+// The tone is CHIP8_AUDIO_DEFAULT_FREQUENCY. Returns 0 on success, 1 on a bad capacity or sample rate.
+// With CHIP8_AUDIO_SYNTH, set chip8->audio to render from chip8_step_timers
+int chip8_audio_init(CHIP8_AUDIO* audio, int16_t* buffer, uint32_t capacity, uint32_t sample_rate);
+
+// Set the tone frequency in Hz and its amplitude
+void chip8_audio_set_tone(CHIP8_AUDIO* audio, uint32_t frequency, int16_t amplitude);
+
+// Play pattern (CHIP8_XO_PATTERN_BYTES, msb first) at the XO-CHIP pitch in place of the tone; NULL for the tone.
+// The pattern is read as it renders, so it may change between ticks
+void chip8_audio_set_pattern(CHIP8_AUDIO* audio, const uint8_t* pattern, uint8_t pitch);
+
+// Render one 60 Hz timer tick; tone if sound is non zero, else silence. Producer side.
+// chip8_step_timers calls this with the sound timer; call it directly for instances stepped elsewhere
+void chip8_audio_tick(CHIP8_AUDIO* audio, int sound);
+
+// Samples waiting in the ring
+uint32_t chip8_audio_available(const CHIP8_AUDIO* audio);
+
+// Read up to count samples into out. Consumer side. Returns the number of samples read
+uint32_t chip8_audio_read(CHIP8_AUDIO* audio, int16_t* out, uint32_t count);
+
+#ifdef __cplusplus
+};
+#endif
+#endif
@@ -0,0 +1,651 @@
+// chip8_batch.c
+//
+// GitHub: https:\\github.com\tommojphillips
+
+/* Lockstep batch engine. When every lane is at the same pc on the same
+ * opcode, a step is one check of the opcode bytes and one vector op on all
+ * lanes. Otherwise the step fetches lane by lane and executes each distinct
+ * opcode once across the lanes that share it, under a lane mask. Register,
+ * timer and (at an equal stack depth) call opcodes run as vectors; opcodes
+ * that touch ram or the display, and CXNN, run lane by lane. Lanes running
+ * the same code in step are the fast case; lanes that diverge for good are
+ * slower than running each one with chip8_run.
+ *
+ * Vectors use GCC/Clang vector extensions, which compile to SSE2/AVX2
+ * depending on the target flags (-mavx2). Other compilers, or defining
+ * CHIP8_BATCH_SCALAR, use plain per-lane loops. */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "chip8_defines.h"
+#include "chip8.h"
+#include "chip8_batch.h"
+
+#define X ((opcode >> 8) & 0x0F) // X register index
+#define Y ((opcode >> 4) & 0x00F) // Y register index
+#define NNN (opcode & 0x0FFF)
+#define NN (opcode & 0x00FF)
+#define N (opcode & 0x000F)
+
+#define LANE_READ_BYTE(lane, address) batch->ram[lane][(address) & (CHIP8_MEMORY_BYTES - 1)]
+
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(CHIP8_BATCH_SCALAR)
+#define CHIP8_BATCH_SIMD
+#endif
+
+/* LANE VECTORS */
+
+#ifdef CHIP8_BATCH_SIMD
+
+/* Helpers are macros so vectors wider than the enabled instruction set
+ * are never passed by value */
+typedef uint8_t LANES8 __attribute__((vector_size(CHIP8_BATCH_LANES), may_alias));
+typedef uint16_t LANES16 __attribute__((vector_size(CHIP8_BATCH_LANES * 2), may_alias));
+
+#define load8(p)		(*(const LANES8*)(p))
+#define load16(p)		(*(const LANES16*)(p))
+#define store8(p, a)	(*(LANES8*)(p) = (a))
+#define store16(p, a)	(*(LANES16*)(p) = (a))
+#define dup8(x)			((LANES8){ 0 } + (uint8_t)(x))
+#define dup16(x)		((LANES16){ 0 } + (uint16_t)(x))
+
+#define add8(a, b)		((a) + (b))
+#define sub8(a, b)		((a) - (b))
+#define and8(a, b)		((a) & (b))
+#define or8(a, b)		((a) | (b))
+#define xor8(a, b)		((a) ^ (b))
+#define not8(a)			(~(a))
+#define shr8(a, n)		((a) >> (n))
+#define shl8(a, n)		((a) << (n))
+#define eq8(a, b)		((LANES8)((a) == (b)))
+#define ge8(a, b)		((LANES8)((a) >= (b)))
+#define sel8(m, a, b)	(((m) & (a)) | (~(m) & (b)))
+
+#define add16(a, b)		((a) + (b))
+#define and16(a, b)		((a) & (b))
+#define or16(a, b)		((a) | (b))
+#define shl16(a, n)		((a) << (n))
+#define shr16v(a, n)	((a) >> (n))
+#define sel16(m, a, b)	(((m) & (a)) | (~(m) & (b)))
+#define widen(a)		__builtin_convertvector((a), LANES16)
+#define narrow(a)		__builtin_convertvector((a), LANES8)
+
+#else
+
+typedef struct { uint8_t l[CHIP8_BATCH_LANES]; } LANES8;
+typedef struct { uint16_t l[CHIP8_BATCH_LANES]; } LANES16;
+
+#define LANES_FOR(r, expr) for (int k = 0; k < CHIP8_BATCH_LANES; ++k) { r.l[k] = (expr); } return r
+
+static inline LANES8 load8(const uint8_t* p) { LANES8 r; LANES_FOR(r, p[k]); }
+static inline LANES16 load16(const uint16_t* p) { LANES16 r; LANES_FOR(r, p[k]); }
+static inline void store8(uint8_t* p, LANES8 a) { for (int k = 0; k < CHIP8_BATCH_LANES; ++k) p[k] = a.l[k]; }
+static inline void store16(uint16_t* p, LANES16 a) { for (int k = 0; k < CHIP8_BATCH_LANES; ++k) p[k] = a.l[k]; }
+static inline LANES8 dup8(uint8_t x) { LANES8 r; LANES_FOR(r, x); }
+static inline LANES16 dup16(uint16_t x) { LANES16 r; LANES_FOR(r, x); }
+
+static inline LANES8 add8(LANES8 a, LANES8 b) { LANES8 r; LANES_FOR(r, (uint8_t)(a.l[k] + b.l[k])); }
+static inline LANES8 sub8(LANES8 a, LANES8 b) { LANES8 r; LANES_FOR(r, (uint8_t)(a.l[k] - b.l[k])); }
+static inline LANES8 and8(LANES8 a, LANES8 b) { LANES8 r; LANES_FOR(r, a.l[k] & b.l[k]); }
+static inline LANES8 or8(LANES8 a, LANES8 b) { LANES8 r; LANES_FOR(r, a.l[k] | b.l[k]); }
+static inline LANES8 xor8(LANES8 a, LANES8 b) { LANES8 r; LANES_FOR(r, a.l[k] ^ b.l[k]); }
+static inline LANES8 not8(LANES8 a) { LANES8 r; LANES_FOR(r, (uint8_t)~a.l[k]); }
+static inline LANES8 shr8(LANES8 a, int n) { LANES8 r; LANES_FOR(r, (uint8_t)(a.l[k] >> n)); }
+static inline LANES8 shl8(LANES8 a, int n) { LANES8 r; LANES_FOR(r, (uint8_t)(a.l[k] << n)); }
+static inline LANES8 eq8(LANES8 a, LANES8 b) { LANES8 r; LANES_FOR(r, a.l[k] == b.l[k] ? 0xFF : 0x00); }
+static inline LANES8 ge8(LANES8 a, LANES8 b) { LANES8 r; LANES_FOR(r, a.l[k] >= b.l[k] ? 0xFF : 0x00); }
+static inline LANES8 sel8(LANES8 m, LANES8 a, LANES8 b) { LANES8 r; LANES_FOR(r, m.l[k] ? a.l[k] : b.l[k]); }
+
+static inline LANES16 add16(LANES16 a, LANES16 b) { LANES16 r; LANES_FOR(r, (uint16_t)(a.l[k] + b.l[k])); }
+static inline LANES16 and16(LANES16 a, LANES16 b) { LANES16 r; LANES_FOR(r, a.l[k] & b.l[k]); }
+static inline LANES16 or16(LANES16 a, LANES16 b) { LANES16 r; LANES_FOR(r, a.l[k] | b.l[k]); }
+static inline LANES16 shl16(LANES16 a, int n) { LANES16 r; LANES_FOR(r, (uint16_t)(a.l[k] << n)); }
+static inline LANES16 shr16v(LANES16 a, LANES16 n) { LANES16 r; LANES_FOR(r, (uint16_t)(a.l[k] >> n.l[k])); }
+static inline LANES16 sel16(LANES16 m, LANES16 a, LANES16 b) { LANES16 r; LANES_FOR(r, m.l[k] ? a.l[k] : b.l[k]); }
+static inline LANES16 widen(LANES8 a) { LANES16 r; LANES_FOR(r, a.l[k]); }
+static inline LANES8 narrow(LANES16 a) { LANES8 r; LANES_FOR(r, (uint8_t)a.l[k]); }
+
+#endif
+
+/* 0xFF byte mask to 0xFFFF word mask */
+#define mask16(m)		or16(widen(m), shl16(widen(m), 8))
+
+/* Lane masks hold 0xFF or 0x00 per lane; test them 8 lanes at a time */
+
+static inline int chip8_batch_any(const uint8_t* mask) {
+	uint64_t w, any = 0;
+	for (int k = 0; k < CHIP8_BATCH_LANES; k += 8) {
+		memcpy(&w, mask + k, 8);
+		any |= w;
+	}
+	return any != 0;
+}
+static inline int chip8_batch_all(const uint8_t* mask) {
+	uint64_t w, all = ~(uint64_t)0;
+	for (int k = 0; k < CHIP8_BATCH_LANES; k += 8) {
+		memcpy(&w, mask + k, 8);
+		all &= w;
+	}
+	return all == ~(uint64_t)0;
+}
+static inline int chip8_batch_same16(const uint16_t* a) {
+	/* Whether every lane of a holds a[0]; 4 lanes at a time */
+	uint64_t w, diff = 0;
+	const uint64_t first = a[0] * 0x0001000100010001ull;
+	for (int k = 0; k < CHIP8_BATCH_LANES; k += 4) {
+		memcpy(&w, a + k, 8);
+		diff |= w ^ first;
+	}
+	return diff == 0;
+}
+
+#define FOR_EACH_LANE(mask) for (uint32_t lane = 0; lane < CHIP8_BATCH_LANES; ++lane) if ((mask)[lane] != 0)
+
+/* LANE OPCODES */
+
+static void chip8_batch_lane_DXYN(CHIP8_BATCH* batch, uint32_t lane, uint16_t opcode) {
+	// DRW VX, VY, N; same as chip8_DXYN
+	uint64_t* display = batch->display[lane];
+	uint64_t row, hit = 0;
+	uint16_t i = batch->i[lane];
+	uint8_t vx, vy;
+	batch->v[0xF][lane] = 0;
+	vx = batch->v[X][lane] & (CHIP8_DISPLAY_WIDTH - 1);
+	vy = batch->v[Y][lane] & (CHIP8_DISPLAY_HEIGHT - 1);
+	for (int y = 0; y < N; ++y) {
+		row = (uint64_t)LANE_READ_BYTE(lane, i + y) << 56;
+		if (batch->quirks & CHIP8_QUIRK_DISPLAY_CLIPPING) {
+			if (vy + y >= CHIP8_DISPLAY_HEIGHT) {
+				break;
+			}
+			row >>= vx;
+		}
+		else {
+			row = (row >> vx) | (row << ((CHIP8_DISPLAY_WIDTH - vx) & (CHIP8_DISPLAY_WIDTH - 1)));
+		}
+		hit |= display[(vy + y) & (CHIP8_DISPLAY_HEIGHT - 1)] & row;
+		display[(vy + y) & (CHIP8_DISPLAY_HEIGHT - 1)] ^= row;
+		batch->dirty_rows[lane] |= (uint64_t)(row != 0) << ((vy + y) & (CHIP8_DISPLAY_HEIGHT - 1));
+	}
+	if (hit != 0) {
+		batch->v[0xF][lane] = 1;
+	}
+	if (batch->quirks & CHIP8_QUIRK_DISPLAY_WAIT) {
+		batch->draw_display[lane] = 1;
+	}
+	batch->pc[lane] += 2;
+}
+static int chip8_batch_lane_key_wait(CHIP8_BATCH* batch, uint32_t lane, uint16_t opcode) {
+	/* FX0A key state; returns 1 once a key is pressed and released */
+	uint16_t keypad = batch->keypad[lane];
+	uint16_t state = batch->fxoa_state[lane] | keypad;
+	uint16_t released = state & ~keypad;
+	int key = 0;
+	batch->fxoa_state[lane] = state;
+	if (released == 0) {
+		return 0;
+	}
+	// lowest key pressed and released
+	while (!((released >> key) & 1)) {
+		key += 1;
+	}
+	batch->v[X][lane] = (uint8_t)key;
+	batch->pc[lane] += 2;
+	batch->fxoa_state[lane] = 0;
+	return 1;
+}
+static void chip8_batch_lanes(CHIP8_BATCH* batch, uint16_t opcode, CHIP8_OP op, const uint8_t* lane_mask) {
+	/* Execute opcode lane by lane in every lane set in lane_mask; opcodes
+	 * that index per-lane memory, the stack or the display. The switch is
+	 * outside the lane loops so each loop is a few scalar instructions. */
+
+	uint16_t sp;
+
+	switch (op) {
+		case CHIP8_OP_00E0:
+			FOR_EACH_LANE(lane_mask) {
+				for (int r = 0; r < CHIP8_DISPLAY_HEIGHT; ++r) {
+					batch->dirty_rows[lane] |= (uint64_t)(batch->display[lane][r] != 0) << r;
+					batch->display[lane][r] = 0;
+				}
+				if (batch->quirks & CHIP8_QUIRK_DISPLAY_WAIT) {
+					batch->draw_display[lane] = 1;
+				}
+				batch->pc[lane] += 2;
+			}
+			break;
+
+		case CHIP8_OP_00EE:
+			FOR_EACH_LANE(lane_mask) {
+				sp = batch->sp[lane];
+				batch->pc[lane] = batch->stack[sp & (CHIP8_STACK_SIZE - 1)][lane] + 2;
+				batch->sp[lane] = sp - 1;
+			}
+			break;
+
+		case CHIP8_OP_2NNN:
+			FOR_EACH_LANE(lane_mask) {
+				sp = batch->sp[lane] + 1;
+				batch->stack[sp & (CHIP8_STACK_SIZE - 1)][lane] = batch->pc[lane];
+				batch->sp[lane] = sp;
+				batch->pc[lane] = NNN;
+			}
+			break;
+
+		case CHIP8_OP_CXNN:
+			FOR_EACH_LANE(lane_mask) {
+#ifdef CHIP8_RANDOM_HOOK
+				batch->v[X][lane] = chip8_random() & NN;
+#else
+				batch->v[X][lane] = chip8_rng_byte(batch->rng[lane]) & NN;
+#endif
+				batch->pc[lane] += 2;
+			}
+			break;
+
+		case CHIP8_OP_DXYN:
+			FOR_EACH_LANE(lane_mask) {
+				chip8_batch_lane_DXYN(batch, lane, opcode);
+			}
+			break;
+
+		case CHIP8_OP_FX0A:
+			FOR_EACH_LANE(lane_mask) {
+				if (!chip8_batch_lane_key_wait(batch, lane, opcode)) {
+					// park the lane until its keypad changes
+					batch->cpu_state[lane] = CHIP8_STATE_KEY_WAIT;
+				}
+			}
+			break;
+
+		case CHIP8_OP_FX33:
+			FOR_EACH_LANE(lane_mask) {
+				uint8_t* ram = batch->ram[lane];
+				uint16_t i = batch->i[lane];
+				uint8_t vx = batch->v[X][lane];
+				ram[i & (CHIP8_MEMORY_BYTES - 1)] = (vx % 1000) / 100;
+				ram[(i + 1) & (CHIP8_MEMORY_BYTES - 1)] = (vx % 100) / 10;
+				ram[(i + 2) & (CHIP8_MEMORY_BYTES - 1)] = (vx % 10);
+				batch->pc[lane] += 2;
+			}
+			break;
+
+		case CHIP8_OP_FX55:
+			FOR_EACH_LANE(lane_mask) {
+				uint8_t* ram = batch->ram[lane];
+				uint16_t i = batch->i[lane];
+				for (int r = 0; r <= X; ++r) {
+					ram[(i + r) & (CHIP8_MEMORY_BYTES - 1)] = batch->v[r][lane];
+				}
+				if (batch->quirks & CHIP8_QUIRK_INCREMENT_I_REGISTER) {
+					batch->i[lane] += X + 1;
+				}
+				batch->pc[lane] += 2;
+			}
+			break;
+
+		case CHIP8_OP_FX65:
+			FOR_EACH_LANE(lane_mask) {
+				uint16_t i = batch->i[lane];
+				for (int r = 0; r <= X; ++r) {
+					batch->v[r][lane] = LANE_READ_BYTE(lane, i + r);
+				}
+				if (batch->quirks & CHIP8_QUIRK_INCREMENT_I_REGISTER) {
+					batch->i[lane] += X + 1;
+				}
+				batch->pc[lane] += 2;
+			}
+			break;
+
+		default:
+			FOR_EACH_LANE(lane_mask) {
+				batch->cpu_state[lane] = CHIP8_STATE_ERROR_OPCODE;
+			}
+			break;
+	}
+}
+
+/* VECTOR OPCODES */
+
+static void chip8_batch_execute(CHIP8_BATCH* batch, uint16_t opcode, const uint8_t* lane_mask) {
+	/* Execute opcode in every lane set in lane_mask. Every register write
+	 * is a select on the mask so lanes outside it keep their state. */
+
+	const CHIP8_OP op = chip8_decode_op(opcode);
+	const LANES8 m = load8(lane_mask);
+	const LANES16 m16 = mask16(m);
+	const LANES16 pc = load16(batch->pc);
+	const LANES16 next = add16(pc, and16(m16, dup16(2)));
+	LANES8 vx = load8(batch->v[X]);
+	LANES8 vy = load8(batch->v[Y]);
+	LANES8 r, vf, skip;
+	LANES16 key;
+	uint16_t sp;
+
+	switch (op) {
+		case CHIP8_OP_1NNN:
+			store16(batch->pc, sel16(m16, dup16(NNN), pc));
+			return;
+
+		case CHIP8_OP_2NNN:
+		case CHIP8_OP_00EE:
+			if (!chip8_batch_same16(batch->sp)) {
+				chip8_batch_lanes(batch, opcode, op, lane_mask);
+				return;
+			}
+			// every lane at the same depth; the stack slot is one vector
+			sp = batch->sp[0];
+			if (op == CHIP8_OP_2NNN) {
+				sp += 1;
+				store16(batch->stack[sp & (CHIP8_STACK_SIZE - 1)], sel16(m16, pc, load16(batch->stack[sp & (CHIP8_STACK_SIZE - 1)])));
+				store16(batch->pc, sel16(m16, dup16(NNN), pc));
+			}
+			else {
+				store16(batch->pc, sel16(m16, add16(load16(batch->stack[sp & (CHIP8_STACK_SIZE - 1)]), dup16(2)), pc));
+				sp -= 1;
+			}
+			store16(batch->sp, sel16(m16, dup16(sp), load16(batch->sp)));
+			return;
+
+		case CHIP8_OP_3XNN: skip = eq8(vx, dup8(NN)); goto skip_next;
+		case CHIP8_OP_4XNN: skip = not8(eq8(vx, dup8(NN))); goto skip_next;
+		case CHIP8_OP_5XY0:
+		case CHIP8_OP_5XY2:
+		case CHIP8_OP_5XY3: skip = eq8(vx, vy); goto skip_next;
+		case CHIP8_OP_9XY0: skip = not8(eq8(vx, vy)); goto skip_next;
+
+		case CHIP8_OP_EX9E:
+		case CHIP8_OP_EXA1:
+			/* Key VX; like CHIP8_KEYPAD_GET on x86, keys 16-31 read as up
+			 * and the shift count wraps at 32 */
+			key = and16(shr16v(load16(batch->keypad), widen(and8(vx, dup8(0x0F)))), dup16(1));
+			skip = eq8(and8(vx, dup8(0x10)), dup8(0));
+			skip = and8(skip, not8(eq8(narrow(key), dup8(0))));
+			if (op == CHIP8_OP_EXA1) {
+				skip = not8(skip);
+			}
+			goto skip_next;
+
+		case CHIP8_OP_6XNN: r = dup8(NN); break;
+		case CHIP8_OP_7XNN: r = add8(vx, dup8(NN)); break;
+		case CHIP8_OP_8XY0: r = vy; break;
+
+		case CHIP8_OP_8XY1:
+		case CHIP8_OP_8XY2:
+		case CHIP8_OP_8XY3:
+			r = op == CHIP8_OP_8XY1 ? or8(vx, vy) : op == CHIP8_OP_8XY2 ? and8(vx, vy) : xor8(vx, vy);
+			store8(batch->v[X], sel8(m, r, vx));
+			if (batch->quirks & CHIP8_QUIRK_ZERO_VF_REGISTER) {
+				store8(batch->v[0xF], sel8(m, dup8(0), load8(batch->v[0xF])));
+			}
+			store16(batch->pc, next);
+			return;
+
+		case CHIP8_OP_8XY4:
+			r = add8(vx, vy);
+			vf = and8(not8(ge8(r, vx)), dup8(1)); // carry if the sum wrapped
+			goto write_vf;
+		case CHIP8_OP_8XY5:
+			r = sub8(vx, vy);
+			vf = and8(ge8(vx, vy), dup8(1));
+			goto write_vf;
+		case CHIP8_OP_8XY6:
+			vf = and8(vx, dup8(1));
+			r = shr8((batch->quirks & CHIP8_QUIRK_SHIFT_X_REGISTER) ? vx : vy, 1);
+			goto write_vf;
+		case CHIP8_OP_8XY7:
+			r = sub8(vy, vx);
+			vf = and8(ge8(vy, vx), dup8(1));
+			goto write_vf;
+		case CHIP8_OP_8XYE:
+			vf = shr8(vx, 7);
+			r = shl8((batch->quirks & CHIP8_QUIRK_SHIFT_X_REGISTER) ? vx : vy, 1);
+			goto write_vf;
+
+		case CHIP8_OP_ANNN:
+			store16(batch->i, sel16(m16, dup16(NNN), load16(batch->i)));
+			store16(batch->pc, next);
+			return;
+
+		case CHIP8_OP_BNNN:
+			r = (batch->quirks & CHIP8_QUIRK_JUMP_VX) ? vx : load8(batch->v[0]);
+			store16(batch->pc, sel16(m16, add16(dup16(NNN), widen(r)), pc));
+			return;
+
+		case CHIP8_OP_FX07: r = load8(batch->delay_timer); break;
+
+		case CHIP8_OP_FX15:
+			store8(batch->delay_timer, sel8(m, vx, load8(batch->delay_timer)));
+			store16(batch->pc, next);
+			return;
+		case CHIP8_OP_FX18:
+			store8(batch->sound_timer, sel8(m, vx, load8(batch->sound_timer)));
+			store16(batch->pc, next);
+			return;
+		case CHIP8_OP_FX1E:
+			store16(batch->i, sel16(m16, add16(load16(batch->i), widen(vx)), load16(batch->i)));
+			store16(batch->pc, next);
+			return;
+		case CHIP8_OP_FX29:
+			key = widen(vx);
+			store16(batch->i, sel16(m16, add16(shl16(key, 2), key), load16(batch->i)));
+			store16(batch->pc, next);
+			return;
+
+		default:
+			// memory, stack and display opcodes
+			chip8_batch_lanes(batch, opcode, op, lane_mask);
+			return;
+	}
+
+	// VX = r
+	store8(batch->v[X], sel8(m, r, vx));
+	store16(batch->pc, next);
+	return;
+
+write_vf:
+	// VX = r, then VF = vf
+	store8(batch->v[X], sel8(m, r, vx));
+	store8(batch->v[0xF], sel8(m, vf, load8(batch->v[0xF])));
+	store16(batch->pc, next);
+	return;
+
+skip_next:
+	store16(batch->pc, add16(next, and16(mask16(and8(m, skip)), dup16(2))));
+}
+
+/* BATCH */
+
+void chip8_batch_init(CHIP8_BATCH* batch, uint32_t quirks) {
+	CHIP8 chip8; // per call, so threads can initialize their own batches at once
+
+	chip8_init_cpu(&chip8);
+	chip8_set_quirks(&chip8, quirks);
+	chip8_reset_cpu(&chip8);
+
+	batch->quirks = quirks;
+	for (uint32_t lane = 0; lane < CHIP8_BATCH_LANES; ++lane) {
+		chip8_batch_set_lane(batch, lane, &chip8);
+	}
+}
+void chip8_batch_load_program(CHIP8_BATCH* batch, uint32_t lane, const uint8_t* program, uint16_t size) {
+	if (size > CHIP8_MEMORY_BYTES - CHIP8_PROGRAM_ADDR) {
+		size = CHIP8_MEMORY_BYTES - CHIP8_PROGRAM_ADDR;
+	}
+	for (int i = 0; i < size; ++i) {
+		batch->ram[lane][CHIP8_PROGRAM_ADDR + i] = program[i];
+	}
+	batch->pc[lane] = CHIP8_PROGRAM_ADDR;
+	batch->cpu_state[lane] = CHIP8_STATE_EXE;
+}
+void chip8_batch_seed_random(CHIP8_BATCH* batch, uint32_t lane, uint64_t seed) {
+	chip8_rng_seed(batch->rng[lane], seed);
+}
+void chip8_batch_get_lane(const CHIP8_BATCH* batch, uint32_t lane, CHIP8* chip8) {
+	chip8->i = batch->i[lane];
+	chip8->pc = batch->pc[lane];
+	chip8->sp = batch->sp[lane];
+	chip8->opcode = batch->opcode[lane];
+	chip8->keypad = batch->keypad[lane];
+	chip8->fxoa_state = batch->fxoa_state[lane];
+	chip8->delay_timer = batch->delay_timer[lane];
+	chip8->sound_timer = batch->sound_timer[lane];
+	chip8->draw_display = batch->draw_display[lane];
+	chip8->cpu_state = batch->cpu_state[lane];
+	chip8->dirty_rows = batch->dirty_rows[lane];
+	chip8->platform = CHIP8_PLATFORM_CHIP8;
+	chip8_set_quirks(chip8, batch->quirks);
+	chip8->hires = 0;
+	chip8->planes = 1;
+	for (int n = 0; n < 4; ++n) {
+		chip8->rng[n] = batch->rng[lane][n];
+	}
+	chip8->frame_debt = 0;
+	for (int r = 0; r < CHIP8_REGISTER_COUNT; ++r) {
+		chip8->v[r] = batch->v[r][lane];
+	}
+	for (int s = 0; s < CHIP8_STACK_SIZE; ++s) {
+		chip8->stack[s] = batch->stack[s][lane];
+	}
+	for (int a = 0; a < CHIP8_MEMORY_BYTES; ++a) {
+		chip8->ram[a] = batch->ram[lane][a];
+	}
+	for (int y = 0; y < CHIP8_DISPLAY_WORDS; ++y) {
+		chip8->display[y] = (y < CHIP8_DISPLAY_HEIGHT) ? batch->display[lane][y] : 0;
+	}
+	chip8_invalidate_memory(chip8, 0, CHIP8_MEMORY_BYTES);
+}
+void chip8_batch_set_lane(CHIP8_BATCH* batch, uint32_t lane, const CHIP8* chip8) {
+	batch->i[lane] = chip8->i;
+	batch->pc[lane] = chip8->pc;
+	batch->sp[lane] = chip8->sp;
+	batch->opcode[lane] = chip8->opcode;
+	batch->keypad[lane] = chip8->keypad;
+	batch->fxoa_state[lane] = chip8->fxoa_state;
+	batch->delay_timer[lane] = chip8->delay_timer;
+	batch->sound_timer[lane] = chip8->sound_timer;
+	batch->draw_display[lane] = chip8->draw_display;
+	batch->cpu_state[lane] = chip8->cpu_state;
+	batch->dirty_rows[lane] = chip8->dirty_rows;
+	for (int n = 0; n < 4; ++n) {
+		batch->rng[lane][n] = chip8->rng[n];
+	}
+	for (int r = 0; r < CHIP8_REGISTER_COUNT; ++r) {
+		batch->v[r][lane] = chip8->v[r];
+	}
+	for (int s = 0; s < CHIP8_STACK_SIZE; ++s) {
+		batch->stack[s][lane] = chip8->stack[s];
+	}
+	for (int a = 0; a < CHIP8_MEMORY_BYTES; ++a) {
+		batch->ram[lane][a] = chip8->ram[a];
+	}
+	for (int y = 0; y < CHIP8_DISPLAY_HEIGHT; ++y) {
+		batch->display[lane][y] = chip8->display[y];
+	}
+}
+void chip8_batch_step_timers(CHIP8_BATCH* batch) {
+	LANES8 dt = load8(batch->delay_timer);
+	LANES8 st = load8(batch->sound_timer);
+	LANES8 zero = dup8(0);
+	LANES8 one = dup8(1);
+
+	store8(batch->delay_timer, sub8(dt, and8(not8(eq8(dt, zero)), one)));
+	store8(batch->sound_timer, sub8(st, and8(not8(eq8(st, zero)), one)));
+}
+static int chip8_batch_converged(CHIP8_BATCH* batch, uint8_t* lane_mask) {
+	/* Converged step; every lane running at the same pc on the same
+	 * opcode. Checks the opcode bytes of each lane against lane 0 without
+	 * decoding them, then executes once on all lanes. Returns 0 without
+	 * executing anything if the lanes differ. */
+
+	const uint16_t pc = batch->pc[0];
+	const uint16_t address = pc & (CHIP8_MEMORY_BYTES - 1);
+	uint16_t first, word, diff = 0;
+	uint16_t opcode;
+
+	store8(lane_mask, eq8(load8(batch->cpu_state), dup8(CHIP8_STATE_EXE)));
+	if (!chip8_batch_all(lane_mask) || !chip8_batch_same16(batch->pc) || address == CHIP8_MEMORY_BYTES - 1) {
+		return 0;
+	}
+
+	memcpy(&first, &batch->ram[0][address], 2);
+	for (uint32_t lane = 1; lane < CHIP8_BATCH_LANES; ++lane) {
+		memcpy(&word, &batch->ram[lane][address], 2);
+		diff |= word ^ first;
+	}
+	if (diff != 0) {
+		return 0;
+	}
+
+	opcode = (uint16_t)((batch->ram[0][address] << 8) | batch->ram[0][address + 1]);
+	store16(batch->opcode, dup16(opcode));
+	if ((opcode & 0xF000) == 0x1000 && NNN == pc) {
+		// jump to self; halts after this step
+		store8(batch->cpu_state, dup8(CHIP8_STATE_HLT));
+	}
+	chip8_batch_execute(batch, opcode, lane_mask);
+	return 1;
+}
+
+void chip8_batch_run(CHIP8_BATCH* batch, uint32_t steps) {
+	CHIP8_BATCH_ALIGN uint16_t opcodes[CHIP8_BATCH_LANES];
+	CHIP8_BATCH_ALIGN uint8_t hi[CHIP8_BATCH_LANES];
+	CHIP8_BATCH_ALIGN uint8_t lo[CHIP8_BATCH_LANES];
+	CHIP8_BATCH_ALIGN uint8_t jump_self[CHIP8_BATCH_LANES];
+	CHIP8_BATCH_ALIGN uint8_t pending[CHIP8_BATCH_LANES];
+	CHIP8_BATCH_ALIGN uint8_t lane_mask[CHIP8_BATCH_LANES];
+
+	for (uint32_t step = 0; step < steps; ++step) {
+		LANES8 state, run, m;
+
+		if (chip8_batch_converged(batch, lane_mask)) {
+			continue;
+		}
+
+		state = load8(batch->cpu_state);
+		run = eq8(state, dup8(CHIP8_STATE_EXE));
+
+		/* Diverged step; fetch lane by lane. Opcodes are compared a byte
+		 * at a time, 16-bit vector compares are scalarised on SSE2 */
+		for (uint32_t lane = 0; lane < CHIP8_BATCH_LANES; ++lane) {
+			uint16_t pc = batch->pc[lane];
+			uint16_t opcode;
+			hi[lane] = LANE_READ_BYTE(lane, pc);
+			lo[lane] = LANE_READ_BYTE(lane, pc + 1);
+			opcode = (uint16_t)((hi[lane] << 8) | lo[lane]);
+			opcodes[lane] = opcode;
+			jump_self[lane] = ((opcode & 0xF000) == 0x1000 && NNN == pc) ? 0xFF : 0x00;
+		}
+		store16(batch->opcode, sel16(mask16(run), load16(opcodes), load16(batch->opcode)));
+
+		// jump to self; halts after this step
+		store8(batch->cpu_state, sel8(and8(run, load8(jump_self)), dup8(CHIP8_STATE_HLT), state));
+
+		store8(lane_mask, eq8(state, dup8(CHIP8_STATE_KEY_WAIT)));
+		if (chip8_batch_any(lane_mask)) {
+			FOR_EACH_LANE(lane_mask) {
+				if (chip8_batch_lane_key_wait(batch, lane, opcodes[lane])) {
+					// completing the wait counts as executing the FX0A
+					batch->cpu_state[lane] = CHIP8_STATE_EXE;
+				}
+			}
+		}
+
+		/* The lowest pending lane leads; every pending lane on its opcode
+		 * executes with it under one mask */
+		store8(pending, run);
+		while (chip8_batch_any(pending)) {
+			uint32_t lead = 0;
+			while (pending[lead] == 0) {
+				lead += 1;
+			}
+			m = and8(eq8(load8(hi), dup8(hi[lead])), eq8(load8(lo), dup8(lo[lead])));
+			m = and8(m, load8(pending));
+			store8(lane_mask, m);
+			store8(pending, and8(load8(pending), not8(m)));
+			chip8_batch_execute(batch, opcodes[lead], lane_mask);
+		}
+	}
+}
@@ -0,0 +1,77 @@
+// chip8_batch.h
+//
+// GitHub: https:\\github.com\tommojphillips
+
+#ifndef CHIP8_BATCH_H
+#define CHIP8_BATCH_H
+
+#include <stdint.h>
+
+#include "chip8_defines.h"
+#include "chip8.h"
+
+/* Lanes per batch; 8, 16 or 32 */
+#ifndef CHIP8_BATCH_LANES
+#define CHIP8_BATCH_LANES 16
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define CHIP8_BATCH_ALIGN __declspec(align(64))
+#else
+#define CHIP8_BATCH_ALIGN __attribute__((aligned(64)))
+#endif
+
+/* Chip8 batch; CHIP8_BATCH_LANES instances stored as struct-of-arrays.
+ * Register arrays are indexed [register][lane] so one register of every
+ * lane is contiguous. All lanes share the same quirks. Lanes run
+ * CHIP8_PLATFORM_CHIP8; SCHIP opcodes are invalid in a lane. */
+typedef struct {
+	CHIP8_BATCH_ALIGN uint8_t v[CHIP8_REGISTER_COUNT][CHIP8_BATCH_LANES];
+	CHIP8_BATCH_ALIGN uint16_t i[CHIP8_BATCH_LANES];
+	CHIP8_BATCH_ALIGN uint16_t pc[CHIP8_BATCH_LANES];
+	CHIP8_BATCH_ALIGN uint16_t sp[CHIP8_BATCH_LANES];
+	CHIP8_BATCH_ALIGN uint16_t keypad[CHIP8_BATCH_LANES];
+	CHIP8_BATCH_ALIGN uint16_t fxoa_state[CHIP8_BATCH_LANES];
+	CHIP8_BATCH_ALIGN uint16_t opcode[CHIP8_BATCH_LANES];
+	CHIP8_BATCH_ALIGN uint8_t delay_timer[CHIP8_BATCH_LANES];
+	CHIP8_BATCH_ALIGN uint8_t sound_timer[CHIP8_BATCH_LANES];
+	CHIP8_BATCH_ALIGN uint8_t draw_display[CHIP8_BATCH_LANES];
+	CHIP8_BATCH_ALIGN uint8_t cpu_state[CHIP8_BATCH_LANES];
+	CHIP8_BATCH_ALIGN uint16_t stack[CHIP8_STACK_SIZE][CHIP8_BATCH_LANES];
+	CHIP8_BATCH_ALIGN uint64_t dirty_rows[CHIP8_BATCH_LANES];
+	CHIP8_BATCH_ALIGN uint32_t rng[CHIP8_BATCH_LANES][4]; // per lane; only CXNN uses it
+	CHIP8_BATCH_ALIGN uint8_t ram[CHIP8_BATCH_LANES][CHIP8_MEMORY_BYTES + 64]; // padded so lanes do not share cache sets
+	CHIP8_BATCH_ALIGN uint64_t display[CHIP8_BATCH_LANES][CHIP8_DISPLAY_HEIGHT];
+	uint32_t quirks;
+} CHIP8_BATCH;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Initialize every lane as chip8_init_cpu would, with the given quirks
+void chip8_batch_init(CHIP8_BATCH* batch, uint32_t quirks);
+
+// Load program into a lane's memory space at CHIP8_PROGRAM_ADDR and reset the lane
+void chip8_batch_load_program(CHIP8_BATCH* batch, uint32_t lane, const uint8_t* program, uint16_t size);
+
+// Seed a lane's random generator; see chip8_seed_random
+void chip8_batch_seed_random(CHIP8_BATCH* batch, uint32_t lane, uint64_t seed);
+
+// Copy a lane out into a CHIP8
+void chip8_batch_get_lane(const CHIP8_BATCH* batch, uint32_t lane, CHIP8* chip8);
+
+// Copy a CHIP8 into a lane; the batch keeps its own quirks. Only the lores display is copied
+void chip8_batch_set_lane(CHIP8_BATCH* batch, uint32_t lane, const CHIP8* chip8);
+
+// Step timers of every lane
+void chip8_batch_step_timers(CHIP8_BATCH* batch);
+
+// Execute steps instructions in every lane; the same as calling chip8_execute steps times per lane.
+// Halted lanes and lanes in an opcode error state are skipped; lanes waiting in FX0A only scan their keypad.
+void chip8_batch_run(CHIP8_BATCH* batch, uint32_t steps);
+
+#ifdef __cplusplus
+};
+#endif
+#endif
@@ -0,0 +1,433 @@
+// chip8_cfg.c
+//
+// GitHub: https:\\github.com\tommojphillips
+
+#include <stdint.h>
+#include <string.h>
+
+#include "chip8_defines.h"
+#include "chip8.h"
+#include "chip8_cfg.h"
+
+#define X ((opcode >> 8) & 0x0F)
+#define N (opcode & 0x000F)
+#define NNN (opcode & 0x0FFF)
+
+/* Program being analysed */
+typedef struct {
+	const uint8_t* program;
+	uint32_t end;				// first address past the program
+	CHIP8_PLATFORM platform;
+} CFG_PROGRAM;
+
+static int chip8_cfg_in_program(const CFG_PROGRAM* p, uint32_t address) {
+	return address >= CHIP8_PROGRAM_ADDR && address + 1 < p->end;
+}
+static uint16_t chip8_cfg_opcode(const CFG_PROGRAM* p, uint32_t address) {
+	return (uint16_t)((p->program[address - CHIP8_PROGRAM_ADDR] << 8) | p->program[address - CHIP8_PROGRAM_ADDR + 1]);
+}
+static CHIP8_OP chip8_cfg_op(const CFG_PROGRAM* p, uint32_t address) {
+	/* Decode the instruction at address as the platform runs it */
+
+	CHIP8_OP op;
+
+	if (!chip8_cfg_in_program(p, address)) {
+		return CHIP8_OP_INVALID;
+	}
+
+	op = chip8_decode_op(chip8_cfg_opcode(p, address));
+	if (op >= CHIP8_OP_00DN && p->platform != CHIP8_PLATFORM_XOCHIP) {
+		// 5XYN is 5XY0 elsewhere
+		return (op == CHIP8_OP_5XY2 || op == CHIP8_OP_5XY3) ? CHIP8_OP_5XY0 : CHIP8_OP_INVALID;
+	}
+	if (op >= CHIP8_OP_00CN && p->platform == CHIP8_PLATFORM_CHIP8) {
+		return CHIP8_OP_INVALID;
+	}
+	if (op == CHIP8_OP_F000 && !chip8_cfg_in_program(p, address + 2)) {
+		// no room for NNNN
+		return CHIP8_OP_INVALID;
+	}
+	return op;
+}
+static uint32_t chip8_cfg_size(CHIP8_OP op) {
+	return (op == CHIP8_OP_F000) ? 4 : 2;
+}
+static int chip8_cfg_is_skip(CHIP8_OP op) {
+	switch (op) {
+		case CHIP8_OP_3XNN:
+		case CHIP8_OP_4XNN:
+		case CHIP8_OP_5XY0:
+		case CHIP8_OP_9XY0:
+		case CHIP8_OP_EX9E:
+		case CHIP8_OP_EXA1:
+			return 1;
+		default:
+			return 0;
+	}
+}
+static uint32_t chip8_cfg_skip_target(const CFG_PROGRAM* p, uint32_t address) {
+	/* Address a skip at address lands on; XO-CHIP skips over F000 NNNN */
+
+	if (p->platform == CHIP8_PLATFORM_XOCHIP && chip8_cfg_in_program(p, address + 2) && chip8_cfg_opcode(p, address + 2) == 0xF000) {
+		return address + 6;
+	}
+	return address + 4;
+}
+
+/* DISCOVERY */
+
+static void chip8_cfg_add_leader(CHIP8_CFG* cfg, uint16_t* count, uint32_t address) {
+	if (address >= CHIP8_MEMORY_BYTES || (cfg->map[address] & CHIP8_CFG_LEADER)) {
+		return;
+	}
+	cfg->map[address] |= CHIP8_CFG_LEADER;
+	cfg->work[(*count)++] = (uint16_t)address;
+}
+static void chip8_cfg_discover(CHIP8_CFG* cfg, const CFG_PROGRAM* p) {
+	/* Walk every path from CHIP8_PROGRAM_ADDR, marking code and block leaders */
+
+	uint16_t count = 0;
+	uint32_t pc;
+	uint32_t size;
+	uint16_t opcode;
+	CHIP8_OP op;
+
+	chip8_cfg_add_leader(cfg, &count, CHIP8_PROGRAM_ADDR);
+
+	while (count > 0) {
+		pc = cfg->work[--count];
+
+		for (;;) {
+			op = chip8_cfg_op(p, pc);
+			if (op == CHIP8_OP_INVALID) {
+				break;
+			}
+
+			opcode = chip8_cfg_opcode(p, pc);
+			size = chip8_cfg_size(op);
+			cfg->map[pc] |= CHIP8_CFG_INSTRUCTION;
+			for (uint32_t i = 0; i < size; ++i) {
+				cfg->map[pc + i] |= CHIP8_CFG_CODE;
+			}
+
+			if (chip8_cfg_is_skip(op)) {
+				chip8_cfg_add_leader(cfg, &count, pc + 2);
+				chip8_cfg_add_leader(cfg, &count, chip8_cfg_skip_target(p, pc));
+				break;
+			}
+			if (op == CHIP8_OP_1NNN) {
+				chip8_cfg_add_leader(cfg, &count, NNN);
+				break;
+			}
+			if (op == CHIP8_OP_2NNN) {
+				cfg->map[NNN] |= CHIP8_CFG_SUBROUTINE;
+				chip8_cfg_add_leader(cfg, &count, NNN);
+				chip8_cfg_add_leader(cfg, &count, pc + 2); // return site
+				break;
+			}
+			if (op == CHIP8_OP_00EE || op == CHIP8_OP_BNNN || op == CHIP8_OP_00FD) {
+				break;
+			}
+
+			pc += size;
+			if (pc < CHIP8_MEMORY_BYTES && (cfg->map[pc] & (CHIP8_CFG_INSTRUCTION | CHIP8_CFG_LEADER))) {
+				// the rest was walked already or is queued; blocks end only at real leaders
+				break;
+			}
+		}
+	}
+}
+
+/* BLOCKS */
+
+static void chip8_cfg_mark(CHIP8_CFG* cfg, uint32_t address, uint32_t size, uint8_t flag) {
+	for (uint32_t i = 0; i < size && address + i < CHIP8_MEMORY_BYTES; ++i) {
+		cfg->map[address + i] |= flag;
+	}
+}
+static void chip8_cfg_block(CHIP8_CFG* cfg, const CFG_PROGRAM* p, uint16_t start) {
+	/* Build the block at leader start, marking the sprites and data it references */
+
+	CHIP8_CFG_BLOCK* block = &cfg->blocks[cfg->block_count];
+	uint32_t pc = start;
+	uint32_t size;
+	uint32_t i_value = 0;
+	int i_known = 0;
+	uint16_t opcode;
+	CHIP8_OP op;
+
+	block->start = start;
+	block->target = CHIP8_CFG_NONE;
+	block->next = CHIP8_CFG_NONE;
+	block->instructions = 0;
+	block->exit = CHIP8_CFG_EXIT_INVALID;
+
+	for (;;) {
+		op = chip8_cfg_op(p, pc);
+		if (op == CHIP8_OP_INVALID) {
+			break;
+		}
+
+		opcode = chip8_cfg_opcode(p, pc);
+		size = chip8_cfg_size(op);
+		block->last = (uint16_t)pc;
+		block->instructions += 1;
+		for (uint32_t i = 0; i < size; ++i) {
+			cfg->block_of[pc + i] = cfg->block_count;
+		}
+
+		switch (op) {
+			case CHIP8_OP_ANNN:
+				i_value = NNN;
+				i_known = 1;
+				break;
+			case CHIP8_OP_F000:
+				i_value = chip8_cfg_opcode(p, pc + 2);
+				i_known = 1;
+				break;
+			case CHIP8_OP_DXYN:
+				if (i_known) {
+					chip8_cfg_mark(cfg, i_value, (N == 0 && p->platform != CHIP8_PLATFORM_CHIP8) ? 32 : N, CHIP8_CFG_SPRITE);
+				}
+				break;
+			case CHIP8_OP_FX33:
+				if (i_known) {
+					chip8_cfg_mark(cfg, i_value, 3, CHIP8_CFG_DATA);
+				}
+				break;
+			case CHIP8_OP_FX55:
+			case CHIP8_OP_FX65:
+				if (i_known) {
+					chip8_cfg_mark(cfg, i_value, X + 1, CHIP8_CFG_DATA);
+				}
+				i_known = 0; // I may move, depending on the quirks
+				break;
+			case CHIP8_OP_FX1E:
+			case CHIP8_OP_FX29:
+			case CHIP8_OP_FX30:
+				i_known = 0;
+				break;
+			default:
+				break;
+		}
+
+		if (chip8_cfg_is_skip(op)) {
+			block->exit = CHIP8_CFG_EXIT_SKIP;
+			block->next = (uint16_t)(pc + 2);
+			block->target = (uint16_t)chip8_cfg_skip_target(p, pc);
+			pc += size;
+			break;
+		}
+		if (op == CHIP8_OP_1NNN || op == CHIP8_OP_2NNN || op == CHIP8_OP_BNNN) {
+			block->exit = (op == CHIP8_OP_1NNN) ? CHIP8_CFG_EXIT_JUMP : (op == CHIP8_OP_2NNN) ? CHIP8_CFG_EXIT_CALL : CHIP8_CFG_EXIT_INDIRECT;
+			block->target = NNN;
+			if (op == CHIP8_OP_2NNN) {
+				block->next = (uint16_t)(pc + 2);
+			}
+			pc += size;
+			break;
+		}
+		if (op == CHIP8_OP_00EE || op == CHIP8_OP_00FD) {
+			block->exit = (op == CHIP8_OP_00EE) ? CHIP8_CFG_EXIT_RETURN : CHIP8_CFG_EXIT_HALT;
+			pc += size;
+			break;
+		}
+
+		pc += size;
+		if (pc < CHIP8_MEMORY_BYTES && (cfg->map[pc] & CHIP8_CFG_LEADER)) {
+			block->exit = CHIP8_CFG_EXIT_FALL;
+			block->next = (uint16_t)pc;
+			break;
+		}
+	}
+
+	block->end = (uint16_t)pc;
+	cfg->block_count += 1;
+}
+
+/* EDGES */
+
+uint16_t chip8_cfg_block_at(const CHIP8_CFG* cfg, uint16_t address) {
+	/* A block owns the byte it starts at; blocks starting later never cover it */
+
+	uint16_t block;
+
+	if (address >= CHIP8_MEMORY_BYTES) {
+		return CHIP8_CFG_NONE;
+	}
+	block = cfg->block_of[address];
+	if (block == CHIP8_CFG_NONE || cfg->blocks[block].start != address) {
+		return CHIP8_CFG_NONE;
+	}
+	return block;
+}
+static void chip8_cfg_add_edge(CHIP8_CFG* cfg, uint16_t from, uint16_t to, CHIP8_CFG_EDGE_KIND kind, int write) {
+	/* Count an edge from block from, or write it if write is set */
+
+	CHIP8_CFG_EDGE* edge;
+
+	if (to == CHIP8_CFG_NONE) {
+		return;
+	}
+	if (!write) {
+		cfg->blocks[from].edge_count += 1;
+		return;
+	}
+	edge = &cfg->edges[cfg->blocks[from].edge + cfg->fill[from]++];
+	edge->block = to;
+	edge->kind = (uint8_t)kind;
+}
+static void chip8_cfg_static_edges(CHIP8_CFG* cfg, uint16_t b, int write) {
+	const CHIP8_CFG_BLOCK* block = &cfg->blocks[b];
+
+	switch (block->exit) {
+		case CHIP8_CFG_EXIT_FALL:
+			chip8_cfg_add_edge(cfg, b, chip8_cfg_block_at(cfg, block->next), CHIP8_CFG_EDGE_FALL, write);
+			break;
+		case CHIP8_CFG_EXIT_JUMP:
+			chip8_cfg_add_edge(cfg, b, chip8_cfg_block_at(cfg, block->target), CHIP8_CFG_EDGE_JUMP, write);
+			break;
+		case CHIP8_CFG_EXIT_CALL:
+			chip8_cfg_add_edge(cfg, b, chip8_cfg_block_at(cfg, block->target), CHIP8_CFG_EDGE_CALL, write);
+			break;
+		case CHIP8_CFG_EXIT_SKIP:
+			chip8_cfg_add_edge(cfg, b, chip8_cfg_block_at(cfg, block->next), CHIP8_CFG_EDGE_FALL, write);
+			chip8_cfg_add_edge(cfg, b, chip8_cfg_block_at(cfg, block->target), CHIP8_CFG_EDGE_SKIP, write);
+			break;
+		default:
+			break;
+	}
+}
+static void chip8_cfg_return_edges(CHIP8_CFG* cfg, uint16_t entry, uint16_t* calls, uint16_t call_count, uint16_t stamp, int write) {
+	/* Search the subroutine at block entry for the 00EE blocks it reaches, stepping over the calls it makes,
+	 * and count or write a return edge from each to the return site of every call to entry */
+
+	uint16_t* stack = cfg->work;
+	uint16_t depth = 0;
+	uint16_t b;
+	uint16_t next[2];
+	const CHIP8_CFG_BLOCK* block;
+
+	cfg->mark[entry] = stamp;
+	stack[depth++] = entry;
+
+	while (depth > 0) {
+		b = stack[--depth];
+		block = &cfg->blocks[b];
+		next[0] = CHIP8_CFG_NONE;
+		next[1] = CHIP8_CFG_NONE;
+
+		switch (block->exit) {
+			case CHIP8_CFG_EXIT_FALL:
+			case CHIP8_CFG_EXIT_CALL:
+				next[0] = chip8_cfg_block_at(cfg, block->next);
+				break;
+			case CHIP8_CFG_EXIT_JUMP:
+				next[0] = chip8_cfg_block_at(cfg, block->target);
+				break;
+			case CHIP8_CFG_EXIT_SKIP:
+				next[0] = chip8_cfg_block_at(cfg, block->next);
+				next[1] = chip8_cfg_block_at(cfg, block->target);
+				break;
+			case CHIP8_CFG_EXIT_RETURN:
+				for (uint16_t c = 0; c < call_count; ++c) {
+					if (cfg->blocks[calls[c]].target == cfg->blocks[entry].start) {
+						chip8_cfg_add_edge(cfg, b, chip8_cfg_block_at(cfg, cfg->blocks[calls[c]].next), CHIP8_CFG_EDGE_RETURN, write);
+					}
+				}
+				break;
+			default:
+				break;
+		}
+
+		for (int k = 0; k < 2; ++k) {
+			if (next[k] != CHIP8_CFG_NONE && cfg->mark[next[k]] != stamp) {
+				cfg->mark[next[k]] = stamp;
+				stack[depth++] = next[k];
+			}
+		}
+	}
+}
+static void chip8_cfg_edges(CHIP8_CFG* cfg, int returns, int write) {
+	/* Count or write every block's edges; static successors first, then return edges */
+
+	uint16_t* calls = &cfg->work[CHIP8_CFG_MAX_BLOCKS];
+	uint16_t call_count = 0;
+	uint16_t stamp = 0;
+	uint16_t b;
+
+	for (b = 0; b < cfg->block_count; ++b) {
+		chip8_cfg_static_edges(cfg, b, write);
+		if (cfg->blocks[b].exit == CHIP8_CFG_EXIT_CALL) {
+			calls[call_count++] = b;
+		}
+	}
+	if (!returns) {
+		return;
+	}
+
+	memset(cfg->mark, 0, sizeof(cfg->mark));
+	for (b = 0; b < cfg->block_count; ++b) {
+		if (cfg->map[cfg->blocks[b].start] & CHIP8_CFG_SUBROUTINE) {
+			chip8_cfg_return_edges(cfg, b, calls, call_count, ++stamp, write);
+		}
+	}
+}
+
+int chip8_cfg_build(CHIP8_CFG* cfg, const uint8_t* program, uint32_t size, CHIP8_PLATFORM platform) {
+
+	CFG_PROGRAM p;
+	uint32_t total = 0;
+	int returns = 1;
+	uint16_t b;
+
+	if (size > CHIP8_MEMORY_BYTES - CHIP8_PROGRAM_ADDR) {
+		size = CHIP8_MEMORY_BYTES - CHIP8_PROGRAM_ADDR;
+	}
+	p.program = program;
+	p.end = CHIP8_PROGRAM_ADDR + size;
+	p.platform = platform;
+
+	cfg->block_count = 0;
+	cfg->edge_count = 0;
+	cfg->truncated = 0;
+	memset(cfg->map, 0, sizeof(cfg->map));
+	memset(cfg->block_of, 0xFF, sizeof(cfg->block_of));
+
+	chip8_cfg_discover(cfg, &p);
+
+	for (uint32_t a = CHIP8_PROGRAM_ADDR; a < p.end; ++a) {
+		if ((cfg->map[a] & (CHIP8_CFG_LEADER | CHIP8_CFG_INSTRUCTION)) == (CHIP8_CFG_LEADER | CHIP8_CFG_INSTRUCTION)) {
+			chip8_cfg_block(cfg, &p, (uint16_t)a);
+		}
+	}
+
+	// count, lay out and fill the edges
+	for (b = 0; b < cfg->block_count; ++b) {
+		cfg->blocks[b].edge_count = 0;
+	}
+	chip8_cfg_edges(cfg, returns, 0);
+	for (b = 0; b < cfg->block_count; ++b) {
+		total += cfg->blocks[b].edge_count;
+	}
+	if (total > CHIP8_CFG_MAX_EDGES) {
+		// at most two static edges a block always fit
+		returns = 0;
+		cfg->truncated = 1;
+		for (b = 0; b < cfg->block_count; ++b) {
+			cfg->blocks[b].edge_count = 0;
+		}
+		chip8_cfg_edges(cfg, returns, 0);
+	}
+
+	total = 0;
+	for (b = 0; b < cfg->block_count; ++b) {
+		cfg->blocks[b].edge = (uint16_t)total;
+		cfg->fill[b] = 0;
+		total += cfg->blocks[b].edge_count;
+	}
+	cfg->edge_count = (uint16_t)total;
+	chip8_cfg_edges(cfg, returns, 1);
+
+	return cfg->truncated;
+}
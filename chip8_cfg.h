@@ -0,0 +1,107 @@
+// chip8_cfg.h
+//
+// GitHub: https:\\github.com\tommojphillips
+
+#ifndef CHIP8_CFG_H
+#define CHIP8_CFG_H
+
+#include <stdint.h>
+
+#include "chip8_defines.h"
+#include "chip8.h"
+
+/* Blocks may start at any program address; misaligned code overlaps aligned code */
+#define CHIP8_CFG_MAX_BLOCKS	(CHIP8_MEMORY_BYTES - CHIP8_PROGRAM_ADDR)
+#define CHIP8_CFG_MAX_EDGES		(2 * CHIP8_CFG_MAX_BLOCKS + 4096)
+#define CHIP8_CFG_NONE			0xFFFF
+
+/* Address flags; cfg->map */
+#define CHIP8_CFG_CODE			0x01	// byte of a reachable instruction
+#define CHIP8_CFG_INSTRUCTION	0x02	// a reachable instruction starts here
+#define CHIP8_CFG_LEADER		0x04	// a basic block starts here
+#define CHIP8_CFG_SUBROUTINE	0x08	// 2NNN target
+#define CHIP8_CFG_SPRITE		0x10	// drawn by DXYN
+#define CHIP8_CFG_DATA			0x20	// read or written by FX33, FX55 or FX65
+
+/* How a basic block ends */
+typedef enum {
+	CHIP8_CFG_EXIT_FALL = 0,	// runs into the block at next
+	CHIP8_CFG_EXIT_JUMP,		// 1NNN to target
+	CHIP8_CFG_EXIT_CALL,		// 2NNN to target, returning to next
+	CHIP8_CFG_EXIT_RETURN,		// 00EE
+	CHIP8_CFG_EXIT_SKIP,		// skip; next if not taken, target if taken
+	CHIP8_CFG_EXIT_INDIRECT,	// BNNN; target is NNN, the jump depends on a register
+	CHIP8_CFG_EXIT_HALT,		// 00FD
+	CHIP8_CFG_EXIT_INVALID,		// runs into an opcode the platform does not have, or off the end of the program
+} CHIP8_CFG_EXIT;
+
+/* Edge kinds */
+typedef enum {
+	CHIP8_CFG_EDGE_FALL = 0,	// fall through, or a skip not taken
+	CHIP8_CFG_EDGE_JUMP,
+	CHIP8_CFG_EDGE_SKIP,		// a skip taken
+	CHIP8_CFG_EDGE_CALL,
+	CHIP8_CFG_EDGE_RETURN,		// 00EE to the return site of a call that reaches it
+} CHIP8_CFG_EDGE_KIND;
+
+typedef struct {
+	uint16_t start;
+	uint16_t end;			// first address past the last instruction
+	uint16_t last;			// address of the last instruction
+	uint16_t target;		// jump, call, BNNN or taken skip address; CHIP8_CFG_NONE if none
+	uint16_t next;			// fall through, return site or untaken skip address; CHIP8_CFG_NONE if none
+	uint16_t edge;			// first successor in cfg->edges
+	uint16_t edge_count;
+	uint16_t instructions;
+	uint8_t exit;			// CHIP8_CFG_EXIT
+} CHIP8_CFG_BLOCK;
+
+typedef struct {
+	uint16_t block;			// successor
+	uint8_t kind;			// CHIP8_CFG_EDGE_KIND
+} CHIP8_CFG_EDGE;
+
+/* Chip8 control flow graph of a program.
+ *
+ * Code is found by walking from CHIP8_PROGRAM_ADDR through jumps, calls,
+ * return sites and both sides of skips; BNNN targets are not followed.
+ * Blocks are ordered by start address, and each block's successors are
+ * contiguous in edges. 00EE blocks have a return edge to the return site of
+ * every call whose subroutine reaches them without going through another
+ * call.
+ *
+ * Sprites and data are the bytes I points at for DXYN, FX33, FX55 and
+ * FX65 when ANNN (or F000 NNNN) set I earlier in the same block; DXY0 counts
+ * 32 bytes outside CHIP8_PLATFORM_CHIP8 and XO-CHIP planes are not tracked.
+ *
+ * Only the first CHIP8_MEMORY_BYTES are analysed, so XO-CHIP code past them
+ * is not found. The struct is large; allocate it statically or on the heap. */
+typedef struct {
+	uint16_t block_count;
+	uint16_t edge_count;
+	uint8_t truncated;		// return edges did not fit in edges and were left out
+	uint8_t map[CHIP8_MEMORY_BYTES];			// CHIP8_CFG_* address flags
+	uint16_t block_of[CHIP8_MEMORY_BYTES];		// block of the instruction each code byte is in, the later where misaligned code overlaps; CHIP8_CFG_NONE if none
+	CHIP8_CFG_BLOCK blocks[CHIP8_CFG_MAX_BLOCKS];
+	CHIP8_CFG_EDGE edges[CHIP8_CFG_MAX_EDGES];
+
+	uint16_t work[2 * CHIP8_CFG_MAX_BLOCKS];	// scratch; worklist and search stack
+	uint16_t mark[CHIP8_CFG_MAX_BLOCKS];		// scratch; search visits
+	uint16_t fill[CHIP8_CFG_MAX_BLOCKS];		// scratch; edges written per block
+} CHIP8_CFG;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Build the control flow graph of size bytes of program loaded at CHIP8_PROGRAM_ADDR, decoding opcodes as platform runs them.
+// Returns 0 on success, 1 if the return edges did not fit (cfg->truncated)
+int chip8_cfg_build(CHIP8_CFG* cfg, const uint8_t* program, uint32_t size, CHIP8_PLATFORM platform);
+
+// Block starting at address; CHIP8_CFG_NONE if no block starts there
+uint16_t chip8_cfg_block_at(const CHIP8_CFG* cfg, uint16_t address);
+
+#ifdef __cplusplus
+};
+#endif
+#endif
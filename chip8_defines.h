@@ -5,19 +5,75 @@
 #ifndef CHIP8_DEFINES_H
 #define CHIP8_DEFINES_H
 
-/* Shrink video ram to 256 bytes from 2048 bytes
- Originally a pixel takes up 1 byte but only uses 1 bit of data,
- there is 8 bits in a byte, so if dynamic memory is tight you can
- enable this to save 1792 bytes! */
-//#define CHIP8_SHRINK_DISPLAY_RAM
-
 #define CHIP8_MNEMONICS
 
-#ifdef ARDUINO
-#ifndef CHIP8_SHRINK_DISPLAY_RAM
-#define CHIP8_SHRINK_DISPLAY_RAM
+/* Dispatch engine used by chip8_run.
+ Threaded dispatch looks up each opcode in a 4KB handler table and jumps
+ straight to the next handler using computed goto (GCC/Clang only).
+ Define CHIP8_DISPATCH_SWITCH to force the portable switch. */
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(CHIP8_DISPATCH_SWITCH)
+#define CHIP8_DISPATCH_THREADED
 #endif
+
+/* Predecode instructions into a 16KB per-instance cache so chip8_run skips
+ fetch and decode. Entries are decoded on first execution and invalidated
+ when ram is written. Requires CHIP8_DISPATCH_THREADED; an error without. */
+//#define CHIP8_PREDECODE
+
+/* Fuse common instruction pairs and triples into single handlers when
+ predecoding (6XNN+6XNN, ANNN+DXYN, 7XNN/FX07+3XNN+1NNN). Requires
+ CHIP8_PREDECODE. */
+//#define CHIP8_FUSION
+
+/* Build a chip8_run engine specialized for every combination of execution
+ quirks and select it in chip8_set_quirks, so no opcode tests quirks at
+ runtime. Costs roughly 64x the engine code size. */
+//#define CHIP8_QUIRK_ENGINES
+
+/* Count instructions executed in chip8->cycles */
+//#define CYCLE_COUNT
+
+/* Profile execution into chip8->profile: instructions per CHIP8_OP and per
+ address, and pixels toggled by DXYN. Counted in the opcode handlers with
+ no branches; jit compiled blocks and AOT translated code are not counted. */
+//#define CHIP8_PROFILER
+
+/* Track the 256 byte ram pages written since the last snapshot so
+ chip8_snapshot and chip8_restore copy only those pages. Costs an OR per
+ ram write; without it snapshots always copy all of ram. */
+//#define CHIP8_SNAPSHOT_PAGES
+
+/* CXNN calls the host chip8_random() instead of the per-instance generator.
+ Results then depend on the host and are shared between instances. */
+//#define CHIP8_RANDOM_HOOK
+
+/* Render the sound timer as square wave samples into the CHIP8_AUDIO ring
+ attached to chip8->audio (chip8_audio.c) instead of calling the host
+ chip8_beep() every tick. */
+//#define CHIP8_AUDIO_SYNTH
+
+/* Leave out SCHIP and XO-CHIP: chip8_set_platform accepts only
+ CHIP8_PLATFORM_CHIP8 and the display is the 256 byte 64x32 framebuffer
+ instead of the 1KB hires one. */
+//#define CHIP8_NO_SCHIP
+
+/* Basic block recompiler; chip8_jit.c. x86-64 Linux only */
+#if defined(__x86_64__) && defined(__linux__) && !defined(CHIP8_NO_JIT)
+#define CHIP8_JIT_X64
+#endif
+
+#ifdef ARDUINO
 #undef CHIP8_MNEMONICS
+#undef CHIP8_DISPATCH_THREADED
+#define CHIP8_NO_SCHIP
+#endif
+
+#if defined(CHIP8_PREDECODE) && !defined(CHIP8_DISPATCH_THREADED)
+#error "CHIP8_PREDECODE requires CHIP8_DISPATCH_THREADED (GCC/Clang without CHIP8_DISPATCH_SWITCH)"
+#endif
+
+#if defined(CHIP8_FUSION) && !defined(CHIP8_PREDECODE)
+#undef CHIP8_FUSION
 #endif
 
 #endif
@@ -0,0 +1,332 @@
+// chip8_engine.h
+//
+// GitHub: https:\\github.com\tommojphillips
+
+/* chip8_run engine body. Not a regular header; chip8.c includes this once
+ * per engine instance. Define CHIP8_ENGINE_QUIRKS to a constant quirk mask
+ * before including to instantiate an engine specialized for those quirks
+ * (chip8_run_quirks_<mask>). Without it, the engine reads chip8->quirks
+ * (chip8_run_engine). Define CHIP8_ENGINE_XO instead for the XO-CHIP
+ * engine, which runs out of the 64 KB in CHIP8_XO (chip8_run_engine_xo);
+ * every other engine runs out of ram. Define CHIP8_ENGINE_VIP for the
+ * COSMAC VIP timing engine (chip8_run_engine_vip), which takes a budget of
+ * VIP cycles instead of instructions and charges each instruction as it
+ * decodes it, so it always switches on the opcode in memory; predecoded
+ * and fused ops would skip that. It runs every platform. */
+
+#if defined(CHIP8_ENGINE_VIP)
+#define ENGINE_NAME chip8_run_engine_vip
+#define ENGINE_QUIRKS chip8->quirks
+#define ENGINE_XO (chip8->platform == CHIP8_PLATFORM_XOCHIP)
+#elif defined(CHIP8_ENGINE_XO)
+#define ENGINE_NAME chip8_run_engine_xo
+#define ENGINE_QUIRKS chip8->quirks
+#define ENGINE_XO 1
+#elif defined(CHIP8_ENGINE_QUIRKS)
+#define ENGINE_NAME CHIP8_ENGINE_CAT(chip8_run_quirks_, CHIP8_ENGINE_QUIRKS)
+#define ENGINE_QUIRKS CHIP8_ENGINE_QUIRKS
+#define ENGINE_XO 0
+#else
+#define ENGINE_NAME chip8_run_engine
+#define ENGINE_QUIRKS chip8->quirks
+#define ENGINE_XO 0
+#endif
+
+#ifndef CHIP8_ENGINE_VIP
+#ifdef CHIP8_DISPATCH_THREADED
+#define ENGINE_THREADED
+#endif
+#ifdef CHIP8_PREDECODE
+#define ENGINE_PREDECODE
+#endif
+#ifdef CHIP8_FUSION
+#define ENGINE_FUSION
+#endif
+#endif
+
+static CHIP8_RUN_EXIT ENGINE_NAME(CHIP8* chip8, uint32_t max_instructions, uint32_t* executed) {
+	/* Decode and execute up to max_instructions. The opcode is kept local
+	 * for the whole batch and only written back to the cpu struct on exit.
+	 * PC and I stay in the struct: the handlers are shared with
+	 * chip8_execute and work on CHIP8*, so a local copy would have to be
+	 * stored back before every handler. With one, GCC spills the copy to the
+	 * stack and runs no faster than reading the struct. */
+
+	const uint32_t quirks = ENGINE_QUIRKS;
+	const int xo = ENGINE_XO;
+	CHIP8_RUN_EXIT exit = CHIP8_RUN_EXIT_COMPLETE;
+	uint32_t count = 0;
+	uint16_t opcode = chip8->opcode;
+	uint16_t pc;
+
+#ifdef CHIP8_ENGINE_VIP
+	uint32_t spent = 0;	// VIP cycles charged; max_instructions is the budget
+	uint32_t cost = 0;	// VIP cycles of the last instruction
+	CHIP8_OP op;
+#endif
+
+#ifdef ENGINE_PREDECODE
+	CHIP8_DECODED* decoded;
+#endif
+
+#ifdef ENGINE_THREADED
+	static const void* const op_labels[] = {
+		&&op_NONE, &&op_INVALID,
+		&&op_00E0, &&op_00EE, &&op_1NNN, &&op_2NNN, &&op_3XNN, &&op_4XNN, &&op_5XY0, &&op_6XNN,
+		&&op_7XNN, &&op_8XY0, &&op_8XY1, &&op_8XY2, &&op_8XY3, &&op_8XY4, &&op_8XY5, &&op_8XY6,
+		&&op_8XY7, &&op_8XYE, &&op_9XY0, &&op_ANNN, &&op_BNNN, &&op_CXNN, &&op_DXYN, &&op_EX9E,
+		&&op_EXA1, &&op_FX07, &&op_FX0A, &&op_FX15, &&op_FX18, &&op_FX1E, &&op_FX29, &&op_FX33,
+		&&op_FX55, &&op_FX65,
+		&&op_00CN, &&op_00FB, &&op_00FC, &&op_00FD, &&op_00FE, &&op_00FF, &&op_FX30, &&op_FX75,
+		&&op_FX85,
+		&&op_00DN, &&op_5XY2, &&op_5XY3, &&op_F000, &&op_FN01, &&op_F002, &&op_FX3A,
+#ifdef ENGINE_FUSION
+		&&op_6XNN_6XNN, &&op_ANNN_DXYN, &&op_7XNN_3XNN_1NNN, &&op_FX07_3XNN_1NNN,
+#endif
+	};
+#endif
+
+	if (chip8->cpu_state == CHIP8_STATE_KEY_WAIT) {
+		// completing the wait counts as executing the FX0A
+		if (max_instructions == 0 || !chip8_key_wait_resume(chip8, xo)) {
+			exit = CHIP8_RUN_EXIT_KEY_WAIT;
+			goto done;
+		}
+		count = 1;
+#ifdef CHIP8_ENGINE_VIP
+		cost = chip8_vip_op_cost(chip8, opcode, CHIP8_OP_FX0A);
+		spent = cost;
+#endif
+	}
+
+	if (chip8->cpu_state != CHIP8_STATE_EXE) {
+		exit = (chip8->cpu_state == CHIP8_STATE_HLT) ? CHIP8_RUN_EXIT_HALT : CHIP8_RUN_EXIT_ERROR;
+		goto done;
+	}
+
+#ifdef ENGINE_THREADED
+	RUN_DISPATCH();
+	{
+#else
+	for (;;) {
+#ifdef CHIP8_ENGINE_VIP
+		if (spent >= max_instructions) goto done;
+		opcode = MEM_GET_OPCODE(xo, PC);
+		op = chip8_decode_op(opcode);
+		cost = chip8_vip_op_cost(chip8, opcode, op);
+		spent += cost;
+		count += 1;
+		switch (op) {
+#else
+		if (count == max_instructions) goto done;
+		opcode = MEM_GET_OPCODE(xo, PC);
+		count += 1;
+		switch (chip8_decode_op(opcode)) {
+#endif
+#endif
+		RUN_OP(NONE)
+#ifdef ENGINE_PREDECODE
+			// decode on first execution
+			opcode = MEM_GET_OPCODE(xo, PC);
+			decoded->opcode = opcode;
+			decoded->op = chip8_op_table[opcode >> 12][opcode & 0xFF];
+#ifdef ENGINE_FUSION
+			decoded->op = chip8_fuse(chip8, PC, decoded->op, xo);
+#endif
+			goto *op_labels[decoded->op];
+		fetch_far:
+			// past the predecoded range; XO-CHIP memory above 4 KB
+			opcode = MEM_GET_OPCODE(xo, PC);
+			count += 1;
+			goto *op_labels[chip8_op_table[opcode >> 12][opcode & 0xFF]];
+#endif
+#ifndef ENGINE_THREADED
+		default: // CHIP8_OP_COUNT; not an op
+#endif
+		RUN_OP(INVALID)
+			chip8->cpu_state = CHIP8_STATE_ERROR_OPCODE;
+			count -= 1;
+			exit = CHIP8_RUN_EXIT_ERROR;
+			goto done;
+
+		RUN_OP(00E0)
+			chip8_00E0(chip8, quirks);
+#ifndef CHIP8_ENGINE_VIP // the VIP only waits for vblank in DXYN
+			if (quirks & CHIP8_QUIRK_DISPLAY_WAIT) {
+				// display updated; wait for vblank
+				exit = CHIP8_RUN_EXIT_DRAW;
+				goto done;
+			}
+#endif
+			RUN_DISPATCH();
+		RUN_OP(00EE) chip8_00EE(chip8); RUN_DISPATCH();
+
+		RUN_OP(1NNN)
+			pc = PC;
+			chip8_1NNN(chip8, opcode);
+			if ((uint16_t)(pc - PC) <= 4) {
+				// jumped to self or just back; halted or idle?
+				exit = chip8_idle_exit(chip8, pc, xo);
+				if (exit != CHIP8_RUN_EXIT_COMPLETE) goto done;
+			}
+			RUN_DISPATCH();
+
+		RUN_OP(2NNN) chip8_2NNN(chip8, opcode); RUN_DISPATCH();
+		RUN_OP(3XNN) chip8_3XNN(chip8, opcode, xo); RUN_DISPATCH();
+		RUN_OP(4XNN) chip8_4XNN(chip8, opcode, xo); RUN_DISPATCH();
+		RUN_OP(5XY0) chip8_5XY0(chip8, opcode, xo); RUN_DISPATCH();
+		RUN_OP(6XNN) chip8_6XNN(chip8, opcode); RUN_DISPATCH();
+		RUN_OP(7XNN) chip8_7XNN(chip8, opcode); RUN_DISPATCH();
+		RUN_OP(8XY0) chip8_8XY0(chip8, opcode); RUN_DISPATCH();
+		RUN_OP(8XY1) chip8_8XY1(chip8, opcode, quirks); RUN_DISPATCH();
+		RUN_OP(8XY2) chip8_8XY2(chip8, opcode, quirks); RUN_DISPATCH();
+		RUN_OP(8XY3) chip8_8XY3(chip8, opcode, quirks); RUN_DISPATCH();
+		RUN_OP(8XY4) chip8_8XY4(chip8, opcode); RUN_DISPATCH();
+		RUN_OP(8XY5) chip8_8XY5(chip8, opcode); RUN_DISPATCH();
+		RUN_OP(8XY6) chip8_8XY6(chip8, opcode, quirks); RUN_DISPATCH();
+		RUN_OP(8XY7) chip8_8XY7(chip8, opcode); RUN_DISPATCH();
+		RUN_OP(8XYE) chip8_8XYE(chip8, opcode, quirks); RUN_DISPATCH();
+		RUN_OP(9XY0) chip8_9XY0(chip8, opcode, xo); RUN_DISPATCH();
+		RUN_OP(ANNN) chip8_ANNN(chip8, opcode); RUN_DISPATCH();
+		RUN_OP(BNNN) chip8_BNNN(chip8, opcode, quirks); RUN_DISPATCH();
+		RUN_OP(CXNN) chip8_CXNN(chip8, opcode); RUN_DISPATCH();
+
+		RUN_OP(DXYN)
+			chip8_DXYN(chip8, opcode, quirks, xo);
+			if (quirks & CHIP8_QUIRK_DISPLAY_WAIT) {
+				// display updated; wait for vblank
+				exit = CHIP8_RUN_EXIT_DRAW;
+				goto done;
+			}
+			RUN_DISPATCH();
+
+		RUN_OP(EX9E) chip8_EX9E(chip8, opcode, xo); RUN_DISPATCH();
+		RUN_OP(EXA1) chip8_EXA1(chip8, opcode, xo); RUN_DISPATCH();
+		RUN_OP(FX07) chip8_FX07(chip8, opcode); RUN_DISPATCH();
+
+		RUN_OP(FX0A)
+			chip8_FX0A(chip8, opcode);
+			if (chip8->cpu_state == CHIP8_STATE_KEY_WAIT) {
+				// waiting for a key; see chip8_set_keypad
+				exit = CHIP8_RUN_EXIT_KEY_WAIT;
+				goto done;
+			}
+			RUN_DISPATCH();
+
+		RUN_OP(FX15) chip8_FX15(chip8, opcode); RUN_DISPATCH();
+		RUN_OP(FX18) chip8_FX18(chip8, opcode); RUN_DISPATCH();
+		RUN_OP(FX1E) chip8_FX1E(chip8, opcode); RUN_DISPATCH();
+		RUN_OP(FX29) chip8_FX29(chip8, opcode); RUN_DISPATCH();
+		RUN_OP(FX33) chip8_FX33(chip8, opcode, xo); RUN_DISPATCH();
+		RUN_OP(FX55) chip8_FX55(chip8, opcode, quirks, xo); RUN_DISPATCH();
+		RUN_OP(FX65) chip8_FX65(chip8, opcode, quirks, xo); RUN_DISPATCH();
+
+		RUN_OP(00CN) chip8_00CN(chip8, opcode); goto platform_exit;
+		RUN_OP(00FB) chip8_00FB(chip8); goto platform_exit;
+		RUN_OP(00FC) chip8_00FC(chip8); goto platform_exit;
+		RUN_OP(00FD) chip8_00FD(chip8); goto platform_exit;
+		RUN_OP(00FE) chip8_00FE(chip8); goto platform_exit;
+		RUN_OP(00FF) chip8_00FF(chip8); goto platform_exit;
+		RUN_OP(FX30) chip8_FX30(chip8, opcode); goto platform_exit;
+		RUN_OP(FX75) chip8_FX75(chip8, opcode); goto platform_exit;
+		RUN_OP(FX85) chip8_FX85(chip8, opcode); goto platform_exit;
+		RUN_OP(00DN) chip8_00DN(chip8, opcode); goto platform_exit;
+		RUN_OP(5XY2) chip8_5XY2(chip8, opcode, xo); goto platform_exit;
+		RUN_OP(5XY3) chip8_5XY3(chip8, opcode, xo); goto platform_exit;
+		RUN_OP(F000) chip8_F000(chip8); goto platform_exit;
+		RUN_OP(FN01) chip8_FN01(chip8, opcode); goto platform_exit;
+		RUN_OP(F002) chip8_F002(chip8); goto platform_exit;
+		RUN_OP(FX3A) chip8_FX3A(chip8, opcode);
+		platform_exit:
+			// invalid on a platform without them; 00FD halts
+			if (chip8->cpu_state != CHIP8_STATE_EXE) {
+				if (chip8->cpu_state == CHIP8_STATE_ERROR_OPCODE) {
+					count -= 1;
+					exit = CHIP8_RUN_EXIT_ERROR;
+				}
+				else {
+					exit = CHIP8_RUN_EXIT_HALT;
+				}
+				goto done;
+			}
+			RUN_DISPATCH();
+#ifdef ENGINE_FUSION
+		/* Fused ops run the same handlers back to back without dispatching
+		 * in between. Each following instruction is counted and checked
+		 * against max_instructions as if it had been dispatched, so the
+		 * state at exit is the same as unfused. */
+		RUN_OP(6XNN_6XNN)
+			chip8_6XNN(chip8, opcode);
+			RUN_FUSED_NEXT(2);
+			chip8_6XNN(chip8, opcode);
+			RUN_DISPATCH();
+
+		RUN_OP(ANNN_DXYN)
+			chip8_ANNN(chip8, opcode);
+			RUN_FUSED_NEXT(2);
+			chip8_DXYN(chip8, opcode, quirks, xo);
+			if (quirks & CHIP8_QUIRK_DISPLAY_WAIT) {
+				// display updated; wait for vblank
+				exit = CHIP8_RUN_EXIT_DRAW;
+				goto done;
+			}
+			RUN_DISPATCH();
+
+		RUN_OP(7XNN_3XNN_1NNN)
+			chip8_7XNN(chip8, opcode);
+			goto fused_3XNN_1NNN;
+
+		RUN_OP(FX07_3XNN_1NNN)
+			chip8_FX07(chip8, opcode);
+		fused_3XNN_1NNN:
+			RUN_FUSED_NEXT(2);
+			pc = PC;
+			chip8_3XNN(chip8, opcode, xo);
+			if (PC == pc + 2) {
+				// jump not skipped
+				RUN_FUSED_NEXT(4);
+				chip8_1NNN(chip8, opcode);
+				exit = chip8_idle_exit(chip8, pc + 2, xo);
+				if (exit != CHIP8_RUN_EXIT_COMPLETE) goto done;
+			}
+			RUN_DISPATCH();
+#endif
+#ifdef ENGINE_THREADED
+	}
+#else
+		}
+	}
+#endif
+
+done:
+	chip8->opcode = opcode;
+#ifdef CHIP8_ENGINE_VIP
+	if (exit == CHIP8_RUN_EXIT_DRAW) {
+		// DXYN waits for vblank, so it is paid for out of the next frame
+		chip8->frame_debt = cost;
+	}
+	else if (exit == CHIP8_RUN_EXIT_COMPLETE) {
+		// the last instruction overran the budget by this much
+		chip8->frame_debt = spent - max_instructions;
+	}
+#endif
+#ifdef CYCLE_COUNT
+	chip8->cycles += count;
+#endif
+
+	if (executed != NULL) {
+		*executed = count;
+	}
+
+	return exit;
+}
+
+#undef ENGINE_NAME
+#undef ENGINE_QUIRKS
+#undef ENGINE_XO
+#undef ENGINE_THREADED
+#undef ENGINE_PREDECODE
+#undef ENGINE_FUSION
+#undef CHIP8_ENGINE_QUIRKS
+#undef CHIP8_ENGINE_XO
+#undef CHIP8_ENGINE_VIP
@@ -0,0 +1,834 @@
+// chip8_jit.c
+//
+// GitHub: https:\\github.com\tommojphillips
+
+/* Basic block recompiler for x86-64 (System V).
+ * Blocks are straight-line runs of opcodes ending at a control flow opcode
+ * (1NNN, 2NNN, 00EE, BNNN, skips) or before an opcode the jit does not
+ * translate (00E0, DXYN, FX0A, SCHIP opcodes). Untranslated opcodes up to the
+ * next translated one run in one chip8_run call. The CHIP8 struct stays the
+ * canonical state; a block is called as uint32_t block(CHIP8*) with chip8 in
+ * rdi, reads and writes the struct directly and returns the number of
+ * instructions it executed.
+ *
+ * FX33/FX55/FX65 use fixed addresses when an ANNN earlier in the block set I;
+ * otherwise they, and CXNN, call C helpers. A write into a page holding
+ * compiled code drops the blocks it overlaps and leaves the running block if
+ * it was one of them. Blocks dropped JIT_HOT_INVALIDATIONS times by the
+ * program's own writes are interpreted from then on. */
+
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE // MAP_ANONYMOUS
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chip8_defines.h"
+#include "chip8.h"
+
+#ifdef CHIP8_JIT_X64
+
+#include <sys/mman.h>
+
+#include "chip8_jit.h"
+
+#define X ((opcode >> 8) & 0x0F)
+#define Y ((opcode >> 4) & 0x00F)
+#define NNN (opcode & 0x0FFF)
+#define NN (opcode & 0x00FF)
+
+/* Struct offsets; chip8 is in rdi */
+#define OFS_V(n)	((uint32_t)(offsetof(CHIP8, v) + (n)))
+#define OFS_VF		OFS_V(0xF)
+#define OFS_I		((uint32_t)offsetof(CHIP8, i))
+#define OFS_PC		((uint32_t)offsetof(CHIP8, pc))
+#define OFS_SP		((uint32_t)offsetof(CHIP8, sp))
+#define OFS_STACK	((uint32_t)offsetof(CHIP8, stack))
+#define OFS_KEYPAD	((uint32_t)offsetof(CHIP8, keypad))
+#define OFS_DT		((uint32_t)offsetof(CHIP8, delay_timer))
+#define OFS_ST		((uint32_t)offsetof(CHIP8, sound_timer))
+#define OFS_OPCODE	((uint32_t)offsetof(CHIP8, opcode))
+#define OFS_RAM(a)	((uint32_t)(offsetof(CHIP8, ram) + (a)))
+#ifdef CHIP8_SNAPSHOT_PAGES
+#define OFS_DIRTY	((uint32_t)offsetof(CHIP8, dirty_pages))
+#endif
+
+/* x86 registers */
+#define EAX 0
+#define ECX 1
+#define EDX 2
+
+/* Block marker for a run of opcodes the jit executes through chip8_run */
+#define JIT_INTERPRET ((void*)1)
+
+/* Largest code a single instruction emits, with room for the block epilogue */
+#define JIT_MAX_INSTRUCTION_BYTES 192
+
+/* Times a block is dropped by the program's own writes before it is interpreted instead */
+#define JIT_HOT_INVALIDATIONS 4
+
+typedef uint32_t(*CHIP8_JIT_FUNC)(CHIP8*);
+
+static void chip8_jit_drop(CHIP8_JIT* jit, uint16_t address, uint16_t size, int count);
+
+static void emit8(CHIP8_JIT* jit, uint8_t b) {
+	jit->code[jit->code_used++] = b;
+}
+static void emit16(CHIP8_JIT* jit, uint16_t w) {
+	emit8(jit, w & 0xFF);
+	emit8(jit, w >> 8);
+}
+static void emit32(CHIP8_JIT* jit, uint32_t d) {
+	emit16(jit, d & 0xFFFF);
+	emit16(jit, d >> 16);
+}
+static void emit64(CHIP8_JIT* jit, uint64_t q) {
+	emit32(jit, q & 0xFFFFFFFF);
+	emit32(jit, q >> 32);
+}
+static void emit_mem(CHIP8_JIT* jit, uint8_t op, uint8_t reg, uint32_t disp) {
+	// op r, [rdi + disp32]
+	emit8(jit, op);
+	emit8(jit, 0x87 | (reg << 3));
+	emit32(jit, disp);
+}
+
+static void emit_load8(CHIP8_JIT* jit, uint8_t reg, uint32_t disp) {
+	// movzx reg, byte [rdi + disp]
+	emit8(jit, 0x0F);
+	emit_mem(jit, 0xB6, reg, disp);
+}
+static void emit_load16(CHIP8_JIT* jit, uint8_t reg, uint32_t disp) {
+	// movzx reg, word [rdi + disp]
+	emit8(jit, 0x0F);
+	emit_mem(jit, 0xB7, reg, disp);
+}
+static void emit_store8(CHIP8_JIT* jit, uint32_t disp, uint8_t reg) {
+	// mov byte [rdi + disp], reg8
+	emit_mem(jit, 0x88, reg, disp);
+}
+static void emit_store16(CHIP8_JIT* jit, uint32_t disp, uint8_t reg) {
+	// mov word [rdi + disp], reg16
+	emit8(jit, 0x66);
+	emit_mem(jit, 0x89, reg, disp);
+}
+static void emit_store8_imm(CHIP8_JIT* jit, uint32_t disp, uint8_t imm) {
+	// mov byte [rdi + disp], imm8
+	emit_mem(jit, 0xC6, 0, disp);
+	emit8(jit, imm);
+}
+static void emit_store16_imm(CHIP8_JIT* jit, uint32_t disp, uint16_t imm) {
+	// mov word [rdi + disp], imm16
+	emit8(jit, 0x66);
+	emit_mem(jit, 0xC7, 0, disp);
+	emit16(jit, imm);
+}
+static void emit_set_pc_cond(CHIP8_JIT* jit, uint8_t cmov, uint16_t pc) {
+	// pc = cond ? pc + 4 : pc + 2
+	emit8(jit, 0xBA); emit32(jit, pc + 2);			// mov edx, pc + 2
+	emit8(jit, 0xB9); emit32(jit, pc + 4);			// mov ecx, pc + 4
+	emit8(jit, 0x0F); emit8(jit, cmov); emit8(jit, 0xD1); // cmovcc edx, ecx
+	emit_store16(jit, OFS_PC, EDX);
+}
+
+static void emit_copy(CHIP8_JIT* jit, uint32_t dst, uint32_t src, uint32_t size) {
+	// copy size bytes within the struct through rax, widest moves first
+	uint32_t n;
+	while (size > 0) {
+		n = (size >= 8) ? 8 : (size >= 4) ? 4 : (size >= 2) ? 2 : 1;
+		if (n == 8) emit8(jit, 0x48);							// rex.w
+		if (n == 2) emit8(jit, 0x66);
+		emit_mem(jit, (n == 1) ? 0x8A : 0x8B, EAX, src);		// mov rax, [src]
+		if (n == 8) emit8(jit, 0x48);
+		if (n == 2) emit8(jit, 0x66);
+		emit_mem(jit, (n == 1) ? 0x88 : 0x89, EAX, dst);		// mov [dst], rax
+		dst += n;
+		src += n;
+		size -= n;
+	}
+}
+static void emit_bcd(CHIP8_JIT* jit, uint32_t dst, uint32_t src) {
+	// decimal digits of byte [src] to [dst], [dst + 1], [dst + 2]
+	emit_load8(jit, EAX, src);
+	emit8(jit, 0x6B); emit8(jit, 0xC8); emit8(jit, 41);		// imul ecx, eax, 41
+	emit8(jit, 0xC1); emit8(jit, 0xE9); emit8(jit, 12);		// shr ecx, 12; eax / 100
+	emit_store8(jit, dst, ECX);
+	emit8(jit, 0x6B); emit8(jit, 0xD1); emit8(jit, 100);	// imul edx, ecx, 100
+	emit8(jit, 0x29); emit8(jit, 0xD0);						// sub eax, edx
+	emit8(jit, 0x69); emit8(jit, 0xC8); emit32(jit, 205);	// imul ecx, eax, 205
+	emit8(jit, 0xC1); emit8(jit, 0xE9); emit8(jit, 11);		// shr ecx, 11; eax / 10
+	emit_store8(jit, dst + 1, ECX);
+	emit8(jit, 0x6B); emit8(jit, 0xD1); emit8(jit, 10);		// imul edx, ecx, 10
+	emit8(jit, 0x29); emit8(jit, 0xD0);						// sub eax, edx
+	emit_store8(jit, dst + 2, EAX);
+}
+static void emit_add_i(CHIP8_JIT* jit, uint16_t opcode) {
+	// FX55/FX65 increment quirk; I += X + 1
+	if (jit->quirks & CHIP8_QUIRK_INCREMENT_I_REGISTER) {
+		emit8(jit, 0x66); emit_mem(jit, 0x83, 0, OFS_I); emit8(jit, X + 1); // add word [i], x + 1
+	}
+}
+static void emit_call(CHIP8_JIT* jit, uintptr_t func, uint32_t a, uint32_t b, uint32_t c) {
+	// func(jit, chip8, a, b, c); rax, rcx and rdx are not preserved
+	emit8(jit, 0x57);										// push rdi; aligns the stack
+	emit8(jit, 0x48); emit8(jit, 0x89); emit8(jit, 0xFE);	// mov rsi, rdi
+	emit8(jit, 0x48); emit8(jit, 0xBF); emit64(jit, (uintptr_t)jit); // mov rdi, jit
+	emit8(jit, 0xBA); emit32(jit, a);						// mov edx, a
+	emit8(jit, 0xB9); emit32(jit, b);						// mov ecx, b
+	emit8(jit, 0x41); emit8(jit, 0xB8); emit32(jit, c);		// mov r8d, c
+	emit8(jit, 0x48); emit8(jit, 0xB8); emit64(jit, func);	// mov rax, func
+	emit8(jit, 0xFF); emit8(jit, 0xD0);						// call rax
+	emit8(jit, 0x5F);										// pop rdi
+}
+static void emit_exit_if(CHIP8_JIT* jit, uint16_t pc, uint16_t opcode, uint32_t executed) {
+	// leave the block after the instruction at pc if eax is set; a helper dropped the block
+	emit8(jit, 0x85); emit8(jit, 0xC0);						// test eax, eax
+	emit8(jit, 0x74); emit8(jit, 24);						// jz past the exit
+	emit_store16_imm(jit, OFS_PC, pc + 2);
+	emit_store16_imm(jit, OFS_OPCODE, opcode);
+	emit8(jit, 0xB8); emit32(jit, executed);				// mov eax, executed
+	emit8(jit, 0xC3);										// ret
+}
+
+#define CMOVE 0x44
+#define CMOVNE 0x45
+
+/* HELPERS; called from blocks */
+
+static uint32_t chip8_jit_written(CHIP8_JIT* jit, CHIP8* chip8, uint32_t address, uint32_t size, uint32_t block) {
+	/* A block wrote size bytes at address. Returns 1 if the writing block was dropped */
+
+	chip8_invalidate_memory(chip8, (uint16_t)address, (uint16_t)size);
+	chip8_jit_drop(jit, (uint16_t)address, (uint16_t)size, 1);
+	return jit->blocks[block].code == NULL;
+}
+static uint32_t chip8_jit_store(CHIP8_JIT* jit, CHIP8* chip8, uint32_t opcode, uint32_t block) {
+	/* FX33/FX55 at I. Returns 1 if the writing block was dropped */
+
+	uint16_t i = chip8->i;
+	uint16_t size;
+
+	if ((opcode & 0xFF) == 0x33) {
+		WRITE_BYTE(i, chip8->v[X] / 100);
+		WRITE_BYTE(i + 1, (chip8->v[X] / 10) % 10);
+		WRITE_BYTE(i + 2, chip8->v[X] % 10);
+		size = 3;
+	}
+	else {
+		for (uint32_t k = 0; k <= X; ++k) {
+			WRITE_BYTE(i + k, chip8->v[k]);
+		}
+		size = X + 1;
+	}
+	chip8_jit_drop(jit, i, size, 1);
+	return jit->blocks[block].code == NULL;
+}
+static uint32_t chip8_jit_load(CHIP8_JIT* jit, CHIP8* chip8, uint32_t opcode) {
+	/* FX65 from I */
+
+	(void)jit;
+	for (uint32_t k = 0; k <= X; ++k) {
+		chip8->v[k] = READ_BYTE(chip8->i + k);
+	}
+	return 0;
+}
+static uint32_t chip8_jit_random(CHIP8_JIT* jit, CHIP8* chip8, uint32_t opcode) {
+	/* CXNN; the same generator as the interpreter */
+
+	(void)jit;
+#ifdef CHIP8_RANDOM_HOOK
+	chip8->v[X] = chip8_random() & NN;
+#else
+	chip8->v[X] = chip8_rng_byte(chip8->rng) & NN;
+#endif
+	return 0;
+}
+
+/* COMPILER */
+
+static int chip8_jit_protect(CHIP8_JIT* jit, uint8_t executable) {
+	/* Map the code buffer writable to compile or executable to run; never both */
+
+	if (jit->executable == executable) {
+		return 0;
+	}
+	if (mprotect(jit->code, CHIP8_JIT_CODE_BYTES, executable ? (PROT_READ | PROT_EXEC) : (PROT_READ | PROT_WRITE)) != 0) {
+		return 1;
+	}
+	jit->executable = executable;
+	return 0;
+}
+static int chip8_jit_translated(CHIP8_OP op) {
+	/* Opcodes chip8_jit_compile translates */
+
+	switch (op) {
+		case CHIP8_OP_00EE:
+		case CHIP8_OP_1NNN:
+		case CHIP8_OP_2NNN:
+		case CHIP8_OP_3XNN:
+		case CHIP8_OP_4XNN:
+		case CHIP8_OP_5XY0:
+		case CHIP8_OP_5XY2:
+		case CHIP8_OP_5XY3:
+		case CHIP8_OP_6XNN:
+		case CHIP8_OP_7XNN:
+		case CHIP8_OP_8XY0:
+		case CHIP8_OP_8XY1:
+		case CHIP8_OP_8XY2:
+		case CHIP8_OP_8XY3:
+		case CHIP8_OP_8XY4:
+		case CHIP8_OP_8XY5:
+		case CHIP8_OP_8XY6:
+		case CHIP8_OP_8XY7:
+		case CHIP8_OP_8XYE:
+		case CHIP8_OP_9XY0:
+		case CHIP8_OP_ANNN:
+		case CHIP8_OP_BNNN:
+		case CHIP8_OP_CXNN:
+		case CHIP8_OP_EX9E:
+		case CHIP8_OP_EXA1:
+		case CHIP8_OP_FX07:
+		case CHIP8_OP_FX15:
+		case CHIP8_OP_FX18:
+		case CHIP8_OP_FX1E:
+		case CHIP8_OP_FX29:
+		case CHIP8_OP_FX33:
+		case CHIP8_OP_FX55:
+		case CHIP8_OP_FX65:
+			return 1;
+		default:
+			return 0;
+	}
+}
+static int chip8_jit_ends_block(CHIP8_OP op) {
+	/* Control flow opcodes */
+
+	switch (op) {
+		case CHIP8_OP_00EE:
+		case CHIP8_OP_1NNN:
+		case CHIP8_OP_2NNN:
+		case CHIP8_OP_BNNN:
+		case CHIP8_OP_3XNN:
+		case CHIP8_OP_4XNN:
+		case CHIP8_OP_5XY0:
+		case CHIP8_OP_5XY2:
+		case CHIP8_OP_5XY3:
+		case CHIP8_OP_9XY0:
+		case CHIP8_OP_EX9E:
+		case CHIP8_OP_EXA1:
+			return 1;
+		default:
+			return 0;
+	}
+}
+static void chip8_jit_mark_pages(CHIP8_JIT* jit, uint16_t address, uint8_t length) {
+	/* Record the pages and length of a new block or marker for chip8_jit_drop */
+
+	if (length > jit->longest) {
+		jit->longest = length;
+	}
+	for (uint16_t page = address >> 8; page <= ((address + length * 2 - 1) >> 8) && page < CHIP8_PAGE_COUNT; ++page) {
+		jit->code_pages |= 1 << page;
+	}
+}
+static void chip8_jit_interpret(CHIP8_JIT* jit, CHIP8* chip8, uint16_t address, int hot) {
+	/* Mark a run of instructions at address for one chip8_run call. The run ends at a
+	 * control flow opcode or, unless hot, before an opcode the jit translates. FX33/FX55
+	 * end it too, so chip8_jit_run finds what they wrote from I after the run */
+
+	CHIP8_JIT_BLOCK* block = &jit->blocks[address];
+	uint16_t pc = address;
+	uint16_t opcode = 0;
+	uint8_t length = 0;
+	CHIP8_OP op;
+
+	while (length < CHIP8_JIT_BLOCK_MAX && pc < CHIP8_MEMORY_BYTES - 1) {
+		opcode = GET_OPCODE(pc);
+		op = chip8_decode_op(opcode);
+		if (length > 0 && !hot && chip8_jit_translated(op)) {
+			break;
+		}
+		block->last_opcode = opcode;
+		length += 1;
+		pc += 2;
+		if (op == CHIP8_OP_FX33 || op == CHIP8_OP_FX55 || chip8_jit_ends_block(op)) {
+			break;
+		}
+	}
+
+	if (length == 0) {
+		block->last_opcode = opcode;
+		length = 1;
+	}
+	block->code = JIT_INTERPRET;
+	block->length = length;
+	chip8_jit_mark_pages(jit, address, length);
+}
+
+static void chip8_jit_compile(CHIP8_JIT* jit, CHIP8* chip8, uint16_t address) {
+	/* Translate the block starting at address */
+
+	CHIP8_JIT_BLOCK* block = &jit->blocks[address];
+	uint32_t start;
+	uint32_t skip;
+	uint32_t size;
+	uint16_t pc = address;
+	uint16_t opcode = 0;
+	uint16_t last_opcode = 0;
+	uint16_t i_value = 0;
+	uint16_t pages;
+	uint8_t i_known = 0; // an ANNN in the block set I to i_value
+	uint8_t length = 0;
+	uint8_t end = 0;
+	CHIP8_OP op;
+
+	if (block->invalidations >= JIT_HOT_INVALIDATIONS || !chip8_jit_translated(chip8_decode_op(GET_OPCODE(address)))) {
+		chip8_jit_interpret(jit, chip8, address, block->invalidations >= JIT_HOT_INVALIDATIONS);
+		return;
+	}
+	if (chip8_jit_protect(jit, 0) != 0) {
+		chip8_jit_interpret(jit, chip8, address, 1);
+		return;
+	}
+
+	if (jit->code_used + (CHIP8_JIT_BLOCK_MAX + 1) * JIT_MAX_INSTRUCTION_BYTES > CHIP8_JIT_CODE_BYTES) {
+		chip8_jit_flush(jit);
+	}
+
+	start = jit->code_used;
+
+	while (!end && length < CHIP8_JIT_BLOCK_MAX && pc < CHIP8_MEMORY_BYTES - 1) {
+
+		opcode = GET_OPCODE(pc);
+		op = chip8_decode_op(opcode);
+
+		switch (op) {
+
+			case CHIP8_OP_00EE: // RET
+				emit_load16(jit, EAX, OFS_SP);
+				emit8(jit, 0x89); emit8(jit, 0xC2);					// mov edx, eax
+				emit8(jit, 0x83); emit8(jit, 0xE2); emit8(jit, CHIP8_STACK_SIZE - 1); // and edx, stack size - 1
+				emit8(jit, 0x0F); emit8(jit, 0xB7); emit8(jit, 0x8C); emit8(jit, 0x57); emit32(jit, OFS_STACK); // movzx ecx, word [rdi + rdx*2 + stack]
+				emit8(jit, 0x83); emit8(jit, 0xC1); emit8(jit, 0x02);	// add ecx, 2
+				emit_store16(jit, OFS_PC, ECX);
+				emit8(jit, 0x66); emit8(jit, 0xFF); emit8(jit, 0xC8);	// dec ax
+				emit_store16(jit, OFS_SP, EAX);
+				end = 1;
+				break;
+
+			case CHIP8_OP_1NNN: // JMP NNN
+				if (NNN == pc || NNN + 4 == pc) {
+					// maybe a halt or idle loop; chip8_run detects those
+					end = 2;
+					continue;
+				}
+				emit_store16_imm(jit, OFS_PC, NNN);
+				end = 1;
+				break;
+
+			case CHIP8_OP_2NNN: // CALL NNN
+				emit_load16(jit, EAX, OFS_SP);
+				emit8(jit, 0x66); emit8(jit, 0xFF); emit8(jit, 0xC0);	// inc ax
+				emit_store16(jit, OFS_SP, EAX);
+				emit8(jit, 0x83); emit8(jit, 0xE0); emit8(jit, CHIP8_STACK_SIZE - 1); // and eax, stack size - 1
+				emit8(jit, 0x66); emit8(jit, 0xC7); emit8(jit, 0x84); emit8(jit, 0x47); emit32(jit, OFS_STACK); emit16(jit, pc); // mov word [rdi + rax*2 + stack], pc
+				emit_store16_imm(jit, OFS_PC, NNN);
+				end = 1;
+				break;
+
+			case CHIP8_OP_3XNN: // SE VX, NN
+			case CHIP8_OP_4XNN: // SNE VX, NN
+				emit_mem(jit, 0x80, 7, OFS_V(X)); emit8(jit, NN);	// cmp byte [vx], nn
+				emit_set_pc_cond(jit, (opcode >> 12) == 0x3 ? CMOVE : CMOVNE, pc);
+				end = 1;
+				break;
+
+			case CHIP8_OP_5XY0: // SE VX, VY
+			case CHIP8_OP_5XY2: // SE VX, VY outside XO-CHIP
+			case CHIP8_OP_5XY3:
+			case CHIP8_OP_9XY0: // SNE VX, VY
+				emit_load8(jit, EAX, OFS_V(X));
+				emit_mem(jit, 0x3A, EAX, OFS_V(Y));				// cmp al, [vy]
+				emit_set_pc_cond(jit, (opcode >> 12) == 0x5 ? CMOVE : CMOVNE, pc);
+				end = 1;
+				break;
+
+			case CHIP8_OP_6XNN: // LD VX, NN
+				emit_store8_imm(jit, OFS_V(X), NN);
+				break;
+
+			case CHIP8_OP_7XNN: // ADD VX, NN
+				emit_mem(jit, 0x80, 0, OFS_V(X)); emit8(jit, NN);	// add byte [vx], nn
+				break;
+
+			case CHIP8_OP_8XY0: // LD VX, VY
+				emit_load8(jit, EAX, OFS_V(Y));
+				emit_store8(jit, OFS_V(X), EAX);
+				break;
+
+			case CHIP8_OP_8XY1: // OR VX, VY
+			case CHIP8_OP_8XY2: // AND VX, VY
+			case CHIP8_OP_8XY3: // XOR VX, VY
+				emit_load8(jit, EAX, OFS_V(X));
+				emit_load8(jit, ECX, OFS_V(Y));
+				emit8(jit, (opcode & 0xF) == 0x1 ? 0x08 : (opcode & 0xF) == 0x2 ? 0x20 : 0x30); emit8(jit, 0xC8); // op al, cl
+				emit_store8(jit, OFS_V(X), EAX);
+				if (jit->quirks & CHIP8_QUIRK_ZERO_VF_REGISTER) {
+					emit_store8_imm(jit, OFS_VF, 0);
+				}
+				break;
+
+			case CHIP8_OP_8XY4: // ADD VX, VY
+				emit_load8(jit, EAX, OFS_V(X));
+				emit_load8(jit, ECX, OFS_V(Y));
+				emit8(jit, 0x01); emit8(jit, 0xC8);					// add eax, ecx
+				emit_store8(jit, OFS_V(X), EAX);
+				emit8(jit, 0xC1); emit8(jit, 0xE8); emit8(jit, 0x08);	// shr eax, 8
+				emit_store8(jit, OFS_VF, EAX);
+				break;
+
+			case CHIP8_OP_8XY5: // SUB VX, VY
+			case CHIP8_OP_8XY7: // SUBN VX, VY
+				emit_load8(jit, EAX, OFS_V(X));
+				emit_load8(jit, ECX, OFS_V(Y));
+				if ((opcode & 0xF) == 0x5) {
+					emit8(jit, 0x39); emit8(jit, 0xC8);				// cmp eax, ecx
+					emit8(jit, 0x0F); emit8(jit, 0x93); emit8(jit, 0xC2); // setae dl
+					emit8(jit, 0x29); emit8(jit, 0xC8);				// sub eax, ecx
+					emit_store8(jit, OFS_V(X), EAX);
+				}
+				else {
+					emit8(jit, 0x39); emit8(jit, 0xC1);				// cmp ecx, eax
+					emit8(jit, 0x0F); emit8(jit, 0x93); emit8(jit, 0xC2); // setae dl
+					emit8(jit, 0x29); emit8(jit, 0xC1);				// sub ecx, eax
+					emit_store8(jit, OFS_V(X), ECX);
+				}
+				emit_store8(jit, OFS_VF, EDX);
+				break;
+
+			case CHIP8_OP_8XY6: // SHR VX, VY
+				emit_load8(jit, EAX, OFS_V(X));
+				emit8(jit, 0x89); emit8(jit, 0xC2);					// mov edx, eax
+				emit8(jit, 0x83); emit8(jit, 0xE2); emit8(jit, 0x01);	// and edx, 1
+				if (!(jit->quirks & CHIP8_QUIRK_SHIFT_X_REGISTER)) {
+					emit_load8(jit, EAX, OFS_V(Y));
+				}
+				emit8(jit, 0xD1); emit8(jit, 0xE8);					// shr eax, 1
+				emit_store8(jit, OFS_V(X), EAX);
+				emit_store8(jit, OFS_VF, EDX);
+				break;
+
+			case CHIP8_OP_8XYE: // SHL VX, VY
+				emit_load8(jit, EAX, OFS_V(X));
+				emit8(jit, 0x89); emit8(jit, 0xC2);					// mov edx, eax
+				emit8(jit, 0xC1); emit8(jit, 0xEA); emit8(jit, 0x07);	// shr edx, 7
+				if (!(jit->quirks & CHIP8_QUIRK_SHIFT_X_REGISTER)) {
+					emit_load8(jit, EAX, OFS_V(Y));
+				}
+				emit8(jit, 0x01); emit8(jit, 0xC0);					// add eax, eax
+				emit_store8(jit, OFS_V(X), EAX);
+				emit_store8(jit, OFS_VF, EDX);
+				break;
+
+			case CHIP8_OP_ANNN: // LD I, NNN
+				emit_store16_imm(jit, OFS_I, NNN);
+				i_value = NNN;
+				i_known = 1;
+				break;
+
+			case CHIP8_OP_BNNN: // JMP NNN, V0
+				emit_load8(jit, EAX, OFS_V((jit->quirks & CHIP8_QUIRK_JUMP_VX) ? X : 0));
+				emit8(jit, 0x05); emit32(jit, NNN);					// add eax, nnn
+				emit_store16(jit, OFS_PC, EAX);
+				end = 1;
+				break;
+
+			case CHIP8_OP_CXNN: // RND VX, NN
+				emit_call(jit, (uintptr_t)chip8_jit_random, opcode, 0, 0);
+				break;
+
+			case CHIP8_OP_EX9E: // SKP VX
+			case CHIP8_OP_EXA1: // SKNP VX
+				emit_load8(jit, ECX, OFS_V(X));
+				emit_load16(jit, EAX, OFS_KEYPAD);
+				emit8(jit, 0xD3); emit8(jit, 0xE8);					// shr eax, cl
+				emit8(jit, 0xA8); emit8(jit, 0x01);					// test al, 1
+				emit_set_pc_cond(jit, (opcode & 0xFF) == 0x9E ? CMOVNE : CMOVE, pc);
+				end = 1;
+				break;
+
+			case CHIP8_OP_FX07: // LD VX, DT
+				emit_load8(jit, EAX, OFS_DT);
+				emit_store8(jit, OFS_V(X), EAX);
+				break;
+
+			case CHIP8_OP_FX15: // LD DT, VX
+			case CHIP8_OP_FX18: // LD ST, VX
+				emit_load8(jit, EAX, OFS_V(X));
+				emit_store8(jit, (opcode & 0xFF) == 0x15 ? OFS_DT : OFS_ST, EAX);
+				break;
+
+			case CHIP8_OP_FX1E: // ADD I, VX
+				emit_load8(jit, EAX, OFS_V(X));
+				emit8(jit, 0x66); emit_mem(jit, 0x01, EAX, OFS_I);	// add word [i], ax
+				i_known = 0;
+				break;
+
+			case CHIP8_OP_FX29: // LD F, VX
+				emit_load8(jit, EAX, OFS_V(X));
+				emit8(jit, 0x8D); emit8(jit, 0x04); emit8(jit, 0x80);	// lea eax, [rax + rax*4]
+				emit_store16(jit, OFS_I, EAX);
+				i_known = 0;
+				break;
+
+			case CHIP8_OP_FX33: // LD B, VX
+			case CHIP8_OP_FX55: // LD [I], VX
+				size = (op == CHIP8_OP_FX33) ? 3 : X + 1;
+				if (i_known && (i_value & (CHIP8_MEMORY_BYTES - 1)) + size <= CHIP8_MEMORY_BYTES) {
+					// fixed addresses; only writes into pages holding blocks call the helper
+					i_value &= CHIP8_MEMORY_BYTES - 1;
+					pages = 0;
+					for (uint32_t page = i_value >> 8; page <= ((i_value + size - 1) >> 8); ++page) {
+						pages |= 1 << page;
+					}
+					if (op == CHIP8_OP_FX33) {
+						emit_bcd(jit, OFS_RAM(i_value), OFS_V(X));
+					}
+					else {
+						emit_copy(jit, OFS_RAM(i_value), OFS_V(0), size);
+						emit_add_i(jit, opcode);
+					}
+#ifdef CHIP8_SNAPSHOT_PAGES
+					emit8(jit, 0x66); emit_mem(jit, 0x81, 1, OFS_DIRTY); emit16(jit, pages); // or word [dirty_pages], pages
+#endif
+#ifdef CHIP8_PREDECODE
+					skip = 0; // predecoded entries are dropped on every write
+#else
+					emit8(jit, 0x48); emit8(jit, 0xB8); emit64(jit, (uintptr_t)&jit->code_pages); // mov rax, &code_pages
+					emit8(jit, 0x66); emit8(jit, 0xF7); emit8(jit, 0x00); emit16(jit, pages);	// test word [rax], pages
+					emit8(jit, 0x74); emit8(jit, 0);										// jz past the helper
+					skip = jit->code_used;
+#endif
+					emit_call(jit, (uintptr_t)chip8_jit_written, i_value, size, address);
+					emit_exit_if(jit, pc, opcode, length + 1);
+					if (skip != 0) {
+						jit->code[skip - 1] = (uint8_t)(jit->code_used - skip);
+					}
+				}
+				else {
+					emit_call(jit, (uintptr_t)chip8_jit_store, opcode, address, 0);
+					if (op == CHIP8_OP_FX55) {
+						emit_add_i(jit, opcode);
+					}
+					emit_exit_if(jit, pc, opcode, length + 1);
+				}
+				if (op == CHIP8_OP_FX55 && (jit->quirks & CHIP8_QUIRK_INCREMENT_I_REGISTER)) {
+					i_value += X + 1;
+				}
+				break;
+
+			case CHIP8_OP_FX65: // LD VX, [I]
+				size = X + 1;
+				if (i_known && (i_value & (CHIP8_MEMORY_BYTES - 1)) + size <= CHIP8_MEMORY_BYTES) {
+					emit_copy(jit, OFS_V(0), OFS_RAM(i_value & (CHIP8_MEMORY_BYTES - 1)), size);
+				}
+				else {
+					emit_call(jit, (uintptr_t)chip8_jit_load, opcode, 0, 0);
+				}
+				emit_add_i(jit, opcode);
+				if (jit->quirks & CHIP8_QUIRK_INCREMENT_I_REGISTER) {
+					i_value += X + 1;
+				}
+				break;
+
+			default:
+				// not translated; ends the block before this opcode
+				end = 2;
+				continue;
+		}
+
+		last_opcode = opcode;
+		length += 1;
+		pc += 2;
+	}
+
+	if (length == 0) {
+		chip8_jit_interpret(jit, chip8, address, 0);
+		return;
+	}
+
+	if (end != 1) {
+		// fell out of the block; continue at the next instruction
+		emit_store16_imm(jit, OFS_PC, pc);
+	}
+	emit8(jit, 0xB8); emit32(jit, length); // mov eax, length
+	emit8(jit, 0xC3); // ret
+
+	block->code = jit->code + start;
+	block->length = length;
+	block->last_opcode = last_opcode;
+	chip8_jit_mark_pages(jit, address, length);
+}
+
+int chip8_jit_init(CHIP8_JIT* jit) {
+	jit->code = mmap(NULL, CHIP8_JIT_CODE_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (jit->code == MAP_FAILED) {
+		jit->code = NULL;
+		return 1;
+	}
+	jit->executable = 0;
+	jit->quirks = 0;
+	chip8_jit_flush(jit);
+	return 0;
+}
+void chip8_jit_destroy(CHIP8_JIT* jit) {
+	if (jit->code != NULL) {
+		munmap(jit->code, CHIP8_JIT_CODE_BYTES);
+		jit->code = NULL;
+	}
+}
+void chip8_jit_flush(CHIP8_JIT* jit) {
+	for (int i = 0; i < CHIP8_MEMORY_BYTES; ++i) {
+		jit->blocks[i].code = NULL;
+		jit->blocks[i].length = 0;
+		jit->blocks[i].invalidations = 0;
+	}
+	jit->code_used = 0;
+	jit->code_pages = 0;
+	jit->longest = 0;
+}
+void chip8_jit_invalidate(CHIP8_JIT* jit, uint16_t address, uint16_t size) {
+	chip8_jit_drop(jit, address, size, 0);
+}
+static void chip8_jit_drop(CHIP8_JIT* jit, uint16_t address, uint16_t size, int count) {
+	/* Drop every block or interpreter marker that overlaps [address, address + size);
+	 * count is set for the program's own writes, which make blocks hot */
+
+	uint16_t pages = 0;
+	int start, first, last;
+
+	if (size == 0) {
+		return;
+	}
+
+	start = address & (CHIP8_MEMORY_BYTES - 1);
+	first = start;
+	last = start + size - 1;
+	if (last >= CHIP8_MEMORY_BYTES) {
+		// wrapped write; just drop everything
+		chip8_jit_flush(jit);
+		return;
+	}
+
+	for (int page = first >> 8; page <= (last >> 8); ++page) {
+		pages |= 1 << page;
+	}
+
+	if (!(jit->code_pages & pages)) {
+		return;
+	}
+
+	/* A block of the longest length starting 2 * longest - 1 bytes before first still covers it */
+	first -= jit->longest * 2 - 1;
+	if (first < 0) {
+		first = 0;
+	}
+
+	for (int i = first; i <= last; ++i) {
+		CHIP8_JIT_BLOCK* block = &jit->blocks[i];
+		if (block->code != NULL && i + block->length * 2 > start) {
+			if (count && block->code != JIT_INTERPRET && block->invalidations < JIT_HOT_INVALIDATIONS) {
+				block->invalidations += 1;
+			}
+			block->code = NULL;
+			block->length = 0;
+		}
+	}
+}
+
+CHIP8_RUN_EXIT chip8_jit_run(CHIP8_JIT* jit, CHIP8* chip8, uint32_t max_instructions, uint32_t* executed) {
+	/* Execute compiled blocks; anything not translated goes through chip8_run */
+
+	CHIP8_RUN_EXIT exit = CHIP8_RUN_EXIT_COMPLETE;
+	CHIP8_JIT_BLOCK* block;
+	uint32_t count = 0;
+	uint32_t budget;
+	uint32_t n;
+	uint16_t opcode;
+	uint16_t i;
+	uint8_t length;
+
+	if (chip8->platform == CHIP8_PLATFORM_XOCHIP) {
+		/* blocks skip two bytes and read the first 4 KB; XO-CHIP is interpreted */
+		return chip8_run(chip8, max_instructions, executed);
+	}
+
+	if (chip8->quirks != jit->quirks) {
+		chip8_jit_flush(jit);
+		jit->quirks = chip8->quirks;
+	}
+
+	if (chip8->cpu_state == CHIP8_STATE_HLT || chip8->cpu_state == CHIP8_STATE_ERROR_OPCODE) {
+		exit = (chip8->cpu_state == CHIP8_STATE_HLT) ? CHIP8_RUN_EXIT_HALT : CHIP8_RUN_EXIT_ERROR;
+		max_instructions = 0;
+	}
+
+	while (count < max_instructions) {
+
+		budget = 1;
+		opcode = GET_OPCODE(chip8->pc); // the last instruction of the run
+		if (chip8->pc < CHIP8_MEMORY_BYTES) {
+			block = &jit->blocks[chip8->pc];
+			if (block->code == NULL) {
+				chip8_jit_compile(jit, chip8, chip8->pc);
+			}
+			length = block->length;
+			if (block->code == JIT_INTERPRET) {
+				budget = length;
+				opcode = block->last_opcode;
+				if (budget > max_instructions - count) {
+					budget = max_instructions - count;
+					opcode = 0; // cut short of a run's FX33/FX55
+				}
+			}
+			else if (length <= max_instructions - count && chip8_jit_protect(jit, 1) == 0) {
+				opcode = block->last_opcode;
+				n = ((CHIP8_JIT_FUNC)block->code)(chip8);
+				if (n == length) {
+					chip8->opcode = opcode; // a block leaving early sets it
+				}
+				count += n;
+#ifdef CYCLE_COUNT
+				chip8->cycles += n;
+#endif
+				continue;
+			}
+		}
+
+		/* Interpret a run; FX33 and FX55 only end one, so the I they wrote at is I after it */
+		exit = chip8_run(chip8, budget, &n);
+		count += n;
+
+		if (n == budget) {
+			if ((opcode & 0xF0FF) == 0xF033) {
+				chip8_jit_drop(jit, chip8->i, 3, 1);
+			}
+			else if ((opcode & 0xF0FF) == 0xF055) {
+				i = (chip8->quirks & CHIP8_QUIRK_INCREMENT_I_REGISTER) ? chip8->i - (X + 1) : chip8->i;
+				chip8_jit_drop(jit, i, X + 1, 1);
+			}
+		}
+
+		if (exit != CHIP8_RUN_EXIT_COMPLETE) {
+			break;
+		}
+	}
+
+	if (executed != NULL) {
+		*executed = count;
+	}
+
+	return exit;
+}
+#endif
@@ -0,0 +1,61 @@
+// chip8_jit.h
+//
+// GitHub: https:\\github.com\tommojphillips
+
+#ifndef CHIP8_JIT_H
+#define CHIP8_JIT_H
+
+#include <stdint.h>
+
+#include "chip8_defines.h"
+#include "chip8.h"
+
+#ifdef CHIP8_JIT_X64
+
+#define CHIP8_JIT_CODE_BYTES		0x100000	// executable buffer size
+#define CHIP8_JIT_BLOCK_MAX			32			// max instructions per block
+
+/* Chip8 jit compiled block */
+typedef struct {
+	void* code;				// entry point; NULL if not compiled
+	uint16_t last_opcode;	// opcode of the last instruction in the block
+	uint8_t length;			// number of instructions in the block, or interpreted in one chip8_run call
+	uint8_t invalidations;	// times the compiled block was dropped by writes; hot blocks are interpreted
+} CHIP8_JIT_BLOCK;
+
+/* Chip8 jit state; one per CHIP8 instance */
+typedef struct {
+	uint8_t* code;			// mmap'd code buffer; writable while compiling, executable while running (W^X)
+	uint32_t code_used;
+	uint32_t quirks;		// quirks the blocks were compiled for
+	uint16_t code_pages;	// 256 byte ram pages containing blocks or markers; 1 bit per page
+	uint8_t longest;		// most instructions in a block or marker since the last flush
+	uint8_t executable;		// code is mapped read/execute
+	CHIP8_JIT_BLOCK blocks[CHIP8_MEMORY_BYTES]; // block starting at each address
+} CHIP8_JIT;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Initialize jit state and allocate the executable buffer. Returns 0 on success
+int chip8_jit_init(CHIP8_JIT* jit);
+
+// Free the executable buffer
+void chip8_jit_destroy(CHIP8_JIT* jit);
+
+// Discard all compiled blocks
+void chip8_jit_flush(CHIP8_JIT* jit);
+
+// Discard compiled blocks overlapping ram written by the host
+void chip8_jit_invalidate(CHIP8_JIT* jit, uint16_t address, uint16_t size);
+
+// Execute up to max_instructions using compiled blocks; same exits as chip8_run.
+// The number of instructions executed is stored in executed if not NULL.
+CHIP8_RUN_EXIT chip8_jit_run(CHIP8_JIT* jit, CHIP8* chip8, uint32_t max_instructions, uint32_t* executed);
+
+#ifdef __cplusplus
+};
+#endif
+#endif
+#endif
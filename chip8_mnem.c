@@ -2,7 +2,8 @@
 //
 // GitHub: https:\\github.com\tommojphillips
 
-#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
 
 #include "chip8_defines.h"
 #include "chip8.h"
@@ -19,156 +20,274 @@
 
 #define VX chip8->v[X]
 #define VY chip8->v[Y]
-#define VF chip8->v[0xF]
-#define I chip8->i
 #define PC chip8->pc
 #define SP chip8->sp
 
-#define MNEM_0(x) sprintf_s(str, 32, x)
-#define MNEM_1(x, x1) sprintf_s(str, 32, x, x1)
-#define MNEM_2(x, x1, x2) sprintf_s(str, 32, x, x1, x2)
-#define MNEM_3(x, x1, x2, x3) sprintf_s(str, 32, x, x1, x2, x3)
-
-void chip8_mnem_00E0(uint16_t opcode, char* str) {
-	// CLS
-	MNEM_0("CLS");
-}
-void chip8_mnem_00EE(uint16_t opcode, char* str) {
-	// RET
-	MNEM_0("RET");
-}
-void chip8_mnem_1NNN(uint16_t opcode, char* str) {
-	// JMP NNN
-	MNEM_1("JMP 0x%x", NNN);
-}
-void chip8_mnem_2NNN(uint16_t opcode, char* str) {
-	// CALL NNN
-	MNEM_1("CALL 0x%x", NNN);
-}
-void chip8_mnem_3XNN(uint16_t opcode, char* str) {
-	// SE VX, NN
-	MNEM_2("SE V%X, 0x%x", X, NN);
-}
-void chip8_mnem_4XNN(uint16_t opcode, char* str) {
-	// SNE VX, NN
-	MNEM_2("SNE V%X, 0x%x", X, NN);
-}
-void chip8_mnem_5XY0(uint16_t opcode, char* str) {
-	// SE VX, VY
-	MNEM_2("SE V%X, V%X", X, Y);
-}
-void chip8_mnem_6XNN(uint16_t opcode, char* str) {
-	// LD VX, NN
-	MNEM_2("LD V%X, 0x%x", X, NN);
-}
-void chip8_mnem_7XNN(uint16_t opcode, char* str) {
-	// ADD VX, NN
-	MNEM_2("ADD V%X, 0x%x", X, NN);
-}
-void chip8_mnem_8XY0(uint16_t opcode, char* str) {
-	// LD VX, VY
-	MNEM_2("LD V%X, V%X", X, Y);
-}
-void chip8_mnem_8XY1(uint16_t opcode, char* str) {
-	// VX=VX│VY
-	MNEM_2("OR V%X, V%X", X, Y);
-}
-void chip8_mnem_8XY2(uint16_t opcode, char* str) {
-	// VX=VX&VY
-	MNEM_2("AND V%X, V%X", X, Y);
-}
-void chip8_mnem_8XY3(uint16_t opcode, char* str) {
-	// VX=VX^VY
-	MNEM_2("XOR V%X, V%X", X, Y);
-}
-void chip8_mnem_8XY4(uint16_t opcode, char* str) {
-	// Set Vx = Vx + Vy, set VF = carry.
-	MNEM_2("ADD V%X, V%X", X, Y);
-}
-void chip8_mnem_8XY5(uint16_t opcode, char* str) {
-	// SUB VX, VY	
-	MNEM_2("SUB V%X, V%X", X, Y);
-}
-void chip8_mnem_8XY6(uint16_t opcode, char* str) {
-	// SHR VX
-	MNEM_1("SHR V%X", X);
-}
-void chip8_mnem_8XY7(uint16_t opcode, char* str) {
-	// SUBN VX, VY
-	MNEM_2("SUBN V%X, V%X", X, Y);
-}
-void chip8_mnem_8XYE(uint16_t opcode, char* str) {
-	// SHL VX
-	MNEM_1("SHL V%X", X);
-}
-void chip8_mnem_9XY0(uint16_t opcode, char* str) {
-	// SNE VX, VY
-	MNEM_2("SNE V%X, V%X", X, Y);
-}
-void chip8_mnem_ANNN(uint16_t opcode, char* str) {
-	// LD I, NNN
-	MNEM_1("LD I, 0x%x", NNN);
-}
-void chip8_mnem_BNNN(uint16_t opcode, char* str) {
-	// JMP NNN, V0
-	MNEM_1("JMP 0x%x, V0", NNN);
-}
-void chip8_mnem_CXNN(uint16_t opcode, char* str) {
-	// RND VX, NN
-	MNEM_2("RND V%X, 0x%x", X, NN);
-}
-void chip8_mnem_DXYN(uint16_t opcode, char* str) {
-	// DRW VX, VY, N
-	MNEM_3("DRW V%X, V%X, 0x%x", X, Y, N);
-}
-void chip8_mnem_EX9E(uint16_t opcode, char* str) {
-	// SKP VX
-	MNEM_1("SKP V%X", X);
-}
-void chip8_mnem_EXA1(uint16_t opcode, char* str) {
-	// SKNP VX
-	MNEM_1("SKNP V%X", X);
-}
-void chip8_mnem_FX07(uint16_t opcode, char* str) {
-	// LD VX, DT
-	MNEM_1("LD V%X, DT", X);
-}
-void chip8_mnem_FX0A(uint16_t opcode, char* str) {
-	// LD VX, KEY
-	MNEM_1("LD V%X, KEY", X);
-}
-void chip8_mnem_FX15(uint16_t opcode, char* str) {
-	// LD DT, VX
-	MNEM_1("LD DT, V%X", X);
-}
-void chip8_mnem_FX18(uint16_t opcode, char* str) {
-	// LD ST, VX
-	MNEM_1("LD ST, V%X", X);
-}
-void chip8_mnem_FX1E(uint16_t opcode, char* str) {
-	// ADD I, VX
-	MNEM_1("ADD I, V%X", X);
+/* Immediate operand of a mnemonic */
+typedef enum {
+	MNEM_IMM_NONE = 0,
+	MNEM_IMM_N,
+	MNEM_IMM_NN,
+	MNEM_IMM_NNN,
+	MNEM_IMM_WORD,			// the word after the opcode
+} MNEM_IMM;
+
+typedef struct {
+	const char* text;		// %x, %y: X, Y as a hex digit; %i: the immediate in hex
+	uint8_t imm;			// MNEM_IMM
+} MNEM_FORMAT;
+
+/* Mnemonic per CHIP8_OP */
+static const MNEM_FORMAT chip8_mnem_formats[CHIP8_OP_COUNT] = {
+	{ "", MNEM_IMM_NONE },					// NONE
+	{ "DW 0x%i", MNEM_IMM_NONE },			// INVALID; the immediate is the opcode
+	{ "CLS", MNEM_IMM_NONE },				// 00E0
+	{ "RET", MNEM_IMM_NONE },				// 00EE
+	{ "JMP 0x%i", MNEM_IMM_NNN },			// 1NNN
+	{ "CALL 0x%i", MNEM_IMM_NNN },			// 2NNN
+	{ "SE V%x, 0x%i", MNEM_IMM_NN },		// 3XNN
+	{ "SNE V%x, 0x%i", MNEM_IMM_NN },		// 4XNN
+	{ "SE V%x, V%y", MNEM_IMM_NONE },		// 5XY0
+	{ "LD V%x, 0x%i", MNEM_IMM_NN },		// 6XNN
+	{ "ADD V%x, 0x%i", MNEM_IMM_NN },		// 7XNN
+	{ "LD V%x, V%y", MNEM_IMM_NONE },		// 8XY0
+	{ "OR V%x, V%y", MNEM_IMM_NONE },		// 8XY1
+	{ "AND V%x, V%y", MNEM_IMM_NONE },		// 8XY2
+	{ "XOR V%x, V%y", MNEM_IMM_NONE },		// 8XY3
+	{ "ADD V%x, V%y", MNEM_IMM_NONE },		// 8XY4
+	{ "SUB V%x, V%y", MNEM_IMM_NONE },		// 8XY5
+	{ "SHR V%x", MNEM_IMM_NONE },			// 8XY6
+	{ "SUBN V%x, V%y", MNEM_IMM_NONE },		// 8XY7
+	{ "SHL V%x", MNEM_IMM_NONE },			// 8XYE
+	{ "SNE V%x, V%y", MNEM_IMM_NONE },		// 9XY0
+	{ "LD I, 0x%i", MNEM_IMM_NNN },			// ANNN
+	{ "JMP 0x%i, V0", MNEM_IMM_NNN },		// BNNN
+	{ "RND V%x, 0x%i", MNEM_IMM_NN },		// CXNN
+	{ "DRW V%x, V%y, 0x%i", MNEM_IMM_N },	// DXYN
+	{ "SKP V%x", MNEM_IMM_NONE },			// EX9E
+	{ "SKNP V%x", MNEM_IMM_NONE },			// EXA1
+	{ "LD V%x, DT", MNEM_IMM_NONE },		// FX07
+	{ "LD V%x, KEY", MNEM_IMM_NONE },		// FX0A
+	{ "LD DT, V%x", MNEM_IMM_NONE },		// FX15
+	{ "LD ST, V%x", MNEM_IMM_NONE },		// FX18
+	{ "ADD I, V%x", MNEM_IMM_NONE },		// FX1E
+	{ "LD F, V%x", MNEM_IMM_NONE },			// FX29
+	{ "LD B, V%x", MNEM_IMM_NONE },			// FX33
+	{ "LD [I], V%x", MNEM_IMM_NONE },		// FX55
+	{ "LD V%x, [I]", MNEM_IMM_NONE },		// FX65
+	{ "SCD 0x%i", MNEM_IMM_N },				// 00CN
+	{ "SCR", MNEM_IMM_NONE },				// 00FB
+	{ "SCL", MNEM_IMM_NONE },				// 00FC
+	{ "EXIT", MNEM_IMM_NONE },				// 00FD
+	{ "LOW", MNEM_IMM_NONE },				// 00FE
+	{ "HIGH", MNEM_IMM_NONE },				// 00FF
+	{ "LD HF, V%x", MNEM_IMM_NONE },		// FX30
+	{ "LD R, V%x", MNEM_IMM_NONE },			// FX75
+	{ "LD V%x, R", MNEM_IMM_NONE },			// FX85
+	{ "SCU 0x%i", MNEM_IMM_N },				// 00DN
+	{ "LD [I], V%x-V%y", MNEM_IMM_NONE },	// 5XY2
+	{ "LD V%x-V%y, [I]", MNEM_IMM_NONE },	// 5XY3
+	{ "LD I, 0x%i", MNEM_IMM_WORD },		// F000 NNNN
+	{ "PLANE %x", MNEM_IMM_NONE },			// FN01
+	{ "AUDIO", MNEM_IMM_NONE },				// F002
+	{ "PITCH V%x", MNEM_IMM_NONE },			// FX3A
+};
+
+static const char chip8_mnem_upper[16] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F' };
+static const char chip8_mnem_lower[16] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
+
+static char* chip8_mnem_hex(char* str, uint16_t value) {
+	/* Lower case hex without leading zeros */
+
+	int shift = 12;
+	while (shift > 0 && (value >> shift) == 0) {
+		shift -= 4;
+	}
+	for (; shift >= 0; shift -= 4) {
+		*str++ = chip8_mnem_lower[(value >> shift) & 0xF];
+	}
+	return str;
 }
-void chip8_mnem_FX29(uint16_t opcode, char* str) {
-	// LD B, VX
-	MNEM_1("LD F, V%X", X);
+static char* chip8_mnem_hex4(char* str, uint16_t value) {
+	/* Upper case hex, 4 digits */
+
+	str[0] = chip8_mnem_upper[value >> 12];
+	str[1] = chip8_mnem_upper[(value >> 8) & 0xF];
+	str[2] = chip8_mnem_upper[(value >> 4) & 0xF];
+	str[3] = chip8_mnem_upper[value & 0xF];
+	return str + 4;
 }
-void chip8_mnem_FX33(uint16_t opcode, char* str) {
-	// LD B, VX
-	MNEM_1("LD B, V%X", X);
+
+static CHIP8_OP chip8_mnem_op(uint16_t opcode, CHIP8_PLATFORM platform) {
+	/* CHIP8_OP of opcode as platform runs it */
+
+	CHIP8_OP op = (CHIP8_OP)chip8_op_table[opcode >> 12][opcode & 0xFF];
+
+	if (op < CHIP8_OP_00CN || platform == CHIP8_PLATFORM_XOCHIP) {
+		return op;
+	}
+	if (op >= CHIP8_OP_00DN) {
+		// 5XYN is 5XY0 elsewhere
+		return (op == CHIP8_OP_5XY2 || op == CHIP8_OP_5XY3) ? CHIP8_OP_5XY0 : CHIP8_OP_INVALID;
+	}
+	return (platform == CHIP8_PLATFORM_CHIP8) ? CHIP8_OP_INVALID : op;
 }
-void chip8_mnem_FX55(uint16_t opcode, char* str) {
-	//LD [I], VX
-	MNEM_1("LD [I], V%X", X);
+
+static void chip8_mnem_decode_opcode(CHIP8_MNEM_INSTRUCTION* instruction, uint16_t opcode, uint16_t address,
+	const uint8_t* word, CHIP8_PLATFORM platform) {
+	/* Decode opcode at address; word is the 2 bytes after it, NULL past the end of the program */
+
+	CHIP8_OP op = chip8_mnem_op(opcode, platform);
+
+	instruction->address = address;
+	instruction->opcode = opcode;
+	instruction->x = X;
+	instruction->y = Y;
+	instruction->size = 2;
+
+	switch (chip8_mnem_formats[op].imm) {
+		case MNEM_IMM_N:
+			instruction->operand = N;
+			break;
+		case MNEM_IMM_NN:
+			instruction->operand = NN;
+			break;
+		case MNEM_IMM_NNN:
+			instruction->operand = NNN;
+			break;
+		case MNEM_IMM_WORD:
+			if (word == NULL) {
+				// F000 without its word
+				op = CHIP8_OP_INVALID;
+				instruction->operand = opcode;
+				break;
+			}
+			instruction->operand = (uint16_t)((word[0] << 8) | word[1]);
+			instruction->size = 4;
+			break;
+		default:
+			instruction->operand = (op == CHIP8_OP_INVALID) ? opcode : 0;
+			break;
+	}
+	instruction->op = (uint8_t)op;
+}
+
+uint32_t chip8_mnem_decode(const uint8_t* program, uint32_t size, uint16_t origin, CHIP8_PLATFORM platform,
+	CHIP8_MNEM_INSTRUCTION* out, uint32_t count) {
+
+	uint32_t offset = 0;
+	uint32_t n = 0;
+	uint16_t opcode;
+
+	for (; n < count && offset < size; ++n) {
+		if (size - offset == 1) {
+			// odd byte at the end
+			out[n].address = (uint16_t)(origin + offset);
+			out[n].opcode = program[offset];
+			out[n].operand = program[offset];
+			out[n].op = CHIP8_OP_INVALID;
+			out[n].x = 0;
+			out[n].y = 0;
+			out[n].size = 1;
+			offset += 1;
+			continue;
+		}
+		opcode = (uint16_t)((program[offset] << 8) | program[offset + 1]);
+		chip8_mnem_decode_opcode(&out[n], opcode, (uint16_t)(origin + offset),
+			(size - offset >= 4) ? &program[offset + 2] : NULL, platform);
+		offset += out[n].size;
+	}
+	return n;
 }
-void chip8_mnem_FX65(uint16_t opcode, char* str) {
-	// LD VX, [I]
-	MNEM_1("LD V%X, [I]", X);
+
+uint32_t chip8_mnem_format(const CHIP8_MNEM_INSTRUCTION* instruction, char* str) {
+
+	const char* text = chip8_mnem_formats[instruction->op].text;
+	char* s = str;
+
+	if (instruction->size == 1) {
+		text = "DB 0x%i";
+	}
+	for (; *text != '\0'; ++text) {
+		if (*text != '%') {
+			*s++ = *text;
+			continue;
+		}
+		switch (*++text) {
+			case 'x':
+				*s++ = chip8_mnem_upper[instruction->x];
+				break;
+			case 'y':
+				*s++ = chip8_mnem_upper[instruction->y];
+				break;
+			default:
+				s = chip8_mnem_hex(s, instruction->operand);
+				break;
+		}
+	}
+	*s = '\0';
+	return (uint32_t)(s - str);
+}
+
+static uint32_t chip8_mnem_line(const CHIP8_MNEM_INSTRUCTION* instruction, char* line) {
+	/* AAAA  OOOO  MNEMONIC\n; returns the length */
+
+	char* s = chip8_mnem_hex4(line, instruction->address);
+	*s++ = ' ';
+	*s++ = ' ';
+	s = chip8_mnem_hex4(s, instruction->opcode);
+	if (instruction->size == 1) {
+		// one byte; blank the high digits
+		s[-4] = s[-2];
+		s[-3] = s[-1];
+		s[-2] = ' ';
+		s[-1] = ' ';
+	}
+	*s++ = ' ';
+	*s++ = ' ';
+	s += chip8_mnem_format(instruction, s);
+	*s++ = '\n';
+	return (uint32_t)(s - line);
+}
+
+uint32_t chip8_mnem_disassemble(const uint8_t* program, uint32_t size, uint16_t origin, CHIP8_PLATFORM platform,
+	char* text, uint32_t capacity, uint32_t* length) {
+
+	CHIP8_MNEM_INSTRUCTION instruction;
+	char line[CHIP8_MNEM_LINE_MAX + 1];
+	uint32_t offset = 0;
+	uint32_t used = 0;
+	uint32_t n;
+
+	while (offset < size) {
+		chip8_mnem_decode(&program[offset], size - offset, (uint16_t)(origin + offset), platform, &instruction, 1);
+		if (capacity - used > CHIP8_MNEM_LINE_MAX) {
+			// room for any line and the terminator
+			used += chip8_mnem_line(&instruction, &text[used]);
+		}
+		else {
+			n = chip8_mnem_line(&instruction, line);
+			if (capacity - used <= n) {
+				break;
+			}
+			memcpy(&text[used], line, n);
+			used += n;
+		}
+		offset += instruction.size;
+	}
+
+	if (capacity != 0) {
+		text[used] = '\0';
+	}
+	if (length != NULL) {
+		*length = used;
+	}
+	return offset;
 }
 
 void chip8_mnem_find_next(CHIP8* chip8, uint16_t* pc) {
 
-	uint16_t opcode = GET_OPCODE(PC);
+	uint16_t opcode = MEM_GET_OPCODE(chip8->platform == CHIP8_PLATFORM_XOCHIP, PC);
 	*pc = PC;
 
 	switch (opcode >> 12) {
@@ -177,7 +296,7 @@ void chip8_mnem_find_next(CHIP8* chip8, uint16_t* pc) {
 			switch (opcode & 0x00FF) {
 
 				case 0xEE: // RET
-					*pc = chip8->stack[SP];
+					*pc = chip8->stack[SP & (CHIP8_STACK_SIZE - 1)];
 					break;
 
 				default:
@@ -206,8 +325,8 @@ void chip8_mnem_find_next(CHIP8* chip8, uint16_t* pc) {
 			*pc += 2;
 			break;
 
-		case 0x5: // SE VX, VY
-			if (VX == VY)
+		case 0x5: // SE VX, VY; 5XY2 and 5XY3 do not skip on XO-CHIP
+			if (VX == VY && (chip8->platform != CHIP8_PLATFORM_XOCHIP || (N != 0x2 && N != 0x3)))
 				*pc += 2;
 			*pc += 2;
 			break;
@@ -252,6 +371,12 @@ void chip8_mnem_find_next(CHIP8* chip8, uint16_t* pc) {
 			}
 		} break;
 
+		case 0xF: // LD I, NNNN is two words long
+			if (opcode == 0xF000 && chip8->platform == CHIP8_PLATFORM_XOCHIP)
+				*pc += 2;
+			*pc += 2;
+			break;
+
 		default:
 			*pc += 2; 
 			break;
@@ -260,162 +385,24 @@ void chip8_mnem_find_next(CHIP8* chip8, uint16_t* pc) {
 
 int chip8_mnem(CHIP8* chip8, uint16_t pc, char* str) {
 
+	CHIP8_MNEM_INSTRUCTION instruction;
+	uint8_t word[2];
+	const int xo = (chip8->platform == CHIP8_PLATFORM_XOCHIP);
+
 	if (pc == 0) {
 		pc = PC;
 	}
-	
-	uint16_t opcode = GET_OPCODE(pc);
-	
-	str[0] = '\0';
+	word[0] = MEM_READ_BYTE(xo, pc + 2);
+	word[1] = MEM_READ_BYTE(xo, pc + 3);
+	chip8_mnem_decode_opcode(&instruction, MEM_GET_OPCODE(xo, pc), pc, word, (CHIP8_PLATFORM)chip8->platform);
 
-	switch (opcode >> 12) {
-
-		case 0x0: {
-			switch (opcode & 0x00FF) {
-
-				case 0xE0: // CLS
-					chip8_mnem_00E0(opcode, str);
-					break;
-				case 0xEE: // RET
-					chip8_mnem_00EE(opcode, str);
-					break;
-				default:
-					return 1;
-			}
-		} break;
-
-		case 0x1: // JMP NNN
-			chip8_mnem_1NNN(opcode, str);
-			break;
-
-		case 0x2: // CALL NNN
-			chip8_mnem_2NNN(opcode, str);
-			break;
-
-		case 0x3: // SE VX, NN
-			chip8_mnem_3XNN(opcode, str);
-			break;
-
-		case 0x4: // SNE VX, NN
-			chip8_mnem_4XNN(opcode, str);
-			break;
-
-		case 0x5: // SE VX, VY
-			chip8_mnem_5XY0(opcode, str);
-			break;
-
-		case 0x6: // LD VX, NN
-			chip8_mnem_6XNN(opcode, str);
-			break;
-
-		case 0x7: // ADD VX, NN
-			chip8_mnem_7XNN(opcode, str);
-			break;
-
-		case 0x8: {
-			switch (opcode & 0x000F) {
-
-				case 0x00: // LD VX, VY
-					chip8_mnem_8XY0(opcode, str);
-					break;
-				case 0x01: // OR VX, VY
-					chip8_mnem_8XY1(opcode, str);
-					break;
-				case 0x02: // AND VX, VY
-					chip8_mnem_8XY2(opcode, str);
-					break;
-				case 0x03: // XOR VX, VY
-					chip8_mnem_8XY3(opcode, str);
-					break;
-				case 0x04: // ADD VX, VY
-					chip8_mnem_8XY4(opcode, str);
-					break;
-				case 0x05: // SUB VX, VY
-					chip8_mnem_8XY5(opcode, str);
-					break;
-				case 0x06: // SHL VX, VY
-					chip8_mnem_8XY6(opcode, str);
-					break;
-				case 0x07: // SUBN VX, VY
-					chip8_mnem_8XY7(opcode, str);
-					break;
-				case 0x0E: // SHR VX, VY
-					chip8_mnem_8XYE(opcode, str);
-					break;
-				default:
-					return 1;
-			}
-		} break;
-
-		case 0x9: // SNE VX, VY
-			chip8_mnem_9XY0(opcode, str);
-			break;
-		case 0xA: // LD I, NNN 
-			chip8_mnem_ANNN(opcode, str);
-			break;
-		case 0xB: // JMP NNN, V0
-			chip8_mnem_BNNN(opcode, str);
-			break;
-		case 0xC: // RND VX, NN
-			chip8_mnem_CXNN(opcode, str);
-			break;
-		case 0xD: // DSP VX, VY, N
-			chip8_mnem_DXYN(opcode, str);
-			break;
-
-		case 0xE: {
-			switch (opcode & 0x00FF) {
-
-				case 0x9E: // SKP VX
-					chip8_mnem_EX9E(opcode, str);
-					break;
-				case 0xA1: // SKNP VX 
-					chip8_mnem_EXA1(opcode, str);
-					break;
-				default:
-					return 1;
-			}
-		} break;
-
-		case 0xF: {
-			switch (opcode & 0x00FF) {
-
-				case 0x07: // LD VX, DT
-					chip8_mnem_FX07(opcode, str);
-					break;
-				case 0x0A: // LD VX, KEY
-					chip8_mnem_FX0A(opcode, str);
-					break;
-				case 0x15: // LD DT, VX
-					chip8_mnem_FX15(opcode, str);
-					break;
-				case 0x18: // LD ST, VX
-					chip8_mnem_FX18(opcode, str);
-					break;
-				case 0x1E: // ADD I, VX
-					chip8_mnem_FX1E(opcode, str);
-					break;
-				case 0x29: // LD F, VX 
-					chip8_mnem_FX29(opcode, str);
-					break;
-				case 0x33: // LD B, VX
-					chip8_mnem_FX33(opcode, str);
-					break;
-				case 0x55: // LD [I], VX 
-					chip8_mnem_FX55(opcode, str);
-					break;
-				case 0x65: // LD VX, [I] 
-					chip8_mnem_FX65(opcode, str);
-					break;
-				default:
-					return 1;
-			}
-		} break;
-
-		default:
-			return 1;
+	if (instruction.op == CHIP8_OP_INVALID) {
+		str[0] = '\0';
+		return 1;
 	}
 
+	chip8_mnem_format(&instruction, str);
 	return 0;
 }
+
 #endif
@@ -12,17 +12,51 @@
 
 #ifdef CHIP8_MNEMONICS
 
+/* Longest mnemonic chip8_mnem and chip8_mnem_format write, including the terminator */
+#define CHIP8_MNEM_MAX 32
+
+/* Longest line chip8_mnem_disassemble writes, including the newline */
+#define CHIP8_MNEM_LINE_MAX (12 + CHIP8_MNEM_MAX)
+
+/* A decoded instruction; see chip8_mnem_decode */
+typedef struct CHIP8_MNEM_INSTRUCTION {
+	uint16_t address;
+	uint16_t opcode;		// the byte itself for a trailing odd byte
+	uint16_t operand;		// the immediate the mnemonic shows; N, NN, NNN, or the NNNN word of F000. 0 if none
+	uint8_t op;				// CHIP8_OP; CHIP8_OP_INVALID for data and opcodes the platform does not have
+	uint8_t x;
+	uint8_t y;
+	uint8_t size;			// bytes; 2, 4 for F000 NNNN, 1 for a trailing odd byte
+} CHIP8_MNEM_INSTRUCTION;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-/* Disassemble instruction at pc into str, if passed in pc is 0, gets pc from cpu struct */
+/* Disassemble instruction at pc into str, if passed in pc is 0, gets pc from cpu struct
+ * str must hold CHIP8_MNEM_MAX bytes. Returns 1 and an empty str if not a valid instruction on the platform */
 int chip8_mnem(CHIP8* chip8, uint16_t pc, char* str);
 
 /* Find next instruction
  * Returns the next program counter in pc */
 void chip8_mnem_find_next(CHIP8* chip8, uint16_t* pc);
 
+/* Decode up to count instructions from size bytes of program loaded at origin into out.
+ * Decoding is linear, so data between instructions decodes too, as CHIP8_OP_INVALID.
+ * Returns the number of instructions decoded; the last one ends at out[n - 1].address + size */
+uint32_t chip8_mnem_decode(const uint8_t* program, uint32_t size, uint16_t origin, CHIP8_PLATFORM platform,
+	CHIP8_MNEM_INSTRUCTION* out, uint32_t count);
+
+/* Format a decoded instruction into str, which must hold CHIP8_MNEM_MAX bytes.
+ * Data formats as DW/DB. Returns the length, not including the terminator */
+uint32_t chip8_mnem_format(const CHIP8_MNEM_INSTRUCTION* instruction, char* str);
+
+/* Disassemble size bytes of program loaded at origin into text as "AAAA  OOOO  MNEMONIC" lines.
+ * Stops before the first line that would not fit in capacity bytes with the terminator.
+ * Returns the number of program bytes disassembled; the text length is stored in length if not NULL */
+uint32_t chip8_mnem_disassemble(const uint8_t* program, uint32_t size, uint16_t origin, CHIP8_PLATFORM platform,
+	char* text, uint32_t capacity, uint32_t* length);
+
 #ifdef __cplusplus
 };
 #endif
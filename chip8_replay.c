@@ -0,0 +1,268 @@
+// chip8_replay.c
+//
+// GitHub: https:\\github.com\tommojphillips
+
+/* Stream format, little endian:
+ *   header: "C8IR", u8 version, u32 quirks, u8 platform, u64 seed, u32 FNV-1a hash of ram
+ *   events: LEB128 varint (instructions since the previous event << 2 | kind)
+ *     EVENT_TIMERS	chip8_step_timers
+ *     EVENT_KEYPAD	followed by the u16 keypad state
+ *     EVENT_END	the recording ends after these instructions; followed by the u8 cpu_state
+ *
+ * An invalid opcode stops the cpu without counting as an instruction, so the
+ * end event records whether the recording stopped on one. */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "chip8_defines.h"
+#include "chip8.h"
+#include "chip8_replay.h"
+
+#define EVENT_TIMERS	0
+#define EVENT_KEYPAD	1
+#define EVENT_END		2
+
+static const uint8_t chip8_replay_magic[4] = { 'C', '8', 'I', 'R' };
+
+static uint32_t chip8_ram_hash(const CHIP8* chip8) {
+	const uint8_t* mem = CHIP8_MEMORY(chip8);
+	uint32_t hash = 0x811C9DC5;
+	for (int i = 0; i < CHIP8_MEMORY_SIZE(chip8); ++i) {
+		hash = (hash ^ mem[i]) * 0x01000193;
+	}
+	return hash;
+}
+
+static void put_le(CHIP8_RECORDER* recorder, uint64_t value, int bytes) {
+	for (int i = 0; i < bytes; ++i) {
+		if (fputc((int)((value >> (i * 8)) & 0xFF), recorder->file) == EOF) {
+			recorder->error = 1;
+		}
+	}
+}
+static void put_varint(CHIP8_RECORDER* recorder, uint64_t value) {
+	while (value >= 0x80) {
+		if (fputc((int)((value & 0x7F) | 0x80), recorder->file) == EOF) {
+			recorder->error = 1;
+		}
+		value >>= 7;
+	}
+	if (fputc((int)value, recorder->file) == EOF) {
+		recorder->error = 1;
+	}
+}
+static uint64_t get_le(CHIP8_REPLAY* replay, int bytes) {
+	uint64_t value = 0;
+	for (int i = 0; i < bytes; ++i) {
+		int c = fgetc(replay->file);
+		if (c == EOF) {
+			replay->error = 1;
+			return 0;
+		}
+		value |= (uint64_t)c << (i * 8);
+	}
+	return value;
+}
+static uint64_t get_varint(CHIP8_REPLAY* replay) {
+	uint64_t value = 0;
+	int c;
+	for (int shift = 0; shift < 64; shift += 7) {
+		c = fgetc(replay->file);
+		if (c == EOF) {
+			replay->error = 1;
+			return 0;
+		}
+		value |= (uint64_t)(c & 0x7F) << shift;
+		if ((c & 0x80) == 0) {
+			return value;
+		}
+	}
+	replay->error = 1;
+	return 0;
+}
+
+/* RECORD */
+
+static void chip8_record_event(CHIP8_RECORDER* recorder, uint8_t kind) {
+	put_varint(recorder, ((recorder->instructions - recorder->event_at) << 2) | kind);
+	recorder->event_at = recorder->instructions;
+}
+
+int chip8_record_begin(CHIP8_RECORDER* recorder, FILE* file, CHIP8* chip8, uint64_t seed) {
+	recorder->file = file;
+	recorder->instructions = 0;
+	recorder->event_at = 0;
+	recorder->keypad = chip8->keypad;
+	recorder->error = 0;
+
+	chip8_seed_random(chip8, seed);
+
+	if (fwrite(chip8_replay_magic, 1, sizeof(chip8_replay_magic), file) != sizeof(chip8_replay_magic)) {
+		recorder->error = 1;
+	}
+	put_le(recorder, CHIP8_REPLAY_VERSION, 1);
+	put_le(recorder, chip8->quirks, 4);
+	put_le(recorder, chip8->platform, 1);
+	put_le(recorder, seed, 8);
+	put_le(recorder, chip8_ram_hash(chip8), 4);
+
+	/* the keypad state at the start is the first event */
+	chip8_record_event(recorder, EVENT_KEYPAD);
+	put_le(recorder, chip8->keypad, 2);
+	return recorder->error;
+}
+void chip8_record_set_keypad(CHIP8_RECORDER* recorder, CHIP8* chip8, uint16_t keypad) {
+	chip8_set_keypad(chip8, keypad);
+	if (keypad != recorder->keypad) {
+		recorder->keypad = keypad;
+		chip8_record_event(recorder, EVENT_KEYPAD);
+		put_le(recorder, keypad, 2);
+	}
+}
+void chip8_record_step_timers(CHIP8_RECORDER* recorder, CHIP8* chip8) {
+	chip8_step_timers(chip8);
+	chip8_record_event(recorder, EVENT_TIMERS);
+}
+CHIP8_RUN_EXIT chip8_record_run(CHIP8_RECORDER* recorder, CHIP8* chip8, uint32_t max_instructions, uint32_t* executed) {
+	uint32_t count = 0;
+	CHIP8_RUN_EXIT exit = chip8_run(chip8, max_instructions, &count);
+
+	recorder->instructions += count;
+	if (executed != NULL) {
+		*executed = count;
+	}
+	return exit;
+}
+int chip8_record_end(CHIP8_RECORDER* recorder, const CHIP8* chip8) {
+	chip8_record_event(recorder, EVENT_END);
+	put_le(recorder, chip8->cpu_state, 1);
+	if (fflush(recorder->file) != 0) {
+		recorder->error = 1;
+	}
+	return recorder->error;
+}
+
+/* REPLAY */
+
+static void chip8_replay_next(CHIP8_REPLAY* replay) {
+	/* Read the next event */
+	uint64_t tag = get_varint(replay);
+
+	replay->event_at += tag >> 2;
+	replay->kind = (uint8_t)(tag & 0x3);
+	if (replay->kind == EVENT_KEYPAD) {
+		replay->keypad = (uint16_t)get_le(replay, 2);
+	}
+	else if (replay->kind == EVENT_END) {
+		replay->cpu_state = (uint8_t)get_le(replay, 1);
+	}
+	if (replay->error) {
+		/* truncated; replay what was read */
+		replay->kind = EVENT_END;
+		replay->event_at = replay->instructions;
+		replay->cpu_state = CHIP8_STATE_EXE;
+	}
+}
+
+int chip8_replay_begin(CHIP8_REPLAY* replay, FILE* file, CHIP8* chip8) {
+	uint8_t magic[4];
+	uint32_t hash;
+
+	replay->file = file;
+	replay->instructions = 0;
+	replay->event_at = 0;
+	replay->done = 0;
+	replay->error = 0;
+
+	if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+		magic[0] != chip8_replay_magic[0] || magic[1] != chip8_replay_magic[1] ||
+		magic[2] != chip8_replay_magic[2] || magic[3] != chip8_replay_magic[3] ||
+		get_le(replay, 1) != CHIP8_REPLAY_VERSION) {
+		replay->error = 1;
+		replay->done = 1;
+		return 1;
+	}
+	replay->quirks = (uint32_t)get_le(replay, 4);
+	replay->platform = (uint8_t)get_le(replay, 1);
+	replay->seed = get_le(replay, 8);
+	hash = (uint32_t)get_le(replay, 4);
+	if (replay->error) {
+		replay->done = 1;
+		return 1;
+	}
+	if (chip8->platform != replay->platform) {
+		/* the SCHIP font is part of the hashed ram; XO-CHIP starts from zeroed memory */
+		if (chip8_set_platform(chip8, (CHIP8_PLATFORM)replay->platform) != 0) {
+			replay->done = 1;
+			return 2;
+		}
+	}
+	if (hash != chip8_ram_hash(chip8)) {
+		replay->done = 1;
+		return 2;
+	}
+
+	chip8_set_quirks(chip8, replay->quirks);
+	chip8_seed_random(chip8, replay->seed);
+	chip8_replay_next(replay);
+	return 0;
+}
+
+CHIP8_RUN_EXIT chip8_replay_run(CHIP8_REPLAY* replay, CHIP8* chip8, uint32_t max_instructions, uint32_t* executed) {
+	CHIP8_RUN_EXIT exit = CHIP8_RUN_EXIT_COMPLETE;
+	uint32_t total = 0;
+
+	while (!replay->done) {
+		uint32_t budget = max_instructions - total;
+		uint32_t count = 0;
+
+		/* apply events due before the next instruction */
+		while (replay->event_at == replay->instructions) {
+			if (replay->kind == EVENT_END) {
+				if (replay->cpu_state == CHIP8_STATE_ERROR_OPCODE) {
+					/* step into the invalid opcode the recording stopped on */
+					exit = chip8_run(chip8, 1, NULL);
+				}
+				replay->done = 1;
+				break;
+			}
+			if (replay->kind == EVENT_KEYPAD) {
+				chip8_set_keypad(chip8, replay->keypad);
+			}
+			else {
+				chip8_step_timers(chip8);
+			}
+			chip8_replay_next(replay);
+		}
+		if (replay->done || budget == 0) {
+			break;
+		}
+
+		if (replay->event_at - replay->instructions < budget) {
+			budget = (uint32_t)(replay->event_at - replay->instructions);
+		}
+		exit = chip8_run(chip8, budget, &count);
+		total += count;
+		replay->instructions += count;
+
+		if (exit == CHIP8_RUN_EXIT_ERROR || exit == CHIP8_RUN_EXIT_HALT) {
+			break;
+		}
+		if (count == 0 && exit != CHIP8_RUN_EXIT_COMPLETE) {
+			/* stuck with no event due; the recording does not match, so running again would spin */
+			break;
+		}
+		exit = CHIP8_RUN_EXIT_COMPLETE;
+	}
+
+	if (executed != NULL) {
+		*executed = total;
+	}
+	return exit;
+}
+
+int chip8_replay_done(const CHIP8_REPLAY* replay) {
+	return replay->done;
+}
@@ -0,0 +1,92 @@
+// chip8_replay.h
+//
+// GitHub: https:\\github.com\tommojphillips
+
+#ifndef CHIP8_REPLAY_H
+#define CHIP8_REPLAY_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "chip8_defines.h"
+#include "chip8.h"
+
+#define CHIP8_REPLAY_VERSION 2
+
+/* Input recording and replay.
+ *
+ * A recording holds the quirks, platform, rng seed and a hash of ram at
+ * the start, then a stream of keypad changes and timer steps, each tagged
+ * with the number of instructions executed before it. Since the machine only sees
+ * the keypad and timers through instructions, replaying the events at the
+ * same counts reproduces the run exactly. Start recording and replay from
+ * the same state, e.g. right after chip8_init_cpu() and
+ * chip8_load_program(). Not deterministic with CHIP8_RANDOM_HOOK.
+ *
+ * Both sides stream through a FILE*, so memory use does not grow with the
+ * length of the session. */
+
+/* Chip8 recorder */
+typedef struct {
+	FILE* file;
+	uint64_t instructions;	// instructions executed since chip8_record_begin
+	uint64_t event_at;		// instruction count of the last event written
+	uint16_t keypad;		// keypad state last written
+	uint8_t error;			// a write failed
+} CHIP8_RECORDER;
+
+/* Chip8 replay */
+typedef struct {
+	FILE* file;
+	uint64_t instructions;	// instructions executed since chip8_replay_begin
+	uint64_t event_at;		// instruction count of the pending event
+	uint32_t quirks;
+	uint8_t platform;		// CHIP8_PLATFORM
+	uint64_t seed;
+	uint16_t keypad;		// keypad of the pending event
+	uint8_t kind;			// pending event kind
+	uint8_t cpu_state;		// cpu state at the end of the recording
+	uint8_t done;			// end of the recording reached
+	uint8_t error;			// the stream is truncated or malformed
+} CHIP8_REPLAY;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Start recording chip8 to file. Seeds chip8's random generator with seed.
+// Returns 0 on success
+int chip8_record_begin(CHIP8_RECORDER* recorder, FILE* file, CHIP8* chip8, uint64_t seed);
+
+// Set the keypad state and record the change
+void chip8_record_set_keypad(CHIP8_RECORDER* recorder, CHIP8* chip8, uint16_t keypad);
+
+// Step timers and record the step
+void chip8_record_step_timers(CHIP8_RECORDER* recorder, CHIP8* chip8);
+
+// chip8_run, counting the instructions executed
+CHIP8_RUN_EXIT chip8_record_run(CHIP8_RECORDER* recorder, CHIP8* chip8, uint32_t max_instructions, uint32_t* executed);
+
+// Write the end of the recording and flush the file. The file is not closed.
+// Returns 0 if every write succeeded
+int chip8_record_end(CHIP8_RECORDER* recorder, const CHIP8* chip8);
+
+// Start replaying a recording from file into chip8; sets the platform and quirks and seeds the random generator.
+// Select the platform before loading the program; an XO-CHIP recording hashes all 64 KB and needs chip8->xo.
+// Returns 0 on success, 1 if the header is invalid, 2 if chip8's ram does not match the recording
+int chip8_replay_begin(CHIP8_REPLAY* replay, FILE* file, CHIP8* chip8);
+
+// Execute up to max_instructions, applying recorded keypad changes and timer steps as they fall due.
+// Draw and FX0A exits do not stop a replay; it stops at max_instructions, an opcode error or the
+// end of the recording. An exit with nothing executed and no event due means the recording does
+// not match chip8, and is returned rather than retried.
+// The number of instructions executed is stored in executed if not NULL.
+CHIP8_RUN_EXIT chip8_replay_run(CHIP8_REPLAY* replay, CHIP8* chip8, uint32_t max_instructions, uint32_t* executed);
+
+// Returns 1 once the end of the recording has been reached
+int chip8_replay_done(const CHIP8_REPLAY* replay);
+
+#ifdef __cplusplus
+};
+#endif
+#endif
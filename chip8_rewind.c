@@ -0,0 +1,234 @@
+// chip8_rewind.c
+//
+// GitHub: https:\\github.com\tommojphillips
+
+/* A delta is stored in the ring as [u16 length][runs][u16 length]; the
+ * leading length lets the oldest delta be dropped, the trailing one lets
+ * the newest be popped. Runs are pairs of LEB128 varints, zero bytes to skip
+ * then literal XOR bytes to follow, repeated until the skips reach the end of
+ * the snapshot. Zero gaps shorter than MIN_ZERO_RUN stay in the literal. */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "chip8_defines.h"
+#include "chip8.h"
+#include "chip8_snapshot.h"
+#include "chip8_rewind.h"
+
+#define STATE_BYTES		((uint32_t)sizeof(CHIP8_SNAPSHOT))
+#define MIN_ZERO_RUN	3
+#define LENGTH_BYTES	2
+
+static uint32_t put_varint(uint8_t* out, uint32_t value) {
+	uint32_t n = 0;
+	while (value >= 0x80) {
+		out[n++] = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	out[n++] = (uint8_t)value;
+	return n;
+}
+static uint32_t get_varint(const uint8_t* in, uint32_t* value) {
+	uint32_t n = 0;
+	uint32_t shift = 0;
+	*value = 0;
+	do {
+		*value |= (uint32_t)(in[n] & 0x7F) << shift;
+		shift += 7;
+	} while (in[n++] & 0x80);
+	return n;
+}
+
+static uint32_t chip8_rewind_encode(uint8_t* out, const uint8_t* a, const uint8_t* b) {
+	/* Encode a ^ b as runs; returns the encoded size */
+	uint32_t n = 0;
+	uint32_t pos = 0;
+
+	for (;;) {
+		uint32_t start = pos;
+		uint32_t end;
+		uint32_t zeros;
+
+		/* skip zero bytes, a word at a time where aligned */
+		while (pos < STATE_BYTES && (pos & 7) != 0 && a[pos] == b[pos]) {
+			pos++;
+		}
+		while (pos + 8 <= STATE_BYTES) {
+			uint64_t wa, wb;
+			memcpy(&wa, a + pos, 8);
+			memcpy(&wb, b + pos, 8);
+			if (wa != wb) {
+				break;
+			}
+			pos += 8;
+		}
+		while (pos < STATE_BYTES && a[pos] == b[pos]) {
+			pos++;
+		}
+
+		n += put_varint(out + n, pos - start);
+		if (pos == STATE_BYTES) {
+			return n;
+		}
+
+		/* literal until MIN_ZERO_RUN zero bytes or the end */
+		end = pos;
+		zeros = 0;
+		while (end < STATE_BYTES && zeros < MIN_ZERO_RUN) {
+			zeros = (a[end] == b[end]) ? zeros + 1 : 0;
+			end++;
+		}
+		end -= zeros;
+
+		n += put_varint(out + n, end - pos);
+		while (pos < end) {
+			out[n++] = a[pos] ^ b[pos];
+			pos++;
+		}
+	}
+}
+
+static void chip8_rewind_decode(uint8_t* state, const uint8_t* in) {
+	/* XOR the runs into state */
+	uint32_t pos = 0;
+	uint32_t value;
+
+	for (;;) {
+		in += get_varint(in, &value);
+		pos += value;
+		if (pos >= STATE_BYTES) {
+			return;
+		}
+		in += get_varint(in, &value);
+		while (value--) {
+			state[pos++] ^= *in++;
+		}
+	}
+}
+
+static void ring_write(CHIP8_REWIND* rewind, uint32_t offset, const uint8_t* src, uint32_t size) {
+	uint32_t first = rewind->size - offset;
+	if (first > size) {
+		first = size;
+	}
+	memcpy(rewind->buffer + offset, src, first);
+	memcpy(rewind->buffer, src + first, size - first);
+}
+static void ring_read(const CHIP8_REWIND* rewind, uint32_t offset, uint8_t* dst, uint32_t size) {
+	uint32_t first = rewind->size - offset;
+	if (first > size) {
+		first = size;
+	}
+	memcpy(dst, rewind->buffer + offset, first);
+	memcpy(dst + first, rewind->buffer, size - first);
+}
+static uint32_t ring_offset(const CHIP8_REWIND* rewind, uint32_t offset, int32_t delta) {
+	/* offset + delta wrapped into the ring */
+	int64_t r = ((int64_t)offset + delta) % rewind->size;
+	return (uint32_t)(r < 0 ? r + rewind->size : r);
+}
+static uint32_t ring_length(const CHIP8_REWIND* rewind, uint32_t offset) {
+	uint8_t length[LENGTH_BYTES];
+	ring_read(rewind, offset, length, LENGTH_BYTES);
+	return length[0] | (length[1] << 8);
+}
+
+static void chip8_rewind_drop_oldest(CHIP8_REWIND* rewind) {
+	uint32_t tail = ring_offset(rewind, rewind->head, -(int32_t)rewind->used);
+	rewind->used -= ring_length(rewind, tail) + LENGTH_BYTES * 2;
+	rewind->frames--;
+}
+
+void chip8_rewind_init(CHIP8_REWIND* rewind, uint8_t* buffer, uint32_t size) {
+	rewind->buffer = buffer;
+	rewind->size = size;
+	memset(&rewind->state, 0, sizeof(rewind->state));
+	memset(&rewind->next, 0, sizeof(rewind->next));
+	chip8_rewind_clear(rewind);
+}
+void chip8_rewind_clear(CHIP8_REWIND* rewind) {
+	rewind->head = 0;
+	rewind->used = 0;
+	rewind->frames = 0;
+}
+
+int chip8_rewind_push(CHIP8_REWIND* rewind, const CHIP8* chip8) {
+	CHIP8_SNAPSHOT* next = &rewind->next;
+	uint32_t length;
+	uint32_t record;
+	uint8_t header[LENGTH_BYTES];
+
+	if (chip8_snapshot_full(chip8, next) != 0) {
+		return 2;
+	}
+
+	if (rewind->frames == 0) {
+		memcpy(&rewind->state, next, sizeof(CHIP8_SNAPSHOT));
+		rewind->frames = 1;
+		return 0;
+	}
+
+	length = chip8_rewind_encode(rewind->delta, (const uint8_t*)&rewind->state, (const uint8_t*)next);
+	memcpy(&rewind->state, next, sizeof(CHIP8_SNAPSHOT));
+
+	record = length + LENGTH_BYTES * 2;
+	if (record > rewind->size) {
+		/* does not fit at all; history restarts here */
+		chip8_rewind_clear(rewind);
+		rewind->frames = 1;
+		return 0;
+	}
+	while (rewind->size - rewind->used < record) {
+		chip8_rewind_drop_oldest(rewind);
+	}
+
+	header[0] = (uint8_t)length;
+	header[1] = (uint8_t)(length >> 8);
+	ring_write(rewind, rewind->head, header, LENGTH_BYTES);
+	ring_write(rewind, ring_offset(rewind, rewind->head, LENGTH_BYTES), rewind->delta, length);
+	ring_write(rewind, ring_offset(rewind, rewind->head, LENGTH_BYTES + length), header, LENGTH_BYTES);
+	rewind->head = ring_offset(rewind, rewind->head, record);
+	rewind->used += record;
+	rewind->frames++;
+	return 0;
+}
+
+int chip8_rewind_step_back(CHIP8_REWIND* rewind, CHIP8* chip8) {
+	uint32_t length;
+	uint32_t start;
+	int result;
+
+	if (rewind->frames == 0) {
+		return 1;
+	}
+	if (rewind->frames == 1) {
+		result = chip8_restore(chip8, &rewind->state, NULL);
+		return (result != 0) ? result : 1;
+	}
+
+	length = ring_length(rewind, ring_offset(rewind, rewind->head, -LENGTH_BYTES));
+	start = ring_offset(rewind, rewind->head, -(int32_t)(length + LENGTH_BYTES));
+	ring_read(rewind, start, rewind->delta, length);
+	chip8_rewind_decode((uint8_t*)&rewind->state, rewind->delta);
+
+	result = chip8_restore(chip8, &rewind->state, NULL);
+	if (result != 0) {
+		/* XOR the delta back out; the frame stays held */
+		chip8_rewind_decode((uint8_t*)&rewind->state, rewind->delta);
+		return result;
+	}
+
+	rewind->head = ring_offset(rewind, rewind->head, -(int32_t)(length + LENGTH_BYTES * 2));
+	rewind->used -= length + LENGTH_BYTES * 2;
+	rewind->frames--;
+	return 0;
+}
+
+uint32_t chip8_rewind_get_frames(const CHIP8_REWIND* rewind) {
+	return rewind->frames;
+}
+uint32_t chip8_rewind_get_used(const CHIP8_REWIND* rewind) {
+	return rewind->used;
+}
@@ -0,0 +1,64 @@
+// chip8_rewind.h
+//
+// GitHub: https:\\github.com\tommojphillips
+
+#ifndef CHIP8_REWIND_H
+#define CHIP8_REWIND_H
+
+#include <stdint.h>
+
+#include "chip8_defines.h"
+#include "chip8.h"
+#include "chip8_snapshot.h"
+
+/* Largest encoded delta; XOR runs of a whole snapshot plus run headers */
+#define CHIP8_REWIND_MAX_DELTA (sizeof(CHIP8_SNAPSHOT) * 2)
+
+/* Chip8 rewind buffer.
+ *
+ * Keeps the newest pushed state as a snapshot and, in a caller supplied
+ * byte ring, one delta per older frame: the XOR of a frame's snapshot with
+ * the next one, run length encoded. Stepping back XORs the newest delta
+ * into the state, so cost depends on what changed in that frame. When the
+ * ring is full the oldest frames are dropped. */
+typedef struct {
+	uint8_t* buffer;		// delta ring
+	uint32_t size;			// ring bytes; the memory budget
+	uint32_t head;			// offset the next delta is written at
+	uint32_t used;			// ring bytes in use; the oldest delta starts at head - used
+	uint32_t frames;		// states held, including state
+	CHIP8_SNAPSHOT state;	// newest state
+	CHIP8_SNAPSHOT next;	// scratch for the state being pushed
+	uint8_t delta[CHIP8_REWIND_MAX_DELTA]; // scratch for the encoded delta
+} CHIP8_REWIND;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Initialize a rewind buffer using size bytes of buffer for deltas
+void chip8_rewind_init(CHIP8_REWIND* rewind, uint8_t* buffer, uint32_t size);
+
+// Drop all frames
+void chip8_rewind_clear(CHIP8_REWIND* rewind);
+
+// Push the state of chip8 as the newest frame; call once per frame.
+// Returns 0 on success, 2 without pushing if chip8 is XO-CHIP; see chip8_snapshot
+int chip8_rewind_push(CHIP8_REWIND* rewind, const CHIP8* chip8);
+
+// Step back one frame and restore it into chip8. At the oldest frame chip8 is restored
+// to it and 1 is returned; returns 1 without touching chip8 if no frames are held.
+// If chip8_restore refuses chip8, returns its error with every frame still held.
+// All of ram is restored; call chip8_jit_flush when using the jit
+int chip8_rewind_step_back(CHIP8_REWIND* rewind, CHIP8* chip8);
+
+// Number of frames held
+uint32_t chip8_rewind_get_frames(const CHIP8_REWIND* rewind);
+
+// Ring bytes in use
+uint32_t chip8_rewind_get_used(const CHIP8_REWIND* rewind);
+
+#ifdef __cplusplus
+};
+#endif
+#endif
@@ -0,0 +1,530 @@
+// chip8_runner.c
+//
+// GitHub: https:\\github.com\tommojphillips
+
+/* Multi-core runner. Each frame the calling thread queues one slice per
+ * instance, round robin over per-thread Chase-Lev deques, then wakes the
+ * workers and works alongside them. A thread pops slices from the bottom
+ * of its own deque and, when it is empty, steals from the top of the
+ * others. The frame ends when every slice has run.
+ *
+ * Deques are refilled only between frames while every worker is parked,
+ * so they never grow and the owner never pushes concurrently with steals. */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // sysconf(_SC_NPROCESSORS_ONLN)
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8_defines.h"
+#include "chip8.h"
+#include "chip8_runner.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <malloc.h> // _aligned_malloc
+typedef HANDLE CHIP8_THREAD;
+typedef SRWLOCK CHIP8_MUTEX;
+typedef CONDITION_VARIABLE CHIP8_COND;
+#define MUTEX_INIT(m)		InitializeSRWLock(m)
+#define MUTEX_DESTROY(m)
+#define MUTEX_LOCK(m)		AcquireSRWLockExclusive(m)
+#define MUTEX_UNLOCK(m)		ReleaseSRWLockExclusive(m)
+#define COND_INIT(c)		InitializeConditionVariable(c)
+#define COND_DESTROY(c)
+#define COND_WAIT(c, m)		SleepConditionVariableSRW(c, m, INFINITE, 0)
+#define COND_SIGNAL(c)		WakeConditionVariable(c)
+#define COND_BROADCAST(c)	WakeAllConditionVariable(c)
+#define THREAD_YIELD()		SwitchToThread()
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+typedef pthread_t CHIP8_THREAD;
+typedef pthread_mutex_t CHIP8_MUTEX;
+typedef pthread_cond_t CHIP8_COND;
+#define MUTEX_INIT(m)		pthread_mutex_init(m, NULL)
+#define MUTEX_DESTROY(m)	pthread_mutex_destroy(m)
+#define MUTEX_LOCK(m)		pthread_mutex_lock(m)
+#define MUTEX_UNLOCK(m)		pthread_mutex_unlock(m)
+#define COND_INIT(c)		pthread_cond_init(c, NULL)
+#define COND_DESTROY(c)		pthread_cond_destroy(c)
+#define COND_WAIT(c, m)		pthread_cond_wait(c, m)
+#define COND_SIGNAL(c)		pthread_cond_signal(c)
+#define COND_BROADCAST(c)	pthread_cond_broadcast(c)
+#define THREAD_YIELD()		sched_yield()
+#endif
+
+/* Atomics; only the deque indices and the remaining slice count are shared without the lock */
+#ifdef _MSC_VER
+#include <intrin.h>
+#define ATOMIC_LOAD(p)			(_ReadWriteBarrier(), *(volatile int64_t*)(p))
+#define ATOMIC_STORE(p, v)		(_ReadWriteBarrier(), *(volatile int64_t*)(p) = (v))
+#define ATOMIC_CAS(p, e, d)		(_InterlockedCompareExchange64((volatile int64_t*)(p), (d), (e)) == (e))
+#define ATOMIC_ADD(p, v)		_InterlockedExchangeAdd64((volatile int64_t*)(p), (v))
+#define ATOMIC_FENCE()			MemoryBarrier()
+#define CPU_RELAX()				YieldProcessor()
+#else
+static inline int atomic_cas(int64_t* p, int64_t e, int64_t d) {
+	return __atomic_compare_exchange_n(p, &e, d, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+#define ATOMIC_LOAD(p)			__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE(p, v)		__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define ATOMIC_CAS(p, e, d)		atomic_cas((p), (e), (d))
+#define ATOMIC_ADD(p, v)		__atomic_fetch_add((p), (v), __ATOMIC_ACQ_REL)
+#define ATOMIC_FENCE()			__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#if defined(__x86_64__) || defined(__i386__)
+#define CPU_RELAX()				__builtin_ia32_pause()
+#else
+#define CPU_RELAX()
+#endif
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define CACHE_ALIGN __declspec(align(64))
+#else
+#define CACHE_ALIGN __attribute__((aligned(64)))
+#endif
+#define CACHE_LINE 64
+
+#define DEQUE_EMPTY		-1
+#define DEQUE_ABORT		-2
+
+#define SPINS_BEFORE_YIELD	64
+
+/* Work-stealing deque of instance indices; one per thread, on its own cache lines */
+typedef struct {
+	CACHE_ALIGN int64_t top;	// next slot to steal
+	CACHE_ALIGN int64_t bottom;	// next slot to push
+	uint32_t* slots;
+	uint32_t mask;
+
+	/* per-thread counters; summed after each frame */
+	uint64_t instructions;
+	uint64_t slices;
+	uint64_t steals;
+	uint32_t seed;				// victim selection
+} CHIP8_RUNNER_WORKER;
+
+struct CHIP8_RUNNER {
+	CHIP8* instances;
+	uint32_t count;
+	uint32_t threads;
+	uint32_t instructions_per_frame;
+
+	CHIP8_RUNNER_WORKER* workers;
+	CHIP8_THREAD* handles;
+
+	CACHE_ALIGN int64_t remaining;	// slices left this frame
+
+	CHIP8_MUTEX lock;
+	CHIP8_COND start;		// new frame or quit
+	CHIP8_COND done;		// worker finished its frame
+	uint64_t generation;	// frame number; workers run a frame when it changes
+	uint32_t finished;		// workers done with the current frame
+	uint8_t quit;
+
+	CHIP8_RUNNER_STATS stats;
+};
+
+typedef struct {
+	CHIP8_RUNNER* runner;
+	uint32_t index;
+} CHIP8_RUNNER_ARG;
+
+static double chip8_runner_time(void) {
+	/* Monotonic time in seconds */
+#ifdef _WIN32
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (double)now.QuadPart / (double)freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+static uint32_t chip8_runner_cpu_count(void) {
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (uint32_t)n : 1;
+#endif
+}
+
+static void chip8_deque_push(CHIP8_RUNNER_WORKER* w, uint32_t index) {
+	/* Owner only; called between frames */
+	int64_t b = w->bottom;
+	w->slots[b & w->mask] = index;
+	ATOMIC_STORE(&w->bottom, b + 1);
+}
+
+static int64_t chip8_deque_take(CHIP8_RUNNER_WORKER* w) {
+	/* Owner only; pop from the bottom */
+	int64_t b = w->bottom - 1;
+	int64_t t;
+	int64_t x;
+
+	ATOMIC_STORE(&w->bottom, b);
+	ATOMIC_FENCE();
+	t = ATOMIC_LOAD(&w->top);
+
+	if (t > b) {
+		ATOMIC_STORE(&w->bottom, b + 1);
+		return DEQUE_EMPTY;
+	}
+
+	x = w->slots[b & w->mask];
+	if (t == b) {
+		/* last slot; race thieves for it */
+		if (!ATOMIC_CAS(&w->top, t, t + 1)) {
+			x = DEQUE_EMPTY;
+		}
+		ATOMIC_STORE(&w->bottom, b + 1);
+	}
+	return x;
+}
+
+static int64_t chip8_deque_steal(CHIP8_RUNNER_WORKER* w) {
+	/* Any thread; take from the top */
+	int64_t t = ATOMIC_LOAD(&w->top);
+	int64_t b;
+	int64_t x;
+
+	ATOMIC_FENCE();
+	b = ATOMIC_LOAD(&w->bottom);
+	if (t >= b) {
+		return DEQUE_EMPTY;
+	}
+
+	x = w->slots[t & w->mask];
+	if (!ATOMIC_CAS(&w->top, t, t + 1)) {
+		return DEQUE_ABORT;
+	}
+	return x;
+}
+
+static void chip8_runner_slice(CHIP8_RUNNER* runner, CHIP8_RUNNER_WORKER* w, uint32_t index) {
+	/* Run one frame of an instance. A slice ends early on draw wait, FX0A or
+	 * opcode error; none of those can progress before the next frame */
+	CHIP8* chip8 = &runner->instances[index];
+	uint32_t executed = 0;
+
+	chip8_run(chip8, runner->instructions_per_frame, &executed);
+	chip8_step_timers(chip8);
+
+	w->instructions += executed;
+	w->slices++;
+}
+
+static int64_t chip8_runner_steal(CHIP8_RUNNER* runner, uint32_t self) {
+	/* Try every other thread once, starting from a random victim */
+	CHIP8_RUNNER_WORKER* w = &runner->workers[self];
+	uint32_t start;
+	int64_t x;
+
+	w->seed ^= w->seed << 13;
+	w->seed ^= w->seed >> 17;
+	w->seed ^= w->seed << 5;
+	start = w->seed % runner->threads;
+
+	for (uint32_t n = 0; n < runner->threads; ++n) {
+		uint32_t victim = (start + n) % runner->threads;
+		if (victim == self) {
+			continue;
+		}
+		do {
+			x = chip8_deque_steal(&runner->workers[victim]);
+		} while (x == DEQUE_ABORT);
+		if (x >= 0) {
+			return x;
+		}
+	}
+	return DEQUE_EMPTY;
+}
+
+static void chip8_runner_work(CHIP8_RUNNER* runner, uint32_t self) {
+	/* Run slices until every slice of the frame is done */
+	CHIP8_RUNNER_WORKER* w = &runner->workers[self];
+	uint32_t spins = 0;
+	int64_t x;
+
+	for (;;) {
+		x = chip8_deque_take(w);
+		if (x < 0) {
+			x = chip8_runner_steal(runner, self);
+			if (x >= 0) {
+				w->steals++;
+			}
+		}
+
+		if (x >= 0) {
+			chip8_runner_slice(runner, w, (uint32_t)x);
+			ATOMIC_ADD(&runner->remaining, -1);
+			spins = 0;
+			continue;
+		}
+
+		/* nothing to take; slices may still be running on other threads */
+		if (ATOMIC_LOAD(&runner->remaining) == 0) {
+			break;
+		}
+		if (++spins < SPINS_BEFORE_YIELD) {
+			CPU_RELAX();
+		}
+		else {
+			THREAD_YIELD();
+		}
+	}
+}
+
+#ifdef _WIN32
+static DWORD WINAPI chip8_runner_thread(LPVOID param) {
+#else
+static void* chip8_runner_thread(void* param) {
+#endif
+	CHIP8_RUNNER_ARG* arg = (CHIP8_RUNNER_ARG*)param;
+	CHIP8_RUNNER* runner = arg->runner;
+	uint32_t self = arg->index;
+	uint64_t seen = 0;
+
+	free(arg);
+
+	for (;;) {
+		MUTEX_LOCK(&runner->lock);
+		while (runner->generation == seen && !runner->quit) {
+			COND_WAIT(&runner->start, &runner->lock);
+		}
+		seen = runner->generation;
+		if (runner->quit) {
+			MUTEX_UNLOCK(&runner->lock);
+			break;
+		}
+		MUTEX_UNLOCK(&runner->lock);
+
+		chip8_runner_work(runner, self);
+
+		MUTEX_LOCK(&runner->lock);
+		if (++runner->finished == runner->threads - 1) {
+			COND_SIGNAL(&runner->done);
+		}
+		MUTEX_UNLOCK(&runner->lock);
+	}
+	return 0;
+}
+
+static int chip8_runner_spawn(CHIP8_RUNNER* runner, uint32_t index) {
+	/* Start worker thread index; returns 0 on success */
+	CHIP8_RUNNER_ARG* arg = (CHIP8_RUNNER_ARG*)malloc(sizeof(CHIP8_RUNNER_ARG));
+	if (arg == NULL) {
+		return 1;
+	}
+	arg->runner = runner;
+	arg->index = index;
+
+#ifdef _WIN32
+	runner->handles[index] = CreateThread(NULL, 0, chip8_runner_thread, arg, 0, NULL);
+	if (runner->handles[index] == NULL) {
+		free(arg);
+		return 1;
+	}
+#else
+	if (pthread_create(&runner->handles[index], NULL, chip8_runner_thread, arg) != 0) {
+		free(arg);
+		return 1;
+	}
+#endif
+	return 0;
+}
+
+static void chip8_runner_join(CHIP8_RUNNER* runner, uint32_t spawned) {
+	/* Stop and join worker threads 1 to spawned - 1 */
+	MUTEX_LOCK(&runner->lock);
+	runner->quit = 1;
+	COND_BROADCAST(&runner->start);
+	MUTEX_UNLOCK(&runner->lock);
+
+	for (uint32_t n = 1; n < spawned; ++n) {
+#ifdef _WIN32
+		WaitForSingleObject(runner->handles[n], INFINITE);
+		CloseHandle(runner->handles[n]);
+#else
+		pthread_join(runner->handles[n], NULL);
+#endif
+	}
+}
+
+static void* chip8_runner_alloc(size_t size) {
+	/* Zeroed memory on a cache line; calloc only promises the alignment of
+	 * a double, which leaves CACHE_ALIGN members sharing lines */
+	void* p;
+	size = (size + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1); // aligned_alloc wants a multiple of the alignment
+#ifdef _WIN32
+	p = _aligned_malloc(size, CACHE_LINE);
+#else
+	p = aligned_alloc(CACHE_LINE, size);
+#endif
+	if (p != NULL) {
+		memset(p, 0, size);
+	}
+	return p;
+}
+static void chip8_runner_release(void* p) {
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+static void chip8_runner_free(CHIP8_RUNNER* runner) {
+	if (runner->workers != NULL) {
+		for (uint32_t n = 0; n < runner->threads; ++n) {
+			free(runner->workers[n].slots);
+		}
+	}
+	chip8_runner_release(runner->workers);
+	free(runner->handles);
+	COND_DESTROY(&runner->start);
+	COND_DESTROY(&runner->done);
+	MUTEX_DESTROY(&runner->lock);
+	chip8_runner_release(runner);
+}
+
+CHIP8_RUNNER* chip8_runner_create(CHIP8* instances, uint32_t count, uint32_t threads) {
+	CHIP8_RUNNER* runner;
+	uint32_t capacity;
+
+	if (instances == NULL || count == 0) {
+		return NULL;
+	}
+
+	if (threads == 0) {
+		threads = chip8_runner_cpu_count();
+	}
+	if (threads > CHIP8_RUNNER_MAX_THREADS) {
+		threads = CHIP8_RUNNER_MAX_THREADS;
+	}
+	if (threads > count) {
+		threads = count;
+	}
+
+	runner = (CHIP8_RUNNER*)chip8_runner_alloc(sizeof(CHIP8_RUNNER));
+	if (runner == NULL) {
+		return NULL;
+	}
+	runner->instances = instances;
+	runner->count = count;
+	runner->threads = threads;
+
+	MUTEX_INIT(&runner->lock);
+	COND_INIT(&runner->start);
+	COND_INIT(&runner->done);
+
+	/* a deque holds at most its share of one frame */
+	capacity = 1;
+	while (capacity < (count + threads - 1) / threads) {
+		capacity <<= 1;
+	}
+
+	runner->workers = (CHIP8_RUNNER_WORKER*)chip8_runner_alloc(threads * sizeof(CHIP8_RUNNER_WORKER));
+	runner->handles = (CHIP8_THREAD*)calloc(threads, sizeof(CHIP8_THREAD));
+	if (runner->workers == NULL || runner->handles == NULL) {
+		chip8_runner_free(runner);
+		return NULL;
+	}
+	for (uint32_t n = 0; n < threads; ++n) {
+		runner->workers[n].slots = (uint32_t*)malloc(capacity * sizeof(uint32_t));
+		if (runner->workers[n].slots == NULL) {
+			chip8_runner_free(runner);
+			return NULL;
+		}
+		runner->workers[n].mask = capacity - 1;
+		runner->workers[n].seed = 0x9E3779B9u * (n + 1);
+	}
+
+	/* thread 0 is the calling thread */
+	for (uint32_t n = 1; n < threads; ++n) {
+		if (chip8_runner_spawn(runner, n) != 0) {
+			chip8_runner_join(runner, n);
+			chip8_runner_free(runner);
+			return NULL;
+		}
+	}
+	return runner;
+}
+
+void chip8_runner_destroy(CHIP8_RUNNER* runner) {
+	if (runner == NULL) {
+		return;
+	}
+	chip8_runner_join(runner, runner->threads);
+	chip8_runner_free(runner);
+}
+
+uint64_t chip8_runner_run_frame(CHIP8_RUNNER* runner, uint32_t instructions_per_frame) {
+	/* Run one slice of every instance across the pool */
+	double start = chip8_runner_time();
+	uint64_t instructions = 0;
+
+	MUTEX_LOCK(&runner->lock);
+
+	/* workers are parked; queue slices round robin */
+	for (uint32_t n = 0; n < runner->count; ++n) {
+		chip8_deque_push(&runner->workers[n % runner->threads], n);
+	}
+	for (uint32_t n = 0; n < runner->threads; ++n) {
+		runner->workers[n].instructions = 0;
+	}
+	runner->instructions_per_frame = instructions_per_frame;
+	runner->remaining = runner->count;
+	runner->finished = 0;
+	runner->generation++;
+	COND_BROADCAST(&runner->start);
+	MUTEX_UNLOCK(&runner->lock);
+
+	chip8_runner_work(runner, 0);
+
+	MUTEX_LOCK(&runner->lock);
+	while (runner->finished != runner->threads - 1) {
+		COND_WAIT(&runner->done, &runner->lock);
+	}
+	MUTEX_UNLOCK(&runner->lock);
+
+	runner->stats.slices = 0;
+	runner->stats.steals = 0;
+	for (uint32_t n = 0; n < runner->threads; ++n) {
+		instructions += runner->workers[n].instructions;
+		runner->stats.slices += runner->workers[n].slices;
+		runner->stats.steals += runner->workers[n].steals;
+	}
+
+	runner->stats.frames++;
+	runner->stats.instructions += instructions;
+	runner->stats.seconds += chip8_runner_time() - start;
+	return instructions;
+}
+
+void chip8_runner_run(CHIP8_RUNNER* runner, uint32_t frames, uint32_t instructions_per_frame) {
+	for (uint32_t n = 0; n < frames; ++n) {
+		chip8_runner_run_frame(runner, instructions_per_frame);
+	}
+}
+
+void chip8_runner_get_stats(const CHIP8_RUNNER* runner, CHIP8_RUNNER_STATS* stats) {
+	*stats = runner->stats;
+	stats->instructions_per_sec = stats->seconds > 0.0 ? (double)stats->instructions / stats->seconds : 0.0;
+}
+
+uint32_t chip8_runner_get_threads(const CHIP8_RUNNER* runner) {
+	return runner->threads;
+}
@@ -0,0 +1,66 @@
+// chip8_runner.h
+//
+// GitHub: https:\\github.com\tommojphillips
+
+#ifndef CHIP8_RUNNER_H
+#define CHIP8_RUNNER_H
+
+#include <stdint.h>
+
+#include "chip8_defines.h"
+#include "chip8.h"
+
+#define CHIP8_RUNNER_MAX_THREADS	64
+
+/* Chip8 runner; a pool of worker threads running a set of CHIP8 instances.
+ *
+ * Each frame every instance gets one slice: chip8_run() for up to
+ * instructions_per_frame, then chip8_step_timers(). Slices are spread over
+ * per-thread work-stealing deques, so threads that run out of work take
+ * slices from busy threads instead of waiting.
+ *
+ * Instances are only touched inside chip8_runner_run_frame(), by one
+ * thread at a time. chip8_beep() is called from worker threads
+ * (with CHIP8_AUDIO_SYNTH, each instance's audio ring is written from them)
+ * and must be safe to call concurrently, as must chip8_random() with
+ * CHIP8_RANDOM_HOOK. */
+typedef struct CHIP8_RUNNER CHIP8_RUNNER;
+
+/* Chip8 runner statistics; totals since chip8_runner_create */
+typedef struct {
+	uint64_t frames;
+	uint64_t instructions;	// instructions executed by all instances
+	uint64_t slices;		// instance slices run
+	uint64_t steals;		// slices run by a thread other than the one they were queued on
+	double seconds;			// wall time spent in chip8_runner_run_frame
+	double instructions_per_sec;
+} CHIP8_RUNNER_STATS;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Create a runner for count instances using threads threads (including the calling thread).
+// threads 0 uses one thread per cpu. Returns NULL on failure
+CHIP8_RUNNER* chip8_runner_create(CHIP8* instances, uint32_t count, uint32_t threads);
+
+// Stop the worker threads and free the runner. Instances are not freed
+void chip8_runner_destroy(CHIP8_RUNNER* runner);
+
+// Run one frame of every instance; returns when all slices are done.
+// Returns the number of instructions executed
+uint64_t chip8_runner_run_frame(CHIP8_RUNNER* runner, uint32_t instructions_per_frame);
+
+// Run frames frames
+void chip8_runner_run(CHIP8_RUNNER* runner, uint32_t frames, uint32_t instructions_per_frame);
+
+// Get runner statistics
+void chip8_runner_get_stats(const CHIP8_RUNNER* runner, CHIP8_RUNNER_STATS* stats);
+
+// Number of threads the runner uses
+uint32_t chip8_runner_get_threads(const CHIP8_RUNNER* runner);
+
+#ifdef __cplusplus
+};
+#endif
+#endif
@@ -0,0 +1,166 @@
+// chip8_snapshot.c
+//
+// GitHub: https:\\github.com\tommojphillips
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "chip8_defines.h"
+#include "chip8.h"
+#include "chip8_snapshot.h"
+
+static uint16_t chip8_snapshot_pages(const CHIP8* chip8, const CHIP8_SNAPSHOT* snapshot) {
+	/* Ram pages that differ between chip8 and snapshot */
+#ifdef CHIP8_SNAPSHOT_PAGES
+	if (chip8->snapshot_base == snapshot && snapshot->owner == chip8) {
+		return chip8->dirty_pages;
+	}
+#else
+	(void)chip8;
+	(void)snapshot;
+#endif
+	return CHIP8_PAGES_ALL;
+}
+
+static void chip8_snapshot_copy(const CHIP8* chip8, CHIP8_SNAPSHOT* snapshot, uint16_t pages) {
+	snapshot->version = CHIP8_SNAPSHOT_VERSION;
+	snapshot->quirks = chip8->quirks;
+#ifdef CYCLE_COUNT
+	snapshot->cycles = chip8->cycles;
+#else
+	snapshot->cycles = 0;
+#endif
+	for (int n = 0; n < 4; ++n) {
+		snapshot->rng[n] = chip8->rng[n];
+	}
+	snapshot->frame_debt = chip8->frame_debt;
+
+	snapshot->i = chip8->i;
+	snapshot->pc = chip8->pc;
+	snapshot->sp = chip8->sp;
+	snapshot->opcode = chip8->opcode;
+	snapshot->keypad = chip8->keypad;
+	snapshot->fxoa_state = chip8->fxoa_state;
+	snapshot->delay_timer = chip8->delay_timer;
+	snapshot->sound_timer = chip8->sound_timer;
+	snapshot->draw_display = chip8->draw_display;
+	snapshot->cpu_state = chip8->cpu_state;
+	snapshot->platform = chip8->platform;
+	snapshot->hires = chip8->hires;
+	snapshot->planes = chip8->planes;
+
+	memcpy(snapshot->v, chip8->v, sizeof(snapshot->v));
+	memcpy(snapshot->rpl, chip8->rpl, sizeof(snapshot->rpl));
+	memcpy(snapshot->stack, chip8->stack, sizeof(snapshot->stack));
+	memcpy(snapshot->display, chip8->display, sizeof(snapshot->display));
+
+	for (int page = 0; page < CHIP8_PAGE_COUNT; ++page) {
+		if (pages & (1U << page)) {
+			memcpy(&snapshot->ram[page * CHIP8_PAGE_BYTES], &chip8->ram[page * CHIP8_PAGE_BYTES], CHIP8_PAGE_BYTES);
+		}
+	}
+}
+
+int chip8_snapshot(CHIP8* chip8, CHIP8_SNAPSHOT* snapshot, uint16_t* pages) {
+	uint16_t copy;
+
+	if (chip8->platform == CHIP8_PLATFORM_XOCHIP) {
+		return 2;
+	}
+
+	copy = chip8_snapshot_pages(chip8, snapshot);
+	chip8_snapshot_copy(chip8, snapshot, copy);
+	snapshot->owner = chip8;
+
+#ifdef CHIP8_SNAPSHOT_PAGES
+	chip8->dirty_pages = 0;
+	chip8->snapshot_base = snapshot;
+#endif
+
+	if (pages != NULL) {
+		*pages = copy;
+	}
+	return 0;
+}
+
+int chip8_snapshot_full(const CHIP8* chip8, CHIP8_SNAPSHOT* snapshot) {
+	if (chip8->platform == CHIP8_PLATFORM_XOCHIP) {
+		return 2;
+	}
+
+	chip8_snapshot_copy(chip8, snapshot, CHIP8_PAGES_ALL);
+	snapshot->owner = NULL;
+	return 0;
+}
+
+int chip8_restore(CHIP8* chip8, const CHIP8_SNAPSHOT* snapshot, uint16_t* pages) {
+	uint16_t restore;
+	int words;
+
+	if (snapshot->version != CHIP8_SNAPSHOT_VERSION) {
+		return 1;
+	}
+	if (chip8->platform == CHIP8_PLATFORM_XOCHIP) {
+		/* runs out of its CHIP8_XO, which the snapshot does not hold */
+		return 2;
+	}
+
+	restore = chip8_snapshot_pages(chip8, snapshot);
+
+#ifdef CYCLE_COUNT
+	chip8->cycles = snapshot->cycles;
+#endif
+	for (int n = 0; n < 4; ++n) {
+		chip8->rng[n] = snapshot->rng[n];
+	}
+	chip8->frame_debt = snapshot->frame_debt;
+
+	chip8->i = snapshot->i;
+	chip8->pc = snapshot->pc;
+	chip8->sp = snapshot->sp;
+	chip8->opcode = snapshot->opcode;
+	chip8->keypad = snapshot->keypad;
+	chip8->fxoa_state = snapshot->fxoa_state;
+	chip8->delay_timer = snapshot->delay_timer;
+	chip8->sound_timer = snapshot->sound_timer;
+	chip8->draw_display = snapshot->draw_display;
+	chip8->cpu_state = snapshot->cpu_state;
+	chip8->platform = snapshot->platform;
+	chip8->planes = snapshot->planes;
+	chip8_set_quirks(chip8, snapshot->quirks);
+
+	memcpy(chip8->v, snapshot->v, sizeof(chip8->v));
+	memcpy(chip8->rpl, snapshot->rpl, sizeof(chip8->rpl));
+	memcpy(chip8->stack, snapshot->stack, sizeof(chip8->stack));
+
+	/* the host redraws rows that differ from what it last drew, or all of them
+	 * if the resolution changed; a hires row is two words */
+	if (chip8->hires != snapshot->hires) {
+		chip8->hires = snapshot->hires;
+		chip8->dirty_rows = chip8->hires ? CHIP8_DISPLAY_HIRES_ROWS_ALL : CHIP8_DISPLAY_ROWS_ALL;
+	}
+	words = chip8->hires ? CHIP8_DISPLAY_WORDS : CHIP8_DISPLAY_HEIGHT;
+	for (int w = 0; w < words; ++w) {
+		chip8->dirty_rows |= (uint64_t)(chip8->display[w] != snapshot->display[w]) << (w >> chip8->hires);
+	}
+	memcpy(chip8->display, snapshot->display, sizeof(chip8->display));
+
+	for (int page = 0; page < CHIP8_PAGE_COUNT; ++page) {
+		if (restore & (1U << page)) {
+			memcpy(&chip8->ram[page * CHIP8_PAGE_BYTES], &snapshot->ram[page * CHIP8_PAGE_BYTES], CHIP8_PAGE_BYTES);
+			chip8_invalidate_memory(chip8, (uint16_t)(page * CHIP8_PAGE_BYTES), CHIP8_PAGE_BYTES);
+		}
+	}
+
+#ifdef CHIP8_SNAPSHOT_PAGES
+	/* ram now matches the snapshot; further restores of it only need pages written from here */
+	chip8->dirty_pages = 0;
+	chip8->snapshot_base = (snapshot->owner == chip8) ? snapshot : NULL;
+#endif
+
+	if (pages != NULL) {
+		*pages = restore;
+	}
+	return 0;
+}
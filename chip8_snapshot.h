@@ -0,0 +1,84 @@
+// chip8_snapshot.h
+//
+// GitHub: https:\\github.com\tommojphillips
+
+#ifndef CHIP8_SNAPSHOT_H
+#define CHIP8_SNAPSHOT_H
+
+#include <stdint.h>
+
+#include "chip8_defines.h"
+#include "chip8.h"
+
+#define CHIP8_SNAPSHOT_VERSION 4
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define CHIP8_SNAPSHOT_ALIGN __declspec(align(64))
+#else
+#define CHIP8_SNAPSHOT_ALIGN __attribute__((aligned(64)))
+#endif
+
+/* Chip8 snapshot; the live state of a CHIP8, without predecoded or host
+ * side state. Fixed size and cache aligned.
+ *
+ * With CHIP8_SNAPSHOT_PAGES, taking a snapshot into the same snapshot the
+ * instance last took or restored copies only the ram pages written since,
+ * and restoring it copies back only those pages. Anything else copies all
+ * of ram. Zero a snapshot before its first use.
+ *
+ * XO-CHIP is refused; its memory and plane 2 live in the host's CHIP8_XO,
+ * which a fixed size snapshot cannot hold. */
+typedef struct {
+	uint32_t version;			// CHIP8_SNAPSHOT_VERSION
+	uint32_t quirks;
+	const void* owner;			// instance the snapshot was taken from
+	uint64_t cycles;			// CYCLE_COUNT only
+	uint32_t rng[4];
+	uint32_t frame_debt;
+
+	uint16_t i;
+	uint16_t pc;
+	uint16_t sp;
+	uint16_t opcode;
+	uint16_t keypad;
+	uint16_t fxoa_state;
+	uint8_t delay_timer;
+	uint8_t sound_timer;
+	uint8_t draw_display;
+	uint8_t cpu_state;
+	uint8_t platform;
+	uint8_t hires;
+	uint8_t planes;
+
+	uint8_t v[CHIP8_REGISTER_COUNT];
+	uint8_t rpl[CHIP8_RPL_FLAGS];
+	uint16_t stack[CHIP8_STACK_SIZE];
+
+	CHIP8_SNAPSHOT_ALIGN uint64_t display[CHIP8_DISPLAY_WORDS];
+	CHIP8_SNAPSHOT_ALIGN uint8_t ram[CHIP8_MEMORY_BYTES];
+} CHIP8_SNAPSHOT;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Take a snapshot of chip8. The ram pages copied are stored in pages if not NULL; 1 bit per
+// CHIP8_PAGE_BYTES page. Returns 0 on success, 2 without touching the snapshot if chip8 is XO-CHIP
+int chip8_snapshot(CHIP8* chip8, CHIP8_SNAPSHOT* snapshot, uint16_t* pages);
+
+// Take a snapshot of chip8 without touching its page tracking. The snapshot has no owner,
+// so it always copies all of ram on restore; for snapshots the caller modifies.
+// Returns as chip8_snapshot
+int chip8_snapshot_full(const CHIP8* chip8, CHIP8_SNAPSHOT* snapshot);
+
+// Restore chip8 from a snapshot. Display rows that change are marked dirty and predecoded
+// instructions in restored pages are invalidated. The restored pages are stored in pages if
+// not NULL; pass them to chip8_jit_invalidate when using the jit.
+// Returns 0 on success, 1 if the snapshot version does not match, 2 without touching chip8 if
+// chip8 is XO-CHIP
+int chip8_restore(CHIP8* chip8, const CHIP8_SNAPSHOT* snapshot, uint16_t* pages);
+
+#ifdef __cplusplus
+};
+#endif
+#endif
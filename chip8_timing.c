@@ -0,0 +1,56 @@
+// chip8_timing.c
+//
+// GitHub: https:\\github.com\tommojphillips
+//
+// src:
+// https:\\www.laurencescotford.net\2020\07\25\chip-8-on-the-cosmac-vip-instruction-index\
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chip8_defines.h"
+#include "chip8.h"
+#include "chip8_timing.h"
+
+CHIP8_RUN_EXIT chip8_run_frame(CHIP8* chip8, uint32_t* executed) {
+	/* Run one 60 Hz frame with VIP timing */
+
+	CHIP8_RUN_EXIT exit = CHIP8_RUN_EXIT_COMPLETE;
+	uint32_t count = 0;
+	uint32_t budget;
+
+	if (chip8->cpu_state == CHIP8_STATE_ERROR_OPCODE) {
+		exit = CHIP8_RUN_EXIT_ERROR;
+		goto done;
+	}
+	if (chip8->cpu_state == CHIP8_STATE_HLT) {
+		exit = CHIP8_RUN_EXIT_HALT;
+		chip8_step_timers(chip8);
+		goto done;
+	}
+
+	/* an instruction that overran the last frame is still running */
+	if (chip8->frame_debt >= CHIP8_VIP_FRAME_BUDGET) {
+		chip8->frame_debt -= CHIP8_VIP_FRAME_BUDGET;
+		chip8_step_timers(chip8);
+		goto done;
+	}
+	budget = CHIP8_VIP_FRAME_BUDGET - chip8->frame_debt;
+	chip8->frame_debt = 0;
+
+	/* charges each instruction and leaves any overrun, or a DXYN waiting
+	 * for vblank, in frame_debt */
+	exit = chip8_run_vip(chip8, budget, &count);
+	if (exit == CHIP8_RUN_EXIT_ERROR) {
+		goto done;
+	}
+
+	chip8_step_timers(chip8);
+
+done:
+	if (executed != NULL) {
+		*executed = count;
+	}
+
+	return exit;
+}
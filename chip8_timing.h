@@ -0,0 +1,35 @@
+// chip8_timing.h
+//
+// GitHub: https:\\github.com\tommojphillips
+
+#ifndef CHIP8_TIMING_H
+#define CHIP8_TIMING_H
+
+#include <stdint.h>
+
+#include "chip8_defines.h"
+#include "chip8.h"
+
+/* COSMAC VIP machine cycles; 1.7609 MHz clock, 8 clocks per machine cycle */
+#define CHIP8_VIP_CYCLES_PER_FRAME		3668	// one 60 Hz frame
+#define CHIP8_VIP_INTERRUPT_CYCLES		1122	// 1861 display DMA and the interrupt routine each frame
+#define CHIP8_VIP_FRAME_BUDGET			(CHIP8_VIP_CYCLES_PER_FRAME - CHIP8_VIP_INTERRUPT_CYCLES)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Run one 60 Hz frame with COSMAC VIP timing (chip8_run_vip), then step timers.
+// Instructions are charged their VIP cycle cost against CHIP8_VIP_FRAME_BUDGET; an instruction
+// that overruns the frame is paid for out of the next one. With CHIP8_QUIRK_DISPLAY_WAIT,
+// DXYN waits for vblank, ending the frame. An idle loop on the delay timer or a halt skips the rest of the frame.
+// Returns CHIP8_RUN_EXIT_COMPLETE, or what ended the frame early: CHIP8_RUN_EXIT_DRAW (DXYN),
+// CHIP8_RUN_EXIT_KEY_WAIT (FX0A), CHIP8_RUN_EXIT_IDLE, CHIP8_RUN_EXIT_HALT or CHIP8_RUN_EXIT_ERROR
+// (on an opcode error the timers are not stepped).
+// The number of instructions executed is stored in executed if not NULL.
+CHIP8_RUN_EXIT chip8_run_frame(CHIP8* chip8, uint32_t* executed);
+
+#ifdef __cplusplus
+};
+#endif
+#endif
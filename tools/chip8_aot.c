@@ -0,0 +1,500 @@
+// chip8_aot.c
+//
+// GitHub: https:\\github.com\tommojphillips
+
+/* Ahead-of-time recompiler. Translates a chip8 program into a C source file
+ * exporting
+ *
+ *   CHIP8_RUN_EXIT <name>_run(CHIP8* chip8, uint32_t max_instructions, uint32_t* executed);
+ *
+ * a drop-in replacement for chip8_run() for that one program. Code reachable
+ * from CHIP8_PROGRAM_ADDR is discovered by following jumps, calls, skips and
+ * return sites, split into basic blocks and emitted as one label per block
+ * operating directly on the CHIP8 struct.
+ *
+ * Anything that can't be resolved statically goes through a dispatcher
+ * switch on PC; addresses without a translated block (BNNN targets, code
+ * reached only through BNNN or returns into unknown code) are executed one
+ * instruction at a time by the interpreter. The translated bytes are checked
+ * against ram on entry and after FX33/FX55 writes into code; while any
+ * differ, every block is verified before it runs and modified blocks are
+ * interpreted instead.
+ *
+ * Build: cc -O2 -I.. chip8_aot.c ../chip8.c ../chip8_cfg.c -o chip8_aot
+ * Usage: chip8_aot <rom> <output.c> [name]
+ * Link the output with chip8.c and call <name>_run() in place of chip8_run(). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "chip8.h"
+#include "chip8_cfg.h"
+
+#define X ((opcode >> 8) & 0x0F)
+#define Y ((opcode >> 4) & 0x00F)
+#define N (opcode & 0x000F)
+#define NNN (opcode & 0x0FFF)
+#define NN (opcode & 0x00FF)
+
+#define PROGRAM_BYTES (CHIP8_MEMORY_BYTES - CHIP8_PROGRAM_ADDR)
+
+/* Discovery state */
+static uint8_t ram[CHIP8_MEMORY_BYTES];
+static uint16_t program_end;					// first address past the program
+static CHIP8_CFG cfg;							// basic blocks of the program
+static uint8_t code[CHIP8_MEMORY_BYTES];		// byte belongs to a translated instruction
+
+#define leader(address) (cfg.map[address] & CHIP8_CFG_LEADER)
+
+/* The tool links chip8.c for chip8_decode_op() only */
+void chip8_render(CHIP8* chip8) { (void)chip8; }
+void chip8_beep(CHIP8* chip8) { (void)chip8; }
+#ifdef CHIP8_RANDOM_HOOK
+uint8_t chip8_random() { return 0; }
+#endif
+
+static int in_program(uint32_t address) {
+	return address >= CHIP8_PROGRAM_ADDR && address + 1 < program_end;
+}
+static uint16_t opcode_at(uint16_t address) {
+	return (uint16_t)((ram[address] << 8) | ram[address + 1]);
+}
+static CHIP8_OP op_at(uint16_t address) {
+	if (!in_program(address)) {
+		return CHIP8_OP_INVALID;
+	}
+	return chip8_decode_op(opcode_at(address));
+}
+static int is_skip(CHIP8_OP op) {
+	switch (op) {
+		case CHIP8_OP_3XNN:
+		case CHIP8_OP_4XNN:
+		case CHIP8_OP_5XY0:
+		case CHIP8_OP_5XY2:
+		case CHIP8_OP_5XY3:
+		case CHIP8_OP_9XY0:
+		case CHIP8_OP_EX9E:
+		case CHIP8_OP_EXA1:
+			return 1;
+		default:
+			return 0;
+	}
+}
+static int ends_block(CHIP8_OP op) {
+	switch (op) {
+		case CHIP8_OP_00EE:
+		case CHIP8_OP_1NNN:
+		case CHIP8_OP_2NNN:
+		case CHIP8_OP_BNNN:
+			return 1;
+		default:
+			return is_skip(op);
+	}
+}
+static int has_block(uint32_t address) {
+	return address < CHIP8_MEMORY_BYTES && leader(address) && op_at((uint16_t)address) != CHIP8_OP_INVALID;
+}
+
+/* EMIT */
+
+static void emit_jump(FILE* f, uint32_t target) {
+	fprintf(f, "chip8->pc = 0x%03X; ", target);
+	if (has_block(target)) {
+		fprintf(f, "if (verify) goto dispatch; goto b%03X;\n", target);
+	}
+	else {
+		fprintf(f, "goto dispatch;\n");
+	}
+}
+static void emit_complex(FILE* f, uint16_t pc) {
+	fprintf(f, "\tchip8->pc = 0x%03X; chip8_execute(chip8);\n", pc);
+}
+static int emit_instruction(FILE* f, uint16_t pc, int remaining) {
+	/* Emit one instruction; remaining is the number of instructions in the
+	 * block after this one, subtracted from count on an early exit.
+	 * Returns 1 if the instruction ends the block. */
+
+	uint16_t opcode = opcode_at(pc);
+	CHIP8_OP op = chip8_decode_op(opcode);
+
+	fprintf(f, "\t// %03X: %04X\n", pc, opcode);
+
+	switch (op) {
+		case CHIP8_OP_00E0:
+		case CHIP8_OP_DXYN:
+			emit_complex(f, pc);
+			fprintf(f, "\tif (chip8->quirks & CHIP8_QUIRK_DISPLAY_WAIT) { count -= %d; exit = CHIP8_RUN_EXIT_DRAW; goto done; }\n", remaining);
+			return 0;
+
+		case CHIP8_OP_00EE:
+			fprintf(f, "\tchip8->pc = chip8->stack[chip8->sp & (CHIP8_STACK_SIZE - 1)] + 2; chip8->sp -= 1; goto dispatch;\n");
+			return 1;
+
+		case CHIP8_OP_1NNN:
+			if (NNN == pc) {
+				fprintf(f, "\tchip8->pc = 0x%03X; chip8->cpu_state = CHIP8_STATE_HLT; exit = CHIP8_RUN_EXIT_HALT; goto done;\n", pc);
+				return 1;
+			}
+			if (NNN + 4 == pc && in_program(NNN + 2) && (opcode_at(NNN) & 0xF0FF) == 0xF007 && (opcode_at(NNN + 2) & 0xFF00) == (0x3000 | (opcode_at(NNN) & 0x0F00))) {
+				// idle loop on the delay timer, unless the loop was overwritten
+				fprintf(f, "\tif (chip8->delay_timer != 0x%02X && !code_changed(chip8, 0x%03X, 4)) { chip8->pc = 0x%03X; exit = CHIP8_RUN_EXIT_IDLE; goto done; }\n",
+					opcode_at(NNN + 2) & 0xFF, NNN, NNN);
+			}
+			fprintf(f, "\t");
+			emit_jump(f, NNN);
+			return 1;
+
+		case CHIP8_OP_2NNN:
+			fprintf(f, "\tchip8->sp += 1; chip8->stack[chip8->sp & (CHIP8_STACK_SIZE - 1)] = 0x%03X;\n\t", pc);
+			emit_jump(f, NNN);
+			return 1;
+
+		case CHIP8_OP_3XNN:
+		case CHIP8_OP_4XNN:
+		case CHIP8_OP_5XY0:
+		case CHIP8_OP_5XY2:
+		case CHIP8_OP_5XY3:
+		case CHIP8_OP_9XY0:
+		case CHIP8_OP_EX9E:
+		case CHIP8_OP_EXA1:
+			switch (op) {
+				case CHIP8_OP_3XNN: fprintf(f, "\tif (V[0x%X] == 0x%02X) { ", X, NN); break;
+				case CHIP8_OP_4XNN: fprintf(f, "\tif (V[0x%X] != 0x%02X) { ", X, NN); break;
+				case CHIP8_OP_5XY0:
+				case CHIP8_OP_5XY2:
+				case CHIP8_OP_5XY3: fprintf(f, "\tif (V[0x%X] == V[0x%X]) { ", X, Y); break; // 5XYN is 5XY0 off XO-CHIP
+				case CHIP8_OP_9XY0: fprintf(f, "\tif (V[0x%X] != V[0x%X]) { ", X, Y); break;
+				case CHIP8_OP_EX9E: fprintf(f, "\tif (CHIP8_KEYPAD_GET(chip8->keypad, V[0x%X]) == 0x1) { ", X); break;
+				default:            fprintf(f, "\tif (CHIP8_KEYPAD_GET(chip8->keypad, V[0x%X]) == 0x0) { ", X); break;
+			}
+			emit_jump(f, pc + 4);
+			fprintf(f, "\t}\n\t");
+			emit_jump(f, pc + 2);
+			return 1;
+
+		case CHIP8_OP_6XNN: fprintf(f, "\tV[0x%X] = 0x%02X;\n", X, NN); return 0;
+		case CHIP8_OP_7XNN: fprintf(f, "\tV[0x%X] += 0x%02X;\n", X, NN); return 0;
+		case CHIP8_OP_8XY0: fprintf(f, "\tV[0x%X] = V[0x%X];\n", X, Y); return 0;
+
+		case CHIP8_OP_8XY1:
+		case CHIP8_OP_8XY2:
+		case CHIP8_OP_8XY3:
+			fprintf(f, "\tV[0x%X] %c= V[0x%X]; if (chip8->quirks & CHIP8_QUIRK_ZERO_VF_REGISTER) VF = 0;\n",
+				X, op == CHIP8_OP_8XY1 ? '|' : op == CHIP8_OP_8XY2 ? '&' : '^', Y);
+			return 0;
+
+		case CHIP8_OP_8XY4:
+			fprintf(f, "\tr = V[0x%X] + V[0x%X]; V[0x%X] = (uint8_t)r; VF = r > 0xFF;\n", X, Y, X);
+			return 0;
+		case CHIP8_OP_8XY5:
+			fprintf(f, "\tvf = V[0x%X] >= V[0x%X]; V[0x%X] = V[0x%X] - V[0x%X]; VF = vf;\n", X, Y, X, X, Y);
+			return 0;
+		case CHIP8_OP_8XY6:
+			fprintf(f, "\tvf = V[0x%X] & 0x1; V[0x%X] = (chip8->quirks & CHIP8_QUIRK_SHIFT_X_REGISTER ? V[0x%X] : V[0x%X]) >> 1; VF = vf;\n", X, X, X, Y);
+			return 0;
+		case CHIP8_OP_8XY7:
+			fprintf(f, "\tvf = V[0x%X] >= V[0x%X]; V[0x%X] = V[0x%X] - V[0x%X]; VF = vf;\n", Y, X, X, Y, X);
+			return 0;
+		case CHIP8_OP_8XYE:
+			fprintf(f, "\tvf = V[0x%X] >> 7; V[0x%X] = (chip8->quirks & CHIP8_QUIRK_SHIFT_X_REGISTER ? V[0x%X] : V[0x%X]) << 1; VF = vf;\n", X, X, X, Y);
+			return 0;
+
+		case CHIP8_OP_ANNN:
+			fprintf(f, "\tchip8->i = 0x%03X;\n", NNN);
+			return 0;
+
+		case CHIP8_OP_BNNN:
+			fprintf(f, "\tchip8->pc = 0x%03X + V[chip8->quirks & CHIP8_QUIRK_JUMP_VX ? 0x%X : 0x0]; goto dispatch;\n", NNN, X);
+			return 1;
+
+		case CHIP8_OP_FX07: fprintf(f, "\tV[0x%X] = chip8->delay_timer;\n", X); return 0;
+		case CHIP8_OP_FX15: fprintf(f, "\tchip8->delay_timer = V[0x%X];\n", X); return 0;
+		case CHIP8_OP_FX18: fprintf(f, "\tchip8->sound_timer = V[0x%X];\n", X); return 0;
+		case CHIP8_OP_FX1E: fprintf(f, "\tchip8->i += V[0x%X];\n", X); return 0;
+		case CHIP8_OP_FX29: fprintf(f, "\tchip8->i = V[0x%X] * 5;\n", X); return 0;
+
+		case CHIP8_OP_FX0A:
+			emit_complex(f, pc);
+			fprintf(f, "\tif (chip8->cpu_state == CHIP8_STATE_KEY_WAIT) { count -= %d; exit = CHIP8_RUN_EXIT_KEY_WAIT; goto done; }\n", remaining);
+			return 0;
+
+		case CHIP8_OP_FX33:
+		case CHIP8_OP_FX55:
+			// ram write; leave the block if it hit translated code
+			fprintf(f, "\ta = chip8->i;\n");
+			emit_complex(f, pc);
+			fprintf(f, "\tif (code_hit(a, %d)) { verify = 1; count -= %d; goto dispatch; }\n",
+				op == CHIP8_OP_FX33 ? 3 : X + 1, remaining);
+			return 0;
+
+		case CHIP8_OP_00CN:
+		case CHIP8_OP_00FB:
+		case CHIP8_OP_00FC:
+		case CHIP8_OP_00FD:
+		case CHIP8_OP_00FE:
+		case CHIP8_OP_00FF:
+		case CHIP8_OP_FX30:
+		case CHIP8_OP_FX75:
+		case CHIP8_OP_FX85:
+		case CHIP8_OP_00DN:
+		case CHIP8_OP_F000:
+		case CHIP8_OP_FN01:
+		case CHIP8_OP_F002:
+		case CHIP8_OP_FX3A:
+			// SCHIP and XO-CHIP; an opcode error on a platform without them, and 00FD halts
+			emit_complex(f, pc);
+			fprintf(f, "\tif (chip8->cpu_state != CHIP8_STATE_EXE) { exit = (chip8->cpu_state == CHIP8_STATE_HLT) ? CHIP8_RUN_EXIT_HALT : CHIP8_RUN_EXIT_ERROR; count -= %d + (exit == CHIP8_RUN_EXIT_ERROR); goto done; }\n", remaining);
+			return 0;
+
+		default: // CXNN, FX65
+			emit_complex(f, pc);
+			return 0;
+	}
+}
+static void emit_block(FILE* f, uint16_t start) {
+	uint16_t pc = start;
+	int length = 0;
+	int k;
+
+	// measure
+	for (;;) {
+		CHIP8_OP op = op_at(pc);
+		if (op == CHIP8_OP_INVALID) {
+			break;
+		}
+		length += 1;
+		if (ends_block(op)) {
+			break;
+		}
+		pc += 2;
+		if (leader(pc)) {
+			break;
+		}
+	}
+
+	fprintf(f, "b%03X:\n", start);
+	fprintf(f, "\tif (max_instructions - count < %d) goto interpret;\n", length);
+	fprintf(f, "\tcount += %d;\n", length);
+
+	pc = start;
+	for (k = 0; k < length; ++k) {
+		code[pc] = 1;
+		code[pc + 1] = 1;
+		if (emit_instruction(f, pc, length - k - 1)) {
+			fprintf(f, "\n");
+			return;
+		}
+		pc += 2;
+	}
+
+	// fall through into the next block or into code that is not translated
+	fprintf(f, "\t");
+	emit_jump(f, pc);
+	fprintf(f, "\n");
+}
+static uint16_t block_end(uint16_t start) {
+	uint16_t pc = start;
+	for (;;) {
+		CHIP8_OP op = op_at(pc);
+		if (op == CHIP8_OP_INVALID) {
+			return pc;
+		}
+		pc += 2;
+		if (ends_block(op) || leader(pc)) {
+			return pc;
+		}
+	}
+}
+static void emit_program(FILE* f, const char* rom_name, const char* name) {
+	FILE* body = tmpfile();
+	uint32_t a;
+	int n;
+
+	if (body == NULL) {
+		perror("tmpfile");
+		exit(1);
+	}
+
+	/* Blocks are emitted first so the code map is complete */
+	for (a = CHIP8_PROGRAM_ADDR; a < program_end; ++a) {
+		if (has_block(a)) {
+			emit_block(body, (uint16_t)a);
+		}
+	}
+
+	fprintf(f, "// %s.c\n//\n// Generated by chip8_aot from %s. Do not edit.\n\n", name, rom_name);
+	fprintf(f, "#include <stdint.h>\n#include <string.h>\n\n#include \"chip8.h\"\n\n");
+	fprintf(f, "#define V chip8->v\n#define VF chip8->v[0xF]\n\n");
+
+	fprintf(f, "CHIP8_RUN_EXIT %s_run(CHIP8* chip8, uint32_t max_instructions, uint32_t* executed);\n\n", name);
+
+	// program image
+	fprintf(f, "static const uint8_t program[0x%X] = {", program_end - CHIP8_PROGRAM_ADDR);
+	for (a = CHIP8_PROGRAM_ADDR; a < program_end; ++a) {
+		fprintf(f, "%s0x%02X,", ((a - CHIP8_PROGRAM_ADDR) & 15) ? " " : "\n\t", ram[a]);
+	}
+	fprintf(f, "\n};\n\n");
+
+	// translated bytes; 1 bit per address
+	fprintf(f, "static const uint8_t code_map[0x%X] = {", CHIP8_MEMORY_BYTES >> 3);
+	for (a = 0; a < CHIP8_MEMORY_BYTES; a += 8) {
+		uint8_t bits = 0;
+		for (n = 0; n < 8; ++n) {
+			bits |= code[a + n] << n;
+		}
+		fprintf(f, "%s0x%02X,", ((a >> 3) & 15) ? " " : "\n\t", bits);
+	}
+	fprintf(f, "\n};\n\n");
+
+	// contiguous runs of translated bytes, checked on entry
+	fprintf(f, "static const uint16_t code_runs[][2] = {\n");
+	n = 0;
+	for (a = CHIP8_PROGRAM_ADDR; a < program_end; ++a) {
+		if (code[a] && !code[a - 1]) {
+			uint32_t end = a;
+			while (end < program_end && code[end]) {
+				end += 1;
+			}
+			fprintf(f, "\t{ 0x%03X, 0x%03X },\n", a, end - a);
+			n += 1;
+		}
+	}
+	if (n == 0) {
+		fprintf(f, "\t{ 0x%03X, 0 },\n", CHIP8_PROGRAM_ADDR);
+	}
+	fprintf(f, "};\n\n");
+
+	fprintf(f,
+		"static int code_hit(uint16_t address, int size) {\n"
+		"\tfor (int i = 0; i < size; ++i) {\n"
+		"\t\tuint16_t a = (address + i) & (CHIP8_MEMORY_BYTES - 1);\n"
+		"\t\tif (code_map[a >> 3] & (1 << (a & 7))) {\n"
+		"\t\t\treturn 1;\n"
+		"\t\t}\n"
+		"\t}\n"
+		"\treturn 0;\n"
+		"}\n"
+		"static int code_changed(CHIP8* chip8, uint16_t address, uint16_t size) {\n"
+		"\treturn memcmp(chip8->ram + address, program + (address - CHIP8_PROGRAM_ADDR), size) != 0;\n"
+		"}\n\n");
+
+	fprintf(f,
+		"CHIP8_RUN_EXIT %s_run(CHIP8* chip8, uint32_t max_instructions, uint32_t* executed) {\n"
+		"\tCHIP8_RUN_EXIT exit = CHIP8_RUN_EXIT_COMPLETE;\n"
+		"\tuint32_t count = 0;\n"
+		"\tuint32_t n;\n"
+		"\tuint16_t opcode;\n"
+		"\tuint16_t a;\n"
+		"\tuint16_t r;\n"
+		"\tuint8_t vf;\n"
+		"\tint verify = 0; // translated code differs from ram; verify blocks before running them\n"
+		"#ifdef CYCLE_COUNT\n"
+		"\tuint64_t cycles = chip8->cycles; // interpreted instructions count themselves; set the total on exit\n"
+		"#endif\n"
+		"\t(void)r; (void)vf;\n"
+		"\n"
+		"\t// XO-CHIP skips over four byte instructions and addresses 64 KB; interpret it\n"
+		"\tif (chip8->platform == CHIP8_PLATFORM_XOCHIP) {\n"
+		"\t\treturn chip8_run(chip8, max_instructions, executed);\n"
+		"\t}\n"
+		"\n"
+		"\tif (chip8->cpu_state == CHIP8_STATE_HLT || chip8->cpu_state == CHIP8_STATE_ERROR_OPCODE) {\n"
+		"\t\texit = (chip8->cpu_state == CHIP8_STATE_HLT) ? CHIP8_RUN_EXIT_HALT : CHIP8_RUN_EXIT_ERROR;\n"
+		"\t\tgoto done;\n"
+		"\t}\n"
+		"\n"
+		"\tfor (n = 0; n < sizeof(code_runs) / sizeof(code_runs[0]); ++n) {\n"
+		"\t\tif (code_changed(chip8, code_runs[n][0], code_runs[n][1])) {\n"
+		"\t\t\tverify = 1;\n"
+		"\t\t\tbreak;\n"
+		"\t\t}\n"
+		"\t}\n"
+		"\n"
+		"\t// a cpu waiting in FX0A resumes through chip8_run\n"
+		"\tif (chip8->cpu_state == CHIP8_STATE_KEY_WAIT) goto interpret;\n"
+		"\n"
+		"dispatch:\n"
+		"\tswitch (chip8->pc) {\n", name);
+
+	for (a = CHIP8_PROGRAM_ADDR; a < program_end; ++a) {
+		if (has_block(a)) {
+			fprintf(f, "\t\tcase 0x%03X: if (verify && code_changed(chip8, 0x%03X, %u)) break; goto b%03X;\n",
+				a, a, block_end((uint16_t)a) - a, a);
+		}
+	}
+
+	fprintf(f,
+		"\t}\n"
+		"\n"
+		"interpret:\n"
+		"\t// no translated block at pc; execute one instruction\n"
+		"\tif (count == max_instructions) goto done;\n"
+		"\ta = chip8->i;\n"
+		"\topcode = GET_OPCODE(chip8->pc);\n"
+		"\texit = chip8_run(chip8, 1, &n);\n"
+		"\tcount += n;\n"
+		"\tif (exit != CHIP8_RUN_EXIT_COMPLETE) goto done;\n"
+		"\tif (((opcode & 0xF0FF) == 0xF033 || (opcode & 0xF0FF) == 0xF055) && code_hit(a, 16)) verify = 1;\n"
+		"\tgoto dispatch;\n"
+		"\n");
+
+	// append the blocks
+	rewind(body);
+	for (;;) {
+		char buf[4096];
+		size_t got = fread(buf, 1, sizeof(buf), body);
+		if (got == 0) {
+			break;
+		}
+		fwrite(buf, 1, got, f);
+	}
+	fclose(body);
+
+	fprintf(f,
+		"done:\n"
+		"#ifdef CYCLE_COUNT\n"
+		"\tchip8->cycles = cycles + count;\n"
+		"#endif\n"
+		"\tif (executed != NULL) {\n"
+		"\t\t*executed = count;\n"
+		"\t}\n"
+		"\treturn exit;\n"
+		"}\n");
+}
+
+int main(int argc, char** argv) {
+	FILE* f;
+	size_t size;
+	const char* name = "chip8_aot";
+
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s <rom> <output.c> [name]\n", argv[0]);
+		return 1;
+	}
+	if (argc > 3) {
+		name = argv[3];
+	}
+
+	f = fopen(argv[1], "rb");
+	if (f == NULL) {
+		perror(argv[1]);
+		return 1;
+	}
+	size = fread(ram + CHIP8_PROGRAM_ADDR, 1, PROGRAM_BYTES, f);
+	fclose(f);
+	program_end = (uint16_t)(CHIP8_PROGRAM_ADDR + size);
+
+	// SCHIP decoding; XO-CHIP programs are interpreted
+	chip8_cfg_build(&cfg, ram + CHIP8_PROGRAM_ADDR, (uint32_t)size, CHIP8_PLATFORM_SCHIP);
+
+	f = fopen(argv[2], "w");
+	if (f == NULL) {
+		perror(argv[2]);
+		return 1;
+	}
+	emit_program(f, argv[1], name);
+	fclose(f);
+	return 0;
+}
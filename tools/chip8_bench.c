@@ -0,0 +1,438 @@
+// chip8_bench.c
+//
+// GitHub: https:\\github.com\tommojphillips
+
+/* Headless benchmark. Runs synthetic workloads, each weighted towards one
+ * group of opcodes, plus draw-heavy and self-modifying programs, and any
+ * ROM files given, for a fixed instruction count on each engine, and prints
+ * a JSON report: instructions/sec and ns/instruction per workload and
+ * engine, the build configuration, and a hash of the final state so
+ * engines that disagree show up.
+ *
+ * The figures are per workload, not per opcode: every workload is a loop
+ * closed by 1NNN with the registers it needs set up in between, so
+ * ns/instruction is the average over the whole loop body (10-20
+ * instructions).
+ *
+ * Build: cc -O2 -I.. chip8_bench.c ../chip8.c ../chip8_jit.c ../chip8_batch.c -o chip8_bench
+ * Usage: chip8_bench [-n instructions] [-r repeats] [-q quirks] [-e engine,...] [rom.ch8 ...]
+ * Engines: execute, run, jit (x86-64 Linux), batch. Rebuild with -DCHIP8_PREDECODE,
+ * -DCHIP8_FUSION, -DCHIP8_DISPATCH_SWITCH etc. to compare dispatch configurations. */
+
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 199309L // clock_gettime
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "chip8.h"
+#include "chip8_batch.h"
+#include "chip8_jit.h"
+
+#define INSTRUCTIONS_PER_FRAME 1000
+
+#define MAX_WORKLOADS 64
+#define MAX_NAME 64
+
+void chip8_render(CHIP8* chip8) { (void)chip8; }
+void chip8_beep(CHIP8* chip8) { (void)chip8; }
+#ifdef CHIP8_RANDOM_HOOK
+uint8_t chip8_random() { static uint32_t s = 1; s = s * 1103515245u + 12345u; return (uint8_t)(s >> 16); }
+#endif
+
+/* Workload */
+typedef struct {
+	char name[MAX_NAME];
+	const char* kind;		// "synthetic" or "rom"
+	uint8_t program[CHIP8_MEMORY_BYTES - CHIP8_PROGRAM_ADDR];
+	uint16_t size;
+} WORKLOAD;
+
+typedef uint64_t(*ENGINE_FUNC)(CHIP8* chip8, uint64_t instructions);
+
+/* Engine */
+typedef struct {
+	const char* name;
+	ENGINE_FUNC run;		// run instructions; returns the number executed
+	uint32_t lanes;			// instances stepped per instruction
+} ENGINE;
+
+static WORKLOAD workloads[MAX_WORKLOADS];
+static int workload_count;
+
+static CHIP8 chip8;
+static uint64_t instructions = 20000000;
+static int repeats = 3;
+static uint32_t quirks = 0;
+
+/* SYNTHETIC WORKLOADS */
+
+static WORKLOAD* add_workload(const char* name, const char* kind) {
+	WORKLOAD* w;
+	if (workload_count == MAX_WORKLOADS) {
+		return NULL;
+	}
+	w = &workloads[workload_count++];
+	memset(w, 0, sizeof(WORKLOAD));
+	snprintf(w->name, MAX_NAME, "%s", name);
+	w->kind = kind;
+	return w;
+}
+static void put(WORKLOAD* w, uint16_t address, const uint16_t* opcodes, int count) {
+	/* Place opcodes at address */
+	for (int i = 0; i < count; ++i) {
+		uint16_t offset = (uint16_t)(address - CHIP8_PROGRAM_ADDR + i * 2);
+		w->program[offset] = (uint8_t)(opcodes[i] >> 8);
+		w->program[offset + 1] = (uint8_t)opcodes[i];
+		if (offset + 2 > w->size) {
+			w->size = offset + 2;
+		}
+	}
+}
+#define PUT(w, address, ...) do { \
+	static const uint16_t ops_[] = { __VA_ARGS__ }; \
+	put(w, address, ops_, (int)(sizeof(ops_) / sizeof(ops_[0]))); \
+} while (0)
+
+static void add_synthetic(void) {
+	WORKLOAD* w;
+
+	/* 6XNN/7XNN/8XYN register arithmetic */
+	w = add_workload("alu", "synthetic");
+	PUT(w, 0x200, 0x6001, 0x6102, 0x6203, 0x6304,
+		0x8014, 0x8125, 0x8236, 0x8301, 0x8412, 0x8523, 0x8634, 0x870E,
+		0x7001, 0x7102, 0x8743, 0x8857, 0x8900, 0x7203, 0x8A14, 0x1208);
+
+	/* 3XNN/4XNN/5XY0/9XY0, taken and not taken */
+	w = add_workload("skip", "synthetic");
+	PUT(w, 0x200, 0x3000, 0x7001, 0x4000, 0x7001, 0x5010, 0x7101, 0x9010,
+		0x7101, 0x3F00, 0x7201, 0x4F00, 0x7201, 0x5230, 0x7301, 0x1200);
+
+	/* 2NNN/00EE two levels deep */
+	w = add_workload("call", "synthetic");
+	PUT(w, 0x200, 0x2210, 0x2210, 0x2220, 0x1200);
+	PUT(w, 0x210, 0x7001, 0x2220, 0x00EE);
+	PUT(w, 0x220, 0x7101, 0x00EE);
+
+	/* ANNN/FX1E/FX29/FX33/FX55/FX65 */
+	w = add_workload("memory", "synthetic");
+	PUT(w, 0x200, 0xA300, 0xF033, 0xF355, 0xF365, 0xF01E, 0xF029, 0xA310,
+		0xF733, 0xF155, 0x7001, 0xF765, 0x1200);
+
+	/* FX07/FX15/FX18/EX9E/EXA1 */
+	w = add_workload("timer", "synthetic");
+	PUT(w, 0x200, 0x6005, 0xF015, 0xF107, 0xF118, 0xE09E, 0x7101,
+		0xE0A1, 0x7101, 0xF207, 0x1202);
+
+	/* CXNN */
+	w = add_workload("random", "synthetic");
+	PUT(w, 0x200, 0xC0FF, 0xC10F, 0xC2F0, 0x8014, 0xC3FF, 0x8234, 0x1200);
+
+	/* FX29/DXYN sprites across the screen, 00E0 every 256 loops */
+	w = add_workload("draw", "synthetic");
+	PUT(w, 0x200, 0xF229, 0xD015, 0x7008, 0x7103, 0x7201, 0x7301, 0x4300,
+		0x00E0, 0x1200);
+
+	/* FX55 rewrites the instruction at 0x20A every loop */
+	w = add_workload("smc", "synthetic");
+	PUT(w, 0x200, 0x6074, 0x7101, 0xA20A, 0xF155, 0x8230, 0x0000, 0x7201, 0x1200);
+	PUT(w, 0x20A, 0x7400);
+}
+
+static int add_rom(const char* path) {
+	WORKLOAD* w;
+	FILE* f;
+	const char* name = strrchr(path, '/');
+
+	w = add_workload(name != NULL ? name + 1 : path, "rom");
+	if (w == NULL) {
+		return 1;
+	}
+	f = fopen(path, "rb");
+	if (f == NULL) {
+		perror(path);
+		workload_count--;
+		return 1;
+	}
+	w->size = (uint16_t)fread(w->program, 1, sizeof(w->program), f);
+	fclose(f);
+	return 0;
+}
+
+/* ENGINES */
+
+static uint64_t run_execute(CHIP8* c, uint64_t count) {
+	uint64_t n = 0;
+	while (n < count && c->cpu_state == CHIP8_STATE_EXE) {
+		chip8_execute(c);
+		if (++n % INSTRUCTIONS_PER_FRAME == 0) {
+			chip8_step_timers(c);
+		}
+	}
+	return n;
+}
+
+static uint64_t run_run(CHIP8* c, uint64_t count) {
+	uint64_t n = 0;
+	uint32_t frame = 0;
+	while (n < count) {
+		uint32_t budget = INSTRUCTIONS_PER_FRAME - frame;
+		uint32_t executed = 0;
+		CHIP8_RUN_EXIT exit;
+		if (count - n < budget) {
+			budget = (uint32_t)(count - n);
+		}
+		exit = chip8_run(c, budget, &executed);
+		n += executed;
+		frame += executed;
+		if (exit == CHIP8_RUN_EXIT_ERROR || exit == CHIP8_RUN_EXIT_HALT || exit == CHIP8_RUN_EXIT_KEY_WAIT) {
+			// no input; a key wait never ends
+			break;
+		}
+		if (frame == INSTRUCTIONS_PER_FRAME) {
+			chip8_step_timers(c);
+			frame = 0;
+		}
+	}
+	return n;
+}
+
+#ifdef CHIP8_JIT_X64
+static CHIP8_JIT jit;
+static uint64_t run_jit(CHIP8* c, uint64_t count) {
+	uint64_t n = 0;
+	uint32_t frame = 0;
+	chip8_jit_flush(&jit);
+	while (n < count) {
+		uint32_t budget = INSTRUCTIONS_PER_FRAME - frame;
+		uint32_t executed = 0;
+		CHIP8_RUN_EXIT exit;
+		if (count - n < budget) {
+			budget = (uint32_t)(count - n);
+		}
+		exit = chip8_jit_run(&jit, c, budget, &executed);
+		n += executed;
+		frame += executed;
+		if (exit == CHIP8_RUN_EXIT_ERROR || exit == CHIP8_RUN_EXIT_HALT || exit == CHIP8_RUN_EXIT_KEY_WAIT) {
+			// no input; a key wait never ends
+			break;
+		}
+		if (frame == INSTRUCTIONS_PER_FRAME) {
+			chip8_step_timers(c);
+			frame = 0;
+		}
+	}
+	return n;
+}
+#endif
+
+static CHIP8_BATCH batch;
+static uint64_t run_batch(CHIP8* c, uint64_t count) {
+	/* every lane runs the same program; count is per lane. Lane 0 is copied back */
+	uint64_t n = 0;
+	batch.quirks = c->quirks;
+	for (uint32_t lane = 0; lane < CHIP8_BATCH_LANES; ++lane) {
+		chip8_batch_set_lane(&batch, lane, c);
+	}
+	while (n < count) {
+		uint32_t steps = INSTRUCTIONS_PER_FRAME;
+		if (count - n < steps) {
+			steps = (uint32_t)(count - n);
+		}
+		chip8_batch_run(&batch, steps);
+		n += steps;
+		if (steps == INSTRUCTIONS_PER_FRAME) {
+			chip8_batch_step_timers(&batch);
+		}
+	}
+	chip8_batch_get_lane(&batch, 0, c);
+	return n;
+}
+
+static const ENGINE engines[] = {
+	{ "execute", run_execute, 1 },
+	{ "run", run_run, 1 },
+#ifdef CHIP8_JIT_X64
+	{ "jit", run_jit, 1 },
+#endif
+	{ "batch", run_batch, CHIP8_BATCH_LANES },
+};
+#define ENGINE_COUNT ((int)(sizeof(engines) / sizeof(engines[0])))
+
+/* REPORT */
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static uint32_t state_hash(const CHIP8* c) {
+	/* FNV-1a over the architectural state */
+	uint32_t hash = 0x811C9DC5;
+#define HASH(p, size) for (size_t i_ = 0; i_ < (size); ++i_) hash = (hash ^ ((const uint8_t*)(p))[i_]) * 0x01000193
+	HASH(c->v, sizeof(c->v));
+	HASH(&c->i, sizeof(c->i));
+	HASH(&c->pc, sizeof(c->pc));
+	HASH(&c->sp, sizeof(c->sp));
+	HASH(c->stack, sizeof(c->stack));
+	HASH(c->ram, sizeof(c->ram));
+	HASH(c->display, sizeof(c->display));
+	HASH(&c->delay_timer, 1);
+	HASH(&c->sound_timer, 1);
+#undef HASH
+	return hash;
+}
+
+static void print_config(void) {
+	printf("  \"config\": {\n");
+	printf("    \"dispatch\": \"%s\",\n",
+#ifdef CHIP8_DISPATCH_THREADED
+		"threaded"
+#else
+		"switch"
+#endif
+	);
+	printf("    \"predecode\": %s,\n",
+#ifdef CHIP8_PREDECODE
+		"true"
+#else
+		"false"
+#endif
+	);
+	printf("    \"fusion\": %s,\n",
+#ifdef CHIP8_FUSION
+		"true"
+#else
+		"false"
+#endif
+	);
+	printf("    \"quirk_engines\": %s,\n",
+#ifdef CHIP8_QUIRK_ENGINES
+		"true"
+#else
+		"false"
+#endif
+	);
+	printf("    \"batch_lanes\": %d,\n", CHIP8_BATCH_LANES);
+	printf("    \"quirks\": %u,\n", quirks);
+	printf("    \"instructions\": %llu,\n", (unsigned long long)instructions);
+	printf("    \"repeats\": %d\n", repeats);
+	printf("  },\n");
+}
+
+static int engine_selected(const char* list, const char* name) {
+	/* list is comma separated; NULL selects every engine */
+	size_t length = strlen(name);
+	const char* p = list;
+	if (list == NULL) {
+		return 1;
+	}
+	while ((p = strstr(p, name)) != NULL) {
+		if ((p == list || p[-1] == ',') && (p[length] == '\0' || p[length] == ',')) {
+			return 1;
+		}
+		p += length;
+	}
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	const char* engine_list = NULL;
+	int first = 1;
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+			instructions = strtoull(argv[++i], NULL, 0);
+		}
+		else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+			repeats = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-q") == 0 && i + 1 < argc) {
+			quirks = (uint32_t)strtoul(argv[++i], NULL, 0);
+		}
+		else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+			engine_list = argv[++i];
+		}
+		else if (argv[i][0] == '-') {
+			fprintf(stderr, "usage: %s [-n instructions] [-r repeats] [-q quirks] [-e engine,...] [rom.ch8 ...]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (repeats < 1) {
+		repeats = 1;
+	}
+
+	add_synthetic();
+	for (int i = 1; i < argc; ++i) {
+		if (argv[i][0] == '-') {
+			i++;
+		}
+		else if (add_rom(argv[i]) != 0) {
+			return 1;
+		}
+	}
+
+#ifdef CHIP8_JIT_X64
+	if (chip8_jit_init(&jit) != 0) {
+		fprintf(stderr, "jit init failed\n");
+		return 1;
+	}
+#endif
+
+	printf("{\n");
+	print_config();
+	printf("  \"results\": [\n");
+
+	for (int w = 0; w < workload_count; ++w) {
+		for (int e = 0; e < ENGINE_COUNT; ++e) {
+			double best = 0.0;
+			uint64_t executed = 0;
+
+			if (!engine_selected(engine_list, engines[e].name)) {
+				continue;
+			}
+
+			/* best of repeats, from the same start state */
+			for (int r = 0; r < repeats; ++r) {
+				double start;
+				double seconds;
+
+				chip8_init_cpu(&chip8);
+				chip8_set_quirks(&chip8, quirks);
+				chip8_load_program(&chip8, workloads[w].program, workloads[w].size);
+
+				start = now();
+				executed = engines[e].run(&chip8, instructions);
+				seconds = now() - start;
+				if (r == 0 || seconds < best) {
+					best = seconds;
+				}
+			}
+
+			executed *= engines[e].lanes;
+			printf("%s    { \"workload\": \"%s\", \"kind\": \"%s\", \"engine\": \"%s\", \"instructions\": %llu, "
+				"\"seconds\": %.6f, \"instructions_per_sec\": %.0f, \"ns_per_instruction\": %.3f, "
+				"\"error\": %s, \"state_hash\": \"%08x\" }",
+				first ? "" : ",\n", workloads[w].name, workloads[w].kind, engines[e].name,
+				(unsigned long long)executed, best,
+				best > 0.0 ? (double)executed / best : 0.0,
+				executed > 0 ? best * 1e9 / (double)executed : 0.0,
+				chip8.cpu_state == CHIP8_STATE_ERROR_OPCODE ? "true" : "false",
+				state_hash(&chip8));
+			first = 0;
+			fflush(stdout);
+		}
+	}
+
+	printf("\n  ]\n}\n");
+
+#ifdef CHIP8_JIT_X64
+	chip8_jit_destroy(&jit);
+#endif
+	return 0;
+}
@@ -0,0 +1,160 @@
+// chip8_cfg_test.c
+//
+// GitHub: https:\\github.com\tommojphillips
+
+/* Control flow graph test. Builds the graph of small hand-written ROMs and
+ * checks block boundaries, exits, edges and the address map. Prints each
+ * failed check and exits 1 if any failed.
+ *
+ * Build: cc -O2 -I.. chip8_cfg_test.c ../chip8.c ../chip8_cfg.c -o chip8_cfg_test
+ * Usage: chip8_cfg_test */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "chip8.h"
+#include "chip8_cfg.h"
+
+void chip8_render(CHIP8* chip8) { (void)chip8; }
+void chip8_beep(CHIP8* chip8) { (void)chip8; }
+
+static CHIP8_CFG cfg;
+static int failed = 0;
+
+#define CHECK(c) do { if (!(c)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #c); failed = 1; } } while (0)
+
+static void build(const uint16_t* words, uint32_t count, uint32_t size, CHIP8_PLATFORM platform) {
+	/* Build the graph of count opcodes, truncated to size bytes */
+
+	static uint8_t program[CHIP8_MEMORY_BYTES - CHIP8_PROGRAM_ADDR];
+
+	for (uint32_t i = 0; i < count; ++i) {
+		program[2 * i] = (uint8_t)(words[i] >> 8);
+		program[2 * i + 1] = (uint8_t)words[i];
+	}
+	CHECK(chip8_cfg_build(&cfg, program, size, platform) == 0);
+}
+static const CHIP8_CFG_BLOCK* block(uint16_t address) {
+	/* Block starting at address; fails the check and returns block 0 if none */
+
+	uint16_t b = chip8_cfg_block_at(&cfg, address);
+	if (b == CHIP8_CFG_NONE) {
+		printf("FAIL: no block at %03X\n", address);
+		failed = 1;
+		return &cfg.blocks[0];
+	}
+	return &cfg.blocks[b];
+}
+static int edge(uint16_t from, uint16_t to, CHIP8_CFG_EDGE_KIND kind) {
+	/* Whether the block at from has an edge of kind to the block at to */
+
+	const CHIP8_CFG_BLOCK* b = block(from);
+	for (uint32_t e = 0; e < b->edge_count; ++e) {
+		const CHIP8_CFG_EDGE* x = &cfg.edges[b->edge + e];
+		if (cfg.blocks[x->block].start == to && x->kind == kind) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void test_straight_line(void) {
+	/* A jump back into the middle of code walked earlier splits it once, at the jump target */
+
+	static const uint16_t rom[] = {
+		0x6000,			// 200 LD V0, 0
+		0x6101,			// 202 LD V1, 1
+		0x8014,			// 204 ADD V0, V1
+		0x7101,			// 206 ADD V1, 1
+		0x3100,			// 208 SE V1, 0
+		0x1204,			// 20A JP 204
+		0xA220,			// 20C LD I, 220
+		0xD015,			// 20E DRW V0, V1, 5
+		0x2216,			// 210 CALL 216
+		0x1200,			// 212 JP 200
+		0x00EE,			// 214 RET; unreachable
+		0x00EE,			// 216 RET
+	};
+
+	build(rom, sizeof(rom) / sizeof(rom[0]), sizeof(rom), CHIP8_PLATFORM_CHIP8);
+
+	CHECK(cfg.block_count == 6);
+	CHECK(block(0x200)->end == 0x204 && block(0x200)->exit == CHIP8_CFG_EXIT_FALL && block(0x200)->instructions == 2);
+	CHECK(block(0x204)->end == 0x20A && block(0x204)->exit == CHIP8_CFG_EXIT_SKIP && block(0x204)->instructions == 3);
+	CHECK(block(0x20A)->end == 0x20C && block(0x20A)->exit == CHIP8_CFG_EXIT_JUMP);
+	CHECK(block(0x20C)->end == 0x212 && block(0x20C)->exit == CHIP8_CFG_EXIT_CALL && block(0x20C)->next == 0x212);
+	CHECK(block(0x212)->end == 0x214 && block(0x212)->exit == CHIP8_CFG_EXIT_JUMP);
+	CHECK(block(0x216)->end == 0x218 && block(0x216)->exit == CHIP8_CFG_EXIT_RETURN);
+	CHECK(chip8_cfg_block_at(&cfg, 0x206) == CHIP8_CFG_NONE);
+	CHECK(chip8_cfg_block_at(&cfg, 0x214) == CHIP8_CFG_NONE && !(cfg.map[0x214] & CHIP8_CFG_CODE));
+
+	CHECK(edge(0x200, 0x204, CHIP8_CFG_EDGE_FALL));
+	CHECK(edge(0x204, 0x20A, CHIP8_CFG_EDGE_FALL) && edge(0x204, 0x20C, CHIP8_CFG_EDGE_SKIP));
+	CHECK(edge(0x20A, 0x204, CHIP8_CFG_EDGE_JUMP));
+	CHECK(edge(0x20C, 0x216, CHIP8_CFG_EDGE_CALL));
+	CHECK(edge(0x212, 0x200, CHIP8_CFG_EDGE_JUMP));
+	CHECK(edge(0x216, 0x212, CHIP8_CFG_EDGE_RETURN));
+	CHECK(cfg.block_of[0x206] == chip8_cfg_block_at(&cfg, 0x204));
+	CHECK((cfg.map[0x220] & CHIP8_CFG_SPRITE) && (cfg.map[0x224] & CHIP8_CFG_SPRITE) && !(cfg.map[0x225] & CHIP8_CFG_SPRITE));
+}
+static void test_calls(void) {
+	/* Skips, calls, returns and BNNN; the sprite after the code is not code */
+
+	static const uint16_t rom[] = {
+		0x00E0,			// 200 CLS
+		0xA220,			// 202 LD I, 220
+		0xD015,			// 204 DRW V0, V1, 5
+		0x2210,			// 206 CALL 210
+		0x3000,			// 208 SE V0, 0
+		0x1208,			// 20A JP 208
+		0xB300,			// 20C JP V0, 300
+		0x0000,			// 20E
+		0x6005,			// 210 LD V0, 5
+		0x4001,			// 212 SNE V0, 1
+		0x00EE,			// 214 RET
+		0x00EE,			// 216 RET
+		0x0000, 0x0000, 0x0000, 0x0000,
+		0xF090, 0x9090, 0xF000, // 220 sprite
+	};
+
+	build(rom, sizeof(rom) / sizeof(rom[0]), sizeof(rom) - 1, CHIP8_PLATFORM_CHIP8);
+
+	CHECK(cfg.block_count == 7);
+	CHECK(block(0x200)->exit == CHIP8_CFG_EXIT_CALL && block(0x200)->instructions == 4);
+	CHECK(edge(0x200, 0x210, CHIP8_CFG_EDGE_CALL));
+	CHECK(edge(0x208, 0x20A, CHIP8_CFG_EDGE_FALL) && edge(0x208, 0x20C, CHIP8_CFG_EDGE_SKIP));
+	CHECK(edge(0x20A, 0x208, CHIP8_CFG_EDGE_JUMP));
+	CHECK(block(0x20C)->exit == CHIP8_CFG_EXIT_INDIRECT && block(0x20C)->edge_count == 0 && block(0x20C)->target == 0x300);
+	CHECK(edge(0x210, 0x214, CHIP8_CFG_EDGE_FALL) && edge(0x210, 0x216, CHIP8_CFG_EDGE_SKIP));
+	CHECK(edge(0x214, 0x208, CHIP8_CFG_EDGE_RETURN) && edge(0x216, 0x208, CHIP8_CFG_EDGE_RETURN));
+	CHECK(cfg.map[0x210] & CHIP8_CFG_SUBROUTINE);
+	CHECK(!(cfg.map[0x20E] & CHIP8_CFG_CODE) && !(cfg.map[0x220] & CHIP8_CFG_CODE));
+	CHECK(cfg.block_of[0x203] == chip8_cfg_block_at(&cfg, 0x200) && cfg.block_of[0x20E] == CHIP8_CFG_NONE);
+}
+static void test_xochip(void) {
+	/* F000 NNNN is one instruction on XO-CHIP and skips step over it */
+
+	static const uint16_t rom[] = {
+		0x3000,			// 200 SE V0, 0
+		0xF000, 0x0FF0,	// 202 LD I, 0FF0
+		0x1208,			// 206 JP 208
+		0x00FD,			// 208 EXIT
+	};
+
+	build(rom, sizeof(rom) / sizeof(rom[0]), sizeof(rom), CHIP8_PLATFORM_XOCHIP);
+	CHECK(cfg.blocks[0].target == 0x206 && cfg.blocks[0].next == 0x202);
+	CHECK(block(0x202)->end == 0x206 && block(0x202)->exit == CHIP8_CFG_EXIT_FALL);
+	CHECK(block(0x208)->exit == CHIP8_CFG_EXIT_HALT);
+
+	build(rom, sizeof(rom) / sizeof(rom[0]), sizeof(rom), CHIP8_PLATFORM_CHIP8);
+	CHECK(chip8_cfg_block_at(&cfg, 0x202) == CHIP8_CFG_NONE && cfg.blocks[0].target == 0x204);
+}
+
+int main(void) {
+	test_straight_line();
+	test_calls();
+	test_xochip();
+
+	printf(failed ? "FAILED\n" : "OK\n");
+	return failed;
+}
@@ -0,0 +1,164 @@
+// chip8_golden_test.c
+//
+// GitHub: https:\\github.com\tommojphillips
+
+/* Golden state test. Runs random CHIP-8 programs from a fixed seed through
+ * chip8_run under random quirks, stepping the timers between bursts, and
+ * checks a hash of each program's final state against the hash the
+ * original switch interpreter (338b49b) gives for the same program, run
+ * with chip8_execute and the same timer steps. The hashes below were made
+ * by building this file's program and hash code against that commit's
+ * chip8.c. Covers whichever engine the build selects, as chip8_run_test
+ * does; a change to the table means the engines no longer match the
+ * original interpreter.
+ *
+ * The mix leaves out what the original does differently on purpose or
+ * cannot run: CXNN (chip8_random was the host's), FX0A, FX07 (chip8_run
+ * stops early on an idle loop), calls and returns (its stack did not wrap),
+ * jumps to self (chip8_run halts on them), DXYN with VF as a coordinate,
+ * and the CLS_ON_RESET and DISPLAY_WAIT quirks. The hash covers v, i, pc,
+ * sp, the stack, the timers, ram and the 64x32 display.
+ *
+ * Build: cc -O2 -I.. chip8_golden_test.c ../chip8.c -o chip8_golden_test */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "chip8.h"
+#include "chip8_test.h"
+
+#define PROGRAMS 64
+#define PROGRAM_BYTES 512
+#define BURSTS 100
+#define INSTRUCTIONS_PER_BURST 100
+
+void chip8_render(CHIP8* chip8) { (void)chip8; }
+void chip8_beep(CHIP8* chip8) { (void)chip8; }
+
+/* Every CHIP-8 opcode the original runs as chip8_run does; jumps stay in
+ * the program, I stays below 0x800 but for FX1E and FX55/FX65 */
+static const TEST_OPCODE mix[] = {
+	{ 0x00E0, 0x000 },	// CLS
+	{ 0x1200, 0x1FE },	// JP
+	{ 0x3000, 0xFFF },	// SE VX, NN
+	{ 0x4000, 0xFFF },	// SNE VX, NN
+	{ 0x5000, 0xFF0 },	// SE VX, VY
+	{ 0x6000, 0xFFF },	// LD VX, NN
+	{ 0x7000, 0xFFF },	// ADD VX, NN
+	{ 0x8000, 0xFF7 },	// 8XY0 - 8XY7
+	{ 0x8000, 0xFF7 },
+	{ 0x800E, 0xFF0 },	// SHL VX, VY
+	{ 0x9000, 0xFF0 },	// SNE VX, VY
+	{ 0xA000, 0x7FF },	// LD I, NNN
+	{ 0xD000, 0xEEF },	// DRW VX, VY, N; X and Y not F
+	{ 0xD000, 0xEEF },
+	{ 0xE09E, 0xF00 },	// SKP VX
+	{ 0xE0A1, 0xF00 },	// SKNP VX
+	{ 0xF015, 0xF00 },	// LD DT, VX
+	{ 0xF018, 0xF00 },	// LD ST, VX
+	{ 0xF01E, 0xF00 },	// ADD I, VX
+	{ 0xF029, 0xF00 },	// LD F, VX
+	{ 0xF033, 0xF00 },	// LD B, VX
+	{ 0xF055, 0xF00 },	// LD [I], VX
+	{ 0xF065, 0xF00 },	// LD VX, [I]
+};
+
+/* State hashes from the original interpreter, by program */
+static const uint32_t golden[PROGRAMS] = {
+	0xB505505F,	0x912B287D,	0x4625C442,	0x16D36DBC,
+	0x484032F3,	0xC830D1AC,	0x98DBCC9F,	0x19FC5C96,
+	0x4C68EE25,	0x79AAD82A,	0x1E9CA992,	0xEA170BD2,
+	0x57A4B4BF,	0x7CCB2EC0,	0x031962D3,	0x50E1F8C5,
+	0xE83F26E2,	0x9FD9E46B,	0x312C3A44,	0x23A71054,
+	0xE649030E,	0xADED3E65,	0x958F0C03,	0x3A4049DC,
+	0xA1EAC89F,	0xC93A9FB0,	0xD3523F52,	0x7FC3D839,
+	0x35B8D129,	0x3B7CE9B3,	0x7B0B7577,	0x1F9CDD9F,
+	0x3B4525C7,	0x9C959C56,	0xB65D7F59,	0x730D9AD9,
+	0x8B29720A,	0x370821B9,	0x9BD05DAA,	0x473EE10F,
+	0x40BCF258,	0x549331BE,	0xC16CF29F,	0x63EF7D59,
+	0x53766D20,	0x06CFEFD8,	0xA51C5802,	0x7B52ACB5,
+	0x916EFCD3,	0x06C1E69B,	0x2EBD30F7,	0xF8E4C8BD,
+	0x2F329AEC,	0xE8A2C737,	0xB42E0000,	0xD8769893,
+	0x54DA8A6F,	0x1D82080A,	0x44FB7457,	0x96C89F67,
+	0xC3C34AC1,	0x9FBBF4D7,	0xEB432DDC,	0xAB229500
+};
+
+static CHIP8 chip8;
+
+static void golden_program(uint8_t* program, int p) {
+	/* Program p; jumps to self jump to the next instruction instead */
+	seed = p * 2654435761u + 11;
+	random_program(program, PROGRAM_BYTES, mix, sizeof(mix) / sizeof(mix[0]));
+	for (int n = 0; n < PROGRAM_BYTES; n += 2) {
+		uint16_t opcode = (uint16_t)(program[n] << 8 | program[n + 1]);
+		if (opcode == (0x1000 | (CHIP8_PROGRAM_ADDR + n))) {
+			program[n + 1] += 2;
+		}
+	}
+}
+static uint32_t golden_hash(const CHIP8* chip8) {
+	/* FNV-1a of the state both interpreters share, a field at a time */
+	uint8_t bytes[2 * CHIP8_STACK_SIZE + 8];
+	uint32_t hash = 2166136261u;
+	int n = 0;
+
+	bytes[n++] = (uint8_t)chip8->i;
+	bytes[n++] = (uint8_t)(chip8->i >> 8);
+	bytes[n++] = (uint8_t)chip8->pc;
+	bytes[n++] = (uint8_t)(chip8->pc >> 8);
+	bytes[n++] = (uint8_t)chip8->sp;
+	bytes[n++] = (uint8_t)(chip8->sp >> 8);
+	bytes[n++] = chip8->delay_timer;
+	bytes[n++] = chip8->sound_timer;
+	for (int i = 0; i < CHIP8_STACK_SIZE; ++i) {
+		bytes[n++] = (uint8_t)chip8->stack[i];
+		bytes[n++] = (uint8_t)(chip8->stack[i] >> 8);
+	}
+
+	for (int i = 0; i < n; ++i) {
+		hash = (hash ^ bytes[i]) * 16777619u;
+	}
+	for (int i = 0; i < CHIP8_REGISTER_COUNT; ++i) {
+		hash = (hash ^ chip8->v[i]) * 16777619u;
+	}
+	for (int i = 0; i < 0x1000; ++i) {
+		hash = (hash ^ chip8->ram[i]) * 16777619u;
+	}
+	for (int i = 0; i < CHIP8_DISPLAY_WIDTH * CHIP8_DISPLAY_HEIGHT; ++i) {
+		hash = (hash ^ (CHIP8_DISPLAY_GET_PX(chip8->display, i) ? 1 : 0)) * 16777619u;
+	}
+	return hash;
+}
+
+int main(void) {
+	uint8_t program[PROGRAM_BYTES];
+	int failed = 0;
+
+	for (int p = 0; p < PROGRAMS; ++p) {
+		uint32_t hash;
+
+		golden_program(program, p);
+		chip8_init_cpu(&chip8);
+		chip8_set_quirks(&chip8, next_random() & 0x76); // not CLS_ON_RESET or DISPLAY_WAIT
+		chip8_load_program(&chip8, program, sizeof(program));
+
+		for (int burst = 0; burst < BURSTS; ++burst) {
+			if (chip8_run(&chip8, INSTRUCTIONS_PER_BURST, NULL) != CHIP8_RUN_EXIT_COMPLETE) {
+				break;
+			}
+			chip8_step_timers(&chip8);
+		}
+
+		hash = golden_hash(&chip8);
+		if (hash != golden[p]) {
+			printf("FAIL program %d: hash %08X, original %08X, pc %03X\n", p, hash, golden[p], chip8.pc);
+			failed = 1;
+		}
+	}
+
+	if (failed) {
+		return 1;
+	}
+	printf("OK %d programs\n", PROGRAMS);
+	return 0;
+}
@@ -0,0 +1,183 @@
+// chip8_replay_test.c
+//
+// GitHub: https:\\github.com\tommojphillips
+
+/* Record and replay fuzz test. Records random programs on each platform,
+ * driven by random keypad changes, timer steps and chip8_run bursts,
+ * replays each recording into a second instance in chunks of a different
+ * size, and checks that the replay executes as many instructions and ends
+ * in the same machine state. Also checks that replaying into different ram is refused,
+ * and that a key wait the recording does not have stops the replay.
+ * Prints the first mismatch and exits 1 if any.
+ *
+ * Build: cc -O2 -I.. chip8_replay_test.c ../chip8.c ../chip8_replay.c -o chip8_replay_test
+ * Usage: chip8_replay_test [programs] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "chip8.h"
+#include "chip8_replay.h"
+#include "chip8_test.h"
+
+#define PROGRAM_BYTES 512
+#define STEPS 3000
+
+void chip8_render(CHIP8* chip8) { (void)chip8; }
+void chip8_beep(CHIP8* chip8) { (void)chip8; }
+
+/* Opcodes weighted towards the keypad, the timers and randomness; SCHIP
+ * programs draw from the mix up to MIX_SCHIP, XO-CHIP ones from all of it */
+static const TEST_OPCODE mix[] = {
+	{ 0xA000, 0xFFF },	// LD I, NNN
+	{ 0xF00A, 0xF00 },	// LD VX, K
+	{ 0xE09E, 0xF00 },	// SKP VX
+	{ 0xD000, 0xFFF },	// DRW VX, VY, N
+	{ 0x1200, 0x1FE },	// JP
+	{ 0x6000, 0xF0F },	// LD VX, NN; keys 0-F
+	{ 0xF007, 0xF00 },	// LD VX, DT
+	{ 0xC000, 0xFFF },	// RND VX, NN
+	{ 0xF015, 0xF00 },	// LD DT, VX
+	{ 0x3000, 0xFFF },	// SE VX, NN
+	{ 0xE0A1, 0xF00 },	// SKNP VX
+	{ 0x8004, 0xFF0 },	// ADD VX, VY
+	{ 0x00FF, 0x000 },	// HIGH
+	{ 0x00C0, 0x00F },	// SCD N
+	{ 0xF075, 0x700 },	// LD R, VX
+	{ 0xF085, 0x700 },	// LD VX, R
+	{ 0x5002, 0xFF1 },	// SAVE VX - VY, LOAD VX - VY
+	{ 0xF001, 0x300 },	// PLANE N
+	{ 0x00D0, 0x00F },	// SCU N
+	{ 0xF03A, 0xF00 },	// PITCH VX
+};
+#define MIX_CHIP8 12
+#define MIX_SCHIP 16
+#define MIX_XOCHIP (sizeof(mix) / sizeof(mix[0]))
+
+static CHIP8 recorded;
+static CHIP8 replayed;
+static CHIP8_XO recorded_xo;
+static CHIP8_XO replayed_xo;
+
+int main(int argc, char** argv) {
+	static const CHIP8_PLATFORM platforms[] = { CHIP8_PLATFORM_CHIP8, CHIP8_PLATFORM_SCHIP, CHIP8_PLATFORM_XOCHIP };
+	static const uint32_t mix_sizes[] = { MIX_CHIP8, MIX_SCHIP, MIX_XOCHIP }; // by CHIP8_PLATFORM
+	uint8_t program[PROGRAM_BYTES];
+	int programs = (argc > 1) ? atoi(argv[1]) : 100;
+	long bytes = 0;
+	long events = 0;
+
+	for (int p = 0; p < programs; ++p) {
+		CHIP8_RECORDER recorder;
+		CHIP8_REPLAY replay;
+		uint64_t total = 0;
+		uint32_t executed;
+		FILE* file = tmpfile();
+
+		if (file == NULL) {
+			printf("FAIL: tmpfile\n");
+			return 1;
+		}
+
+		/* a third of the programs on each platform, unless built with CHIP8_NO_SCHIP */
+		chip8_init_cpu(&recorded);
+		chip8_init_cpu(&replayed);
+		recorded.xo = &recorded_xo;
+		replayed.xo = &replayed_xo;
+		if (chip8_set_platform(&recorded, platforms[p % 3]) != 0) {
+			chip8_set_platform(&recorded, CHIP8_PLATFORM_CHIP8);
+		}
+		chip8_set_platform(&replayed, (CHIP8_PLATFORM)recorded.platform);
+
+		seed = p * 2654435761u + 7;
+		random_program(program, sizeof(program), mix, mix_sizes[recorded.platform]);
+
+		chip8_set_quirks(&recorded, next_random() & 0xF6); // every quirk but CLS_ON_RESET
+		chip8_load_program(&recorded, program, sizeof(program));
+		chip8_load_program(&replayed, program, sizeof(program));
+
+		chip8_record_begin(&recorder, file, &recorded, p * 11);
+		for (int step = 0; step < STEPS; ++step) {
+			uint32_t action = next_random() % 8;
+			if (action == 0) {
+				chip8_record_set_keypad(&recorder, &recorded, (uint16_t)(next_random() & next_random()));
+				events++;
+			}
+			else if (action == 1) {
+				chip8_record_step_timers(&recorder, &recorded);
+				events++;
+			}
+			else {
+				chip8_record_run(&recorder, &recorded, next_random() % 40, NULL);
+			}
+		}
+		if (chip8_record_end(&recorder, &recorded) != 0) {
+			printf("FAIL program %d: write error\n", p);
+			return 1;
+		}
+		bytes += ftell(file);
+
+		/* replay in chunks that do not line up with the recorded runs */
+		rewind(file);
+		if (chip8_replay_begin(&replay, file, &replayed) != 0) {
+			printf("FAIL program %d: replay begin\n", p);
+			return 1;
+		}
+		for (int calls = 0; !chip8_replay_done(&replay); ++calls) {
+			if (calls == 1000000) {
+				printf("FAIL program %d: replay stuck at %llu instructions\n", p, (unsigned long long)total);
+				return 1;
+			}
+			chip8_replay_run(&replay, &replayed, 1 + next_random() % 5000, &executed);
+			total += executed;
+		}
+		if (total != recorder.instructions || !same(&recorded, &replayed)) {
+			printf("FAIL program %d: %llu instructions replayed of %llu\n", p, (unsigned long long)total, (unsigned long long)recorder.instructions);
+			return 1;
+		}
+
+		/* the ram hash rejects an instance without the program */
+		chip8_init_cpu(&replayed);
+		rewind(file);
+		if (chip8_replay_begin(&replay, file, &replayed) != 2) {
+			printf("FAIL program %d: replay into different ram accepted\n", p);
+			return 1;
+		}
+		fclose(file);
+	}
+
+	/* a key wait the recording does not have stops the replay rather than spinning */
+	{
+		static const uint8_t loop[] = { 0x70, 0x01, 0x12, 0x00 }; // ADD V0, 1; JP 200
+		CHIP8_RECORDER recorder;
+		CHIP8_REPLAY replay;
+		uint32_t executed;
+		FILE* file = tmpfile();
+
+		if (file == NULL) {
+			printf("FAIL: tmpfile\n");
+			return 1;
+		}
+		chip8_init_cpu(&recorded);
+		chip8_load_program(&recorded, loop, sizeof(loop));
+		chip8_init_cpu(&replayed);
+		chip8_load_program(&replayed, loop, sizeof(loop));
+		chip8_record_begin(&recorder, file, &recorded, 0);
+		chip8_record_run(&recorder, &recorded, 100, NULL);
+		chip8_record_step_timers(&recorder, &recorded);
+		chip8_record_end(&recorder, &recorded);
+		rewind(file);
+		chip8_replay_begin(&replay, file, &replayed);
+		replayed.cpu_state = CHIP8_STATE_KEY_WAIT;
+		if (chip8_replay_run(&replay, &replayed, 1000, &executed) != CHIP8_RUN_EXIT_KEY_WAIT || executed != 0) {
+			printf("FAIL: replay of a mismatched key wait\n");
+			return 1;
+		}
+		fclose(file);
+	}
+
+	printf("OK %.2f bytes per event\n", (double)bytes / events);
+	return 0;
+}
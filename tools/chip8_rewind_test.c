@@ -0,0 +1,134 @@
+// chip8_rewind_test.c
+//
+// GitHub: https:\\github.com\tommojphillips
+
+/* Rewind fuzz test. Runs random programs, every other one on SCHIP with
+ * its hires, scroll and flag register opcodes, pushing a frame after each
+ * burst of instructions and sometimes stepping back, with ring buffers
+ * from a few bytes (every push drops the older frames) to 1 MB. Keeps a
+ * copy of the instance at every frame and checks that each step back
+ * lands on the copy for that frame, and that a step back chip8_restore
+ * refuses leaves the buffer as it was. Prints the first mismatch and exits
+ * 1 if any.
+ *
+ * Build: cc -O2 -I.. chip8_rewind_test.c ../chip8.c ../chip8_snapshot.c ../chip8_rewind.c -o chip8_rewind_test
+ * Usage: chip8_rewind_test [programs] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "chip8.h"
+#include "chip8_rewind.h"
+#include "chip8_test.h"
+
+#define PROGRAM_BYTES 512
+#define STEPS 2000
+
+void chip8_render(CHIP8* chip8) { (void)chip8; }
+void chip8_beep(CHIP8* chip8) { (void)chip8; }
+
+/* Opcodes weighted towards ram writes, draws and jumps within the program;
+ * SCHIP programs draw from the whole mix, CHIP-8 ones stop at MIX_CHIP8 */
+static const TEST_OPCODE mix[] = {
+	{ 0xA000, 0xFFF },	// LD I, NNN
+	{ 0xF055, 0xF00 },	// LD [I], VX
+	{ 0xF033, 0xF00 },	// LD B, VX
+	{ 0xD000, 0xFFF },	// DRW VX, VY, N
+	{ 0x1200, 0x1FE },	// JP
+	{ 0x6000, 0xFFF },	// LD VX, NN
+	{ 0x7000, 0xFFF },	// ADD VX, NN
+	{ 0xC000, 0xFFF },	// RND VX, NN
+	{ 0x8004, 0xFF0 },	// ADD VX, VY
+	{ 0x8004, 0xFF0 },
+	{ 0x00FF, 0x000 },	// HIGH
+	{ 0x00FE, 0x000 },	// LOW
+	{ 0x00C0, 0x00F },	// SCD N
+	{ 0x00FB, 0x001 },	// SCR, SCL
+	{ 0xD000, 0xFF0 },	// DRW VX, VY, 0
+	{ 0xF075, 0x700 },	// LD R, VX
+	{ 0xF085, 0x700 },	// LD VX, R
+};
+#define MIX_CHIP8 10
+#define MIX_SCHIP (sizeof(mix) / sizeof(mix[0]))
+
+static CHIP8 chip8;
+static CHIP8 frames[STEPS];	// the instance at every frame pushed; frames[top - 1] is the newest
+static CHIP8_REWIND rewind_buffer;
+static uint8_t ring[1 << 20];
+static CHIP8 xo_chip8;
+static CHIP8_XO xo;
+
+int main(int argc, char** argv) {
+	static const uint32_t sizes[] = { sizeof(ring), 20000, 5000, 4507, 3 };
+	uint8_t program[PROGRAM_BYTES];
+	int programs = (argc > 1) ? atoi(argv[1]) : 50;
+	uint32_t back = 0;
+
+	for (int p = 0; p < programs; ++p) {
+		const uint32_t size = sizes[p % (sizeof(sizes) / sizeof(sizes[0]))];
+		int top = 0;
+		int schip;
+
+		/* every other program on SCHIP, unless built with CHIP8_NO_SCHIP */
+		chip8_init_cpu(&chip8);
+		schip = (p & 1) && chip8_set_platform(&chip8, CHIP8_PLATFORM_SCHIP) == 0;
+
+		seed = p * 2654435761u + 1;
+		random_program(program, sizeof(program), mix, schip ? MIX_SCHIP : MIX_CHIP8);
+		chip8_seed_random(&chip8, p);
+		chip8_load_program(&chip8, program, sizeof(program));
+		chip8_rewind_init(&rewind_buffer, ring, size);
+
+		for (int step = 0; step < STEPS; ++step) {
+			if (top > 0 && next_random() % 4 == 0) {
+				/* the oldest frame held restores without being dropped */
+				if (chip8_rewind_step_back(&rewind_buffer, &chip8) == 0) {
+					top--;
+				}
+				if (!same(&chip8, &frames[top - 1])) {
+					printf("FAIL program %d step %d: ring %u bytes, %u frames\n", p, step, size, chip8_rewind_get_frames(&rewind_buffer));
+					return 1;
+				}
+				back++;
+			}
+			else {
+				chip8_run(&chip8, next_random() % 30, NULL);
+				chip8_step_timers(&chip8);
+				chip8_rewind_push(&rewind_buffer, &chip8);
+				memcpy(&frames[top++], &chip8, sizeof(CHIP8));
+			}
+
+			if (chip8_rewind_get_frames(&rewind_buffer) > (uint32_t)top || chip8_rewind_get_used(&rewind_buffer) > size) {
+				printf("FAIL program %d step %d: %u frames held, %u pushed\n", p, step, chip8_rewind_get_frames(&rewind_buffer), top);
+				return 1;
+			}
+		}
+	}
+
+	/* a refused restore keeps the frame it would have stepped back to */
+	xo_chip8.xo = &xo;
+	if (chip8_set_platform(&xo_chip8, CHIP8_PLATFORM_XOCHIP) == 0) { // not built with CHIP8_NO_SCHIP
+		uint32_t used;
+		chip8_rewind_init(&rewind_buffer, ring, sizeof(ring));
+		chip8_rewind_push(&rewind_buffer, &chip8);
+		memcpy(&frames[0], &chip8, sizeof(CHIP8));
+		chip8_run(&chip8, 30, NULL);
+		chip8_step_timers(&chip8);
+		chip8_rewind_push(&rewind_buffer, &chip8);
+		used = chip8_rewind_get_used(&rewind_buffer);
+		if (chip8_rewind_step_back(&rewind_buffer, &xo_chip8) != 2 ||
+			chip8_rewind_get_frames(&rewind_buffer) != 2 || chip8_rewind_get_used(&rewind_buffer) != used) {
+			printf("FAIL: refused step back changed the buffer\n");
+			return 1;
+		}
+		if (chip8_rewind_step_back(&rewind_buffer, &chip8) != 0 || !same(&chip8, &frames[0])) {
+			printf("FAIL: step back after a refused one\n");
+			return 1;
+		}
+	}
+
+	printf("OK %u steps back\n", back);
+	return 0;
+}
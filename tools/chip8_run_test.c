@@ -0,0 +1,122 @@
+// chip8_run_test.c
+//
+// GitHub: https:\\github.com\tommojphillips
+
+/* chip8_run fuzz test. Runs random programs on every platform under random
+ * quirks, once through chip8_run and once through chip8_execute called as
+ * many times as chip8_run reported executing, with the same keypad changes
+ * and timer steps in between, and checks that both instances end every
+ * burst in the same state. A machine that stops on an invalid opcode or
+ * halts is reset and carries on at a random address. Covers whichever
+ * engine the build selects; rebuild with -DCHIP8_DISPATCH_SWITCH,
+ * -DCHIP8_PREDECODE, -DCHIP8_FUSION or -DCHIP8_QUIRK_ENGINES to test the
+ * others. Prints the first mismatch and exits 1 if any.
+ *
+ * Build: cc -O2 -I.. chip8_run_test.c ../chip8.c -o chip8_run_test
+ * Usage: chip8_run_test [programs] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "chip8.h"
+#include "chip8_test.h"
+
+#define PROGRAM_BYTES 1024
+#define STEPS 500
+
+void chip8_render(CHIP8* chip8) { (void)chip8; }
+void chip8_beep(CHIP8* chip8) { (void)chip8; }
+
+/* Any opcode half the time; otherwise jumps, calls and skips that stay in the
+ * program, ram writes and draws, so programs run for a while */
+static const TEST_OPCODE mix[] = {
+	{ 0x1200, 0x3FE },	// JP
+	{ 0x2200, 0x3FE },	// CALL
+	{ 0x00EE, 0x000 },	// RET
+	{ 0x3000, 0xFFF },	// SE VX, NN
+	{ 0xA000, 0xFFF },	// LD I, NNN
+	{ 0xF055, 0xF00 },	// LD [I], VX
+	{ 0xD000, 0xFFF },	// DRW VX, VY, N
+	{ 0x7000, 0xFFF },	// ADD VX, NN
+	{ 0, 0xFFFF }, { 0, 0xFFFF }, { 0, 0xFFFF }, { 0, 0xFFFF },
+	{ 0, 0xFFFF }, { 0, 0xFFFF }, { 0, 0xFFFF }, { 0, 0xFFFF },
+};
+
+static CHIP8 run;
+static CHIP8 execute;
+static CHIP8_XO run_xo;
+static CHIP8_XO execute_xo;
+
+int main(int argc, char** argv) {
+	uint8_t program[PROGRAM_BYTES];
+	int programs = (argc > 1) ? atoi(argv[1]) : 300;
+	uint64_t instructions = 0;
+
+	for (int p = 0; p < programs; ++p) {
+		CHIP8_PLATFORM platform = (CHIP8_PLATFORM)(p % 3);
+		uint32_t quirks;
+
+		seed = p * 2654435761u + 3;
+		random_program(program, sizeof(program), mix, sizeof(mix) / sizeof(mix[0]));
+		quirks = next_random() & 0xFE;
+
+		chip8_init_cpu(&run);
+		chip8_init_cpu(&execute);
+		run.xo = &run_xo;
+		execute.xo = &execute_xo;
+		if (chip8_set_platform(&run, platform) != 0) {
+			platform = CHIP8_PLATFORM_CHIP8; // built with CHIP8_NO_SCHIP
+			run.xo = NULL;
+			execute.xo = NULL;
+		}
+		chip8_set_platform(&execute, platform);
+		chip8_set_quirks(&run, quirks);
+		chip8_set_quirks(&execute, quirks);
+		chip8_seed_random(&run, p);
+		chip8_seed_random(&execute, p);
+		chip8_load_program(&run, program, sizeof(program));
+		chip8_load_program(&execute, program, sizeof(program));
+
+		for (int step = 0; step < STEPS; ++step) {
+			uint32_t action = next_random() % 8;
+			if (run.cpu_state == CHIP8_STATE_ERROR_OPCODE || run.cpu_state == CHIP8_STATE_HLT) {
+				/* carry on from somewhere else in the program */
+				uint16_t pc = CHIP8_PROGRAM_ADDR + (next_random() % PROGRAM_BYTES);
+				chip8_reset_cpu(&run);
+				chip8_reset_cpu(&execute);
+				run.pc = pc;
+				execute.pc = pc;
+			}
+			if (action == 0) {
+				uint16_t keypad = (uint16_t)(next_random() & next_random());
+				chip8_set_keypad(&run, keypad);
+				chip8_set_keypad(&execute, keypad);
+			}
+			else if (action == 1) {
+				chip8_step_timers(&run);
+				chip8_step_timers(&execute);
+			}
+			else {
+				uint32_t executed = 0;
+				CHIP8_RUN_EXIT exit = chip8_run(&run, 1 + next_random() % 200, &executed);
+				for (uint32_t n = 0; n < executed; ++n) {
+					chip8_execute(&execute);
+				}
+				if (exit == CHIP8_RUN_EXIT_ERROR && execute.cpu_state == CHIP8_STATE_EXE) {
+					chip8_execute(&execute); // the invalid opcode is not counted as executed
+				}
+				instructions += executed;
+				if (!same(&run, &execute) || run.dirty_rows != execute.dirty_rows) {
+					printf("FAIL program %d step %d: platform %d, quirks %02X, exit %d after %u instructions, pc %03X/%03X\n",
+						p, step, platform, quirks, exit, executed, run.pc, execute.pc);
+					return 1;
+				}
+			}
+		}
+	}
+
+	printf("OK %llu instructions\n", (unsigned long long)instructions);
+	return 0;
+}
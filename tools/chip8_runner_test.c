@@ -0,0 +1,102 @@
+// chip8_runner_test.c
+//
+// GitHub: https:\\github.com\tommojphillips
+
+/* Runner test. Runs a set of random programs, on the CHIP-8 and SCHIP
+ * platforms under random quirks, through chip8_runner_run_frame with 1, 3
+ * and 8 threads, and checks every instance after every frame against a
+ * copy given the same slice serially with chip8_run and chip8_step_timers.
+ * Some instances stop early on an invalid opcode. Prints the first
+ * mismatch and exits 1 if any.
+ *
+ * Build: cc -O2 -I.. chip8_runner_test.c ../chip8.c ../chip8_runner.c -pthread -o chip8_runner_test
+ * Usage: chip8_runner_test [instances] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "chip8.h"
+#include "chip8_runner.h"
+#include "chip8_test.h"
+
+#define PROGRAM_BYTES 512
+#define FRAMES 200
+#define INSTRUCTIONS_PER_FRAME 500
+
+void chip8_render(CHIP8* chip8) { (void)chip8; }
+void chip8_beep(CHIP8* chip8) { (void)chip8; }
+
+/* Jumps and skips that stay in the program, ram writes, draws and
+ * arithmetic, so programs run for the whole test */
+static const TEST_OPCODE mix[] = {
+	{ 0x1200, 0x1FE },	// JP
+	{ 0x3000, 0xFFF },	// SE VX, NN
+	{ 0xA000, 0xFFF },	// LD I, NNN
+	{ 0xF055, 0xF00 },	// LD [I], VX
+	{ 0xD000, 0xFFF },	// DRW VX, VY, N
+	{ 0xC000, 0xFFF },	// RND VX, NN
+	{ 0xF015, 0xF00 },	// LD DT, VX
+	{ 0x7000, 0xFFF },	// ADD VX, NN
+	{ 0x8000, 0xFF7 },	// 8XY0 - 8XY7
+	{ 0x8000, 0xFF7 },
+};
+
+int main(int argc, char** argv) {
+	static const uint32_t threads[] = { 1, 3, 8 };
+	uint32_t count = (argc > 1) ? (uint32_t)atoi(argv[1]) : 64;
+	CHIP8* instances = (CHIP8*)malloc(count * sizeof(CHIP8));
+	CHIP8* serial = (CHIP8*)malloc(count * sizeof(CHIP8));
+	uint8_t program[PROGRAM_BYTES];
+	uint64_t instructions = 0;
+
+	if (instances == NULL || serial == NULL || count == 0) {
+		printf("FAIL: alloc\n");
+		return 1;
+	}
+
+	for (uint32_t t = 0; t < sizeof(threads) / sizeof(threads[0]); ++t) {
+		CHIP8_RUNNER* runner;
+
+		for (uint32_t n = 0; n < count; ++n) {
+			seed = n * 2654435761u + t + 5;
+			random_program(program, sizeof(program), mix, sizeof(mix) / sizeof(mix[0]));
+			if (n % 5 == 0) {
+				program[next_random() % PROGRAM_BYTES & ~1u] = 0xFF; // FFxx is invalid
+			}
+
+			memset(&instances[n], 0, sizeof(CHIP8));
+			chip8_init_cpu(&instances[n]);
+			chip8_set_platform(&instances[n], (CHIP8_PLATFORM)(n % 2)); // stays CHIP-8 if built with CHIP8_NO_SCHIP
+			chip8_set_quirks(&instances[n], next_random() & 0xFE);
+			chip8_seed_random(&instances[n], n);
+			chip8_load_program(&instances[n], program, sizeof(program));
+			memcpy(&serial[n], &instances[n], sizeof(CHIP8));
+		}
+
+		runner = chip8_runner_create(instances, count, threads[t]);
+		if (runner == NULL) {
+			printf("FAIL: %u threads: create\n", threads[t]);
+			return 1;
+		}
+		for (int frame = 0; frame < FRAMES; ++frame) {
+			instructions += chip8_runner_run_frame(runner, INSTRUCTIONS_PER_FRAME);
+			for (uint32_t n = 0; n < count; ++n) {
+				chip8_run(&serial[n], INSTRUCTIONS_PER_FRAME, NULL);
+				chip8_step_timers(&serial[n]);
+				if (memcmp(&instances[n], &serial[n], sizeof(CHIP8)) != 0) {
+					printf("FAIL %u threads frame %d instance %u: pc %03X/%03X\n",
+						chip8_runner_get_threads(runner), frame, n, instances[n].pc, serial[n].pc);
+					return 1;
+				}
+			}
+		}
+		chip8_runner_destroy(runner);
+	}
+
+	free(instances);
+	free(serial);
+	printf("OK %llu instructions\n", (unsigned long long)instructions);
+	return 0;
+}
@@ -0,0 +1,138 @@
+// chip8_snapshot_test.c
+//
+// GitHub: https:\\github.com\tommojphillips
+
+/* Snapshot fuzz test. Runs random programs, every other one on SCHIP
+ * with hires, scroll and flag register opcodes mixed in, while taking
+ * snapshots into a few slots, restoring them and restoring them into a
+ * fresh instance, and checks the whole machine state against a reference
+ * that keeps whole-struct copies in the same slots instead. Build with -DCHIP8_SNAPSHOT_PAGES as well:
+ * page tracking makes most snapshots partial, so this catches pages that
+ * were written but not copied. Also checks that XO-CHIP is refused.
+ * Prints the first mismatch and exits 1 if any.
+ *
+ * Build: cc -O2 -I.. chip8_snapshot_test.c ../chip8.c ../chip8_snapshot.c -o chip8_snapshot_test
+ * Usage: chip8_snapshot_test [programs] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "chip8.h"
+#include "chip8_snapshot.h"
+#include "chip8_test.h"
+
+#define SLOTS 4
+#define PROGRAM_BYTES 1024
+#define STEPS 400
+
+void chip8_render(CHIP8* chip8) { (void)chip8; }
+void chip8_beep(CHIP8* chip8) { (void)chip8; }
+
+/* Opcodes weighted towards ram writes, draws and jumps within the program;
+ * SCHIP programs draw from the whole mix, CHIP-8 ones stop at MIX_CHIP8 */
+static const TEST_OPCODE mix[] = {
+	{ 0xA000, 0xFFF },	// LD I, NNN
+	{ 0xF055, 0xF00 },	// LD [I], VX
+	{ 0xF033, 0xF00 },	// LD B, VX
+	{ 0xD000, 0xFFF },	// DRW VX, VY, N
+	{ 0x1200, 0x1FE },	// JP
+	{ 0x6000, 0xFFF },	// LD VX, NN
+	{ 0x7000, 0xFFF },	// ADD VX, NN
+	{ 0xC000, 0xFFF },	// RND VX, NN
+	{ 0xF01E, 0xF00 },	// ADD I, VX
+	{ 0x3000, 0xFFF },	// SE VX, NN
+	{ 0x00E0, 0x000 },	// CLS
+	{ 0x8004, 0xFF0 },	// ADD VX, VY
+	{ 0x00FF, 0x000 },	// HIGH
+	{ 0x00FE, 0x000 },	// LOW
+	{ 0x00C0, 0x00F },	// SCD N
+	{ 0x00FB, 0x001 },	// SCR, SCL
+	{ 0xD000, 0xFF0 },	// DRW VX, VY, 0
+	{ 0xF075, 0x700 },	// LD R, VX
+	{ 0xF085, 0x700 },	// LD VX, R
+};
+#define MIX_CHIP8 12
+#define MIX_SCHIP (sizeof(mix) / sizeof(mix[0]))
+
+static CHIP8 chip8;
+static CHIP8 ref;
+static CHIP8 fork;
+static CHIP8 ref_slots[SLOTS];
+static CHIP8_SNAPSHOT slots[SLOTS];
+static CHIP8_XO xo;
+
+int main(int argc, char** argv) {
+	uint8_t program[PROGRAM_BYTES];
+	int valid[SLOTS];
+	int programs = (argc > 1) ? atoi(argv[1]) : 200;
+	uint32_t snapshots = 0;
+	uint32_t partial = 0;
+	int schip;
+
+	for (int p = 0; p < programs; ++p) {
+		/* every other program on SCHIP, unless built with CHIP8_NO_SCHIP */
+		chip8_init_cpu(&chip8);
+		schip = (p & 1) && chip8_set_platform(&chip8, CHIP8_PLATFORM_SCHIP) == 0;
+
+		seed = p * 2654435761u + 1;
+		random_program(program, sizeof(program), mix, schip ? MIX_SCHIP : MIX_CHIP8);
+		chip8_seed_random(&chip8, p);
+		chip8_load_program(&chip8, program, sizeof(program));
+		memcpy(&ref, &chip8, sizeof(CHIP8));
+		memset(slots, 0, sizeof(slots));
+		memset(valid, 0, sizeof(valid));
+
+		for (int step = 0; step < STEPS; ++step) {
+			uint32_t action = next_random() % 10;
+			int s = next_random() % SLOTS;
+
+			if (action < 3) {
+				uint16_t pages;
+				chip8_snapshot(&chip8, &slots[s], &pages);
+				partial += (pages != CHIP8_PAGES_ALL);
+				snapshots++;
+				memcpy(&ref_slots[s], &ref, sizeof(CHIP8));
+				valid[s] = 1;
+			}
+			else if (action < 5 && valid[s]) {
+				chip8_restore(&chip8, &slots[s], NULL);
+				memcpy(&ref, &ref_slots[s], sizeof(CHIP8));
+			}
+			else if (action == 5 && valid[s]) {
+				/* restore into another instance; a snapshot owned by chip8 copies all of ram here */
+				chip8_init_cpu(&fork);
+				chip8_restore(&fork, &slots[s], NULL);
+				if (!same(&fork, &ref_slots[s])) {
+					printf("FAIL program %d step %d: restore into another instance\n", p, step);
+					return 1;
+				}
+			}
+			else {
+				uint32_t count = next_random() % 50;
+				for (uint32_t n = 0; n < count && chip8.cpu_state == CHIP8_STATE_EXE; ++n) {
+					chip8_execute(&ref);
+					chip8_run(&chip8, 1, NULL);
+				}
+			}
+
+			if (!same(&chip8, &ref)) {
+				printf("FAIL program %d step %d: action %u\n", p, step, action);
+				return 1;
+			}
+		}
+	}
+
+	/* XO-CHIP state is in the CHIP8_XO, which a snapshot cannot hold */
+	chip8_init_cpu(&chip8);
+	chip8.xo = &xo;
+	if (chip8_set_platform(&chip8, CHIP8_PLATFORM_XOCHIP) == 0 && // not built with CHIP8_NO_SCHIP
+		(chip8_snapshot(&chip8, &slots[0], NULL) != 2 || chip8_restore(&chip8, &slots[0], NULL) != 2)) {
+		printf("FAIL: XO-CHIP snapshot accepted\n");
+		return 1;
+	}
+
+	printf("OK %u snapshots, %u partial\n", snapshots, partial);
+	return 0;
+}
@@ -0,0 +1,68 @@
+// chip8_test.h
+//
+// GitHub: https:\\github.com\tommojphillips
+
+/* Shared by the tests in tools: the test's own random sequence, random
+ * programs built from a weighted opcode mix, and a comparison of the whole
+ * machine state. Each test is one file and includes this once. */
+
+#ifndef CHIP8_TEST_H
+#define CHIP8_TEST_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "chip8.h"
+
+/* Opcode mix entry; random_opcode fills the bits in random with random bits */
+typedef struct {
+	uint16_t opcode;
+	uint16_t random;
+} TEST_OPCODE;
+
+static uint32_t seed = 1;
+
+static inline uint32_t next_random(void) {
+	/* xorshift32; the test sequence, not the machine's */
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed;
+}
+static inline uint16_t random_opcode(const TEST_OPCODE* mix, uint32_t count) {
+	/* An entry of mix picked at random; repeat an entry to weight it */
+	const TEST_OPCODE* entry = &mix[next_random() % count];
+	return entry->opcode | (next_random() & entry->random);
+}
+static inline void random_program(uint8_t* program, uint32_t size, const TEST_OPCODE* mix, uint32_t count) {
+	/* Fill program with size bytes of opcodes from mix */
+	for (uint32_t n = 0; n + 1 < size; n += 2) {
+		uint16_t opcode = random_opcode(mix, count);
+		program[n] = (uint8_t)(opcode >> 8);
+		program[n + 1] = (uint8_t)opcode;
+	}
+}
+
+static inline int same(const CHIP8* a, const CHIP8* b) {
+	/* Whether a and b hold the same machine state: every field a snapshot
+	 * stores, and the CHIP8_XO on XO-CHIP. Not dirty_rows, which tracks
+	 * rendering rather than the machine */
+	return a->i == b->i && a->pc == b->pc && a->sp == b->sp && a->opcode == b->opcode &&
+		a->keypad == b->keypad && a->fxoa_state == b->fxoa_state &&
+		a->delay_timer == b->delay_timer && a->sound_timer == b->sound_timer &&
+		a->draw_display == b->draw_display && a->cpu_state == b->cpu_state &&
+		a->platform == b->platform && a->hires == b->hires && a->planes == b->planes &&
+		a->quirks == b->quirks && a->frame_debt == b->frame_debt &&
+#ifdef CYCLE_COUNT
+		a->cycles == b->cycles &&
+#endif
+		memcmp(a->v, b->v, sizeof(a->v)) == 0 &&
+		memcmp(a->rpl, b->rpl, sizeof(a->rpl)) == 0 &&
+		memcmp(a->stack, b->stack, sizeof(a->stack)) == 0 &&
+		memcmp(a->ram, b->ram, sizeof(a->ram)) == 0 &&
+		memcmp(a->display, b->display, sizeof(a->display)) == 0 &&
+		memcmp(a->rng, b->rng, sizeof(a->rng)) == 0 &&
+		(a->platform != CHIP8_PLATFORM_XOCHIP || memcmp(a->xo, b->xo, sizeof(CHIP8_XO)) == 0);
+}
+
+#endif